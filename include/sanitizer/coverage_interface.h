@@ -65,6 +65,26 @@ extern "C" {
   // __sanitizer_get_number_of_counters bytes long and 8-aligned.
   uintptr_t
   __sanitizer_update_counter_bitset_and_clear_counters(uint8_t *bitset);
+
+  // With -fsanitize-coverage=trace-cmp every comparison and switch statement
+  // is recorded in a per-thread table that holds the operands of the last
+  // 128 comparisons executed by the thread.
+  // This is intended for in-process fuzzers that look for the values the
+  // input has to contain to take the other side of a comparison.
+  struct __sanitizer_cmp_trace_entry {
+    uint64_t pc;    // PC of the comparison.
+    uint64_t arg1;
+    uint64_t arg2;  // For a switch, the case value closest to arg1.
+    uint32_t size;  // Operand size in bits.
+    uint32_t type;  // Comparison predicate (llvm::CmpInst), 0 for a switch.
+  };
+  // Sets *entries to the comparison table of the current thread and returns
+  // the number of valid entries in it. Once the table is full the oldest
+  // entries are overwritten, so the entries are not in any particular order.
+  uintptr_t
+  __sanitizer_get_cmp_trace(const struct __sanitizer_cmp_trace_entry **entries);
+  // Clears the comparison table of the current thread.
+  void __sanitizer_reset_cmp_trace();
 #ifdef __cplusplus
 }  // extern "C"
 #endif
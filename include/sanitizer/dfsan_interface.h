@@ -77,6 +77,12 @@ int dfsan_has_label(dfsan_label label, dfsan_label elem);
 /// that label, else returns 0.
 dfsan_label dfsan_has_label_with_desc(dfsan_label label, const char *desc);
 
+/// Stores the base labels the given label is made of into labels, in
+/// increasing order, and returns their number.  At most n labels are stored.
+/// Takes time linear in the number of labels allocated, however deeply
+/// nested the unions are.
+size_t dfsan_get_base_labels(dfsan_label label, dfsan_label *labels, size_t n);
+
 /// Returns the number of labels allocated.
 size_t dfsan_get_label_count(void);
 
@@ -58,6 +58,9 @@ extern "C" {
   // terminate the process. It does not affect the behavior of
   // __lsan_do_leak_check() or the end-of-process leak check, and is not
   // affected by them.
+  // With LSAN_OPTIONS=use_fork_snapshot=1, the leak check runs in a forked
+  // copy-on-write snapshot of the process, which is only paused for the
+  // duration of fork().
   int __lsan_do_recoverable_leak_check();
 
   // The user may optionally provide this function to disallow leak checking
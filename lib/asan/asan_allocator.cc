@@ -859,6 +859,10 @@ void ForEachChunk(ForEachChunkCallback callback, void *arg) {
   __asan::get_allocator().ForEachChunk(callback, arg);
 }
 
+void ForEachUserRange(RangeIteratorCallback callback, void *arg) {
+  __asan::get_allocator().ForEachUserRange(callback, arg);
+}
+
 IgnoreObjectResult IgnoreObjectLocked(const void *p) {
   uptr addr = reinterpret_cast<uptr>(p);
   __asan::AsanChunk *m = __asan::instance.GetAsanChunkByAddr(addr);
@@ -544,6 +544,7 @@ static void AsanInitInternal() {
   if (common_flags()->detect_leaks && common_flags()->leak_check_at_exit) {
     Atexit(__lsan::DoLeakCheck);
   }
+  __lsan::MaybeStartPeriodicLeakCheckThread();
 #endif  // CAN_SANITIZE_LEAKS
 
 #if CAN_SANITIZE_UB
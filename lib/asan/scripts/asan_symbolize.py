@@ -24,6 +24,7 @@ binary_name_filter = None
 fix_filename_patterns = None
 logfile = sys.stdin
 allow_system_symbolizer = True
+build_id_dirs = []
 
 # FIXME: merge the code that calls fix_filename().
 def fix_filename(file_name):
@@ -37,6 +38,19 @@ def fix_filename(file_name):
 def sysroot_path_filter(binary_name):
   return sysroot_path + binary_name
 
+def find_binary_by_build_id(build_id):
+  # Separate debug files are usually stored as <dir>/.build-id/ab/cdef.debug
+  # for the build ID abcdef, e.g. under /usr/lib/debug.
+  for build_id_dir in build_id_dirs:
+    for path in [os.path.join(build_id_dir, '.build-id', build_id[:2],
+                              build_id[2:] + '.debug'),
+                 os.path.join(build_id_dir, build_id[:2],
+                              build_id[2:] + '.debug'),
+                 os.path.join(build_id_dir, build_id)]:
+      if os.path.exists(path):
+        return path
+  return None
+
 def guess_arch(addr):
   # Guess which arch we're running. 10 = len('0x') + 8 hex digits.
   if len(addr) > 10:
@@ -433,19 +447,25 @@ class SymbolizationLoop(object):
   def process_line_posix(self, line):
     self.current_line = line.rstrip()
     #0 0x7f6e35cf2e45  (/blah/foo.so+0x11fe45)
+    # or, with symbolize_offline=1,
+    #0 0x7f6e35cf2e45 (/blah/foo.so+0x11fe45) (BuildId: 0123abcd)
     stack_trace_line_format = (
-        '^( *#([0-9]+) *)(0x[0-9a-f]+) *\((.*)\+(0x[0-9a-f]+)\)')
+        '^( *#([0-9]+) *)(0x[0-9a-f]+) *\((.*)\+(0x[0-9a-f]+)\)'
+        '(?: *\(BuildId: ([0-9a-f]+)\))?')
     match = re.match(stack_trace_line_format, line)
     if not match:
       return [self.current_line]
     if DEBUG:
       print line
-    _, frameno_str, addr, binary, offset = match.groups()
+    _, frameno_str, addr, binary, offset, build_id = match.groups()
     if frameno_str == '0':
       # Assume that frame #0 is the first frame of new stack trace.
       self.frame_no = 0
     original_binary = binary
-    if self.binary_name_filter:
+    build_id_binary = build_id and find_binary_by_build_id(build_id)
+    if build_id_binary:
+      binary = build_id_binary
+    elif self.binary_name_filter:
       binary = self.binary_name_filter(binary)
     symbolized_line = self.symbolize_address(addr, binary, offset)
     if not symbolized_line:
@@ -472,6 +492,10 @@ if __name__ == '__main__':
   parser.add_argument('-l','--logfile', default=sys.stdin,
                       type=argparse.FileType('r'),
                       help='set log file name to parse, default is stdin')
+  parser.add_argument('-b', '--build-id-dir', action='append', default=[],
+                      help='look up binaries by the build IDs printed with '
+                           'symbolize_offline=1 in this directory (e.g. '
+                           '/usr/lib/debug), may be repeated')
   args = parser.parse_args()
   if args.path_to_cut:
     fix_filename_patterns = args.path_to_cut
@@ -482,6 +506,7 @@ if __name__ == '__main__':
     sysroot_path = args.s
   if args.c:
     binutils_prefix = args.c
+  build_id_dirs = args.build_id_dir
   if args.logfile:
     logfile = args.logfile
   else:
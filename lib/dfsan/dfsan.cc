@@ -27,6 +27,15 @@
 
 #include "dfsan/dfsan.h"
 
+#ifdef __SSE2__
+// <emmintrin.h> transitively includes <stdlib.h>,
+// and it's prohibited to include std headers into the runtime.
+// So we do this dirty trick.
+#define _MM_MALLOC_H_INCLUDED
+#define __MM_MALLOC_H
+#include <emmintrin.h>
+#endif
+
 using namespace __dfsan;
 
 typedef atomic_uint16_t atomic_dfsan_label;
@@ -37,6 +46,16 @@ static const uptr kNumLabels = 1 << (sizeof(dfsan_label) * 8);
 static atomic_dfsan_label __dfsan_last_label;
 static dfsan_label_info __dfsan_label_info[kNumLabels];
 
+// Each of the first kNumExactBaseLabels base labels has its own bit in the
+// base label bitsets, later base labels share the last bit.  The bitset of a
+// label is the union of the bits of the base labels it is made of.  It is
+// computed when the label is created and answers most dfsan_has_label queries
+// without walking the union DAG.
+static const uptr kNumExactBaseLabels = 63;
+static const u64 kSharedBaseLabelBit = 1ULL << kNumExactBaseLabels;
+static atomic_uint32_t __dfsan_num_base_labels;
+static u64 __dfsan_label_base_bits[kNumLabels];
+
 Flags __dfsan::flags_data;
 
 SANITIZER_INTERFACE_ATTRIBUTE THREADLOCAL dfsan_label __dfsan_retval_tls;
@@ -138,6 +157,65 @@ static void dfsan_check_label(dfsan_label label) {
   }
 }
 
+// Check whether l2 subsumes l1.  We don't need to check whether l1 subsumes l2
+// because we are guaranteed here that l1 < l2, and (at least in the cases we
+// are interested in) a label may only subsume labels created earlier (i.e.
+// with a lower numerical value).
+static bool dfsan_subsumes(dfsan_label l2, dfsan_label l1) {
+  return __dfsan_label_info[l2].l1 == l1 || __dfsan_label_info[l2].l2 == l1;
+}
+
+// Creates the union label of l1 and l2.
+static dfsan_label dfsan_create_union_label(dfsan_label l1, dfsan_label l2) {
+  dfsan_label label =
+    atomic_fetch_add(&__dfsan_last_label, 1, memory_order_relaxed) + 1;
+  dfsan_check_label(label);
+  __dfsan_label_info[label].l1 = l1;
+  __dfsan_label_info[label].l2 = l2;
+  __dfsan_label_base_bits[label] =
+      __dfsan_label_base_bits[l1] | __dfsan_label_base_bits[l2];
+  return label;
+}
+
+// The sparse union table (the default, sparse_union_table=1) only records the
+// unions that created a label, in an open addressing hash table.  Subsumption
+// is checked on every lookup instead of being recorded, so there are fewer
+// unions to record than labels and the table, twice that size, never fills
+// up.  An entry is the pair of labels in the upper 32 bits and the union label
+// in the lower 16 bits, and is read with a single atomic load.
+static const uptr kSparseUnionTableSizeLog = sizeof(dfsan_label) * 8 + 1;
+static const uptr kSparseUnionTableSize = 1ULL << kSparseUnionTableSizeLog;
+static atomic_uint64_t __dfsan_sparse_union_table[kSparseUnionTableSize];
+
+static dfsan_label dfsan_sparse_union(dfsan_label l1, dfsan_label l2) {
+  if (dfsan_subsumes(l2, l1))
+    return l2;
+
+  const u64 key = ((u64)l1 << 48) | ((u64)l2 << 32);
+  uptr i = ((key >> 32) * 0x9E3779B97F4A7C15ULL) >>
+           (64 - kSparseUnionTableSizeLog);
+  for (;; i = (i + 1) & (kSparseUnionTableSize - 1)) {
+    atomic_uint64_t *table_ent = &__dfsan_sparse_union_table[i];
+    u64 ent = atomic_load(table_ent, memory_order_acquire);
+    // Claim a free entry the same way the dense table does.
+    if (ent == 0 &&
+        atomic_compare_exchange_strong(table_ent, &ent,
+                                       key | kInitializingLabel,
+                                       memory_order_acquire)) {
+      dfsan_label label = dfsan_create_union_label(l1, l2);
+      atomic_store(table_ent, key | label, memory_order_release);
+      return label;
+    }
+    if ((ent & ~0xffffULL) != key)
+      continue;
+    while ((dfsan_label)ent == kInitializingLabel) {
+      internal_sched_yield();
+      ent = atomic_load(table_ent, memory_order_acquire);
+    }
+    return (dfsan_label)ent;
+  }
+}
+
 // Resolves the union of two unequal labels.  Nonequality is a precondition for
 // this function (the instrumentation pass inlines the equality test).
 extern "C" SANITIZER_INTERFACE_ATTRIBUTE
@@ -152,6 +230,9 @@ dfsan_label __dfsan_union(dfsan_label l1, dfsan_label l2) {
   if (l1 > l2)
     Swap(l1, l2);
 
+  if (flags().sparse_union_table)
+    return dfsan_sparse_union(l1, l2);
+
   atomic_dfsan_label *table_ent = union_table(l1, l2);
   // We need to deal with the case where two threads concurrently request
   // a union of the same pair of labels.  If the table entry is uninitialized,
@@ -160,20 +241,10 @@ dfsan_label __dfsan_union(dfsan_label l1, dfsan_label l2) {
   dfsan_label label = 0;
   if (atomic_compare_exchange_strong(table_ent, &label, kInitializingLabel,
                                      memory_order_acquire)) {
-    // Check whether l2 subsumes l1.  We don't need to check whether l1
-    // subsumes l2 because we are guaranteed here that l1 < l2, and (at least
-    // in the cases we are interested in) a label may only subsume labels
-    // created earlier (i.e. with a lower numerical value).
-    if (__dfsan_label_info[l2].l1 == l1 ||
-        __dfsan_label_info[l2].l2 == l1) {
+    if (dfsan_subsumes(l2, l1))
       label = l2;
-    } else {
-      label =
-        atomic_fetch_add(&__dfsan_last_label, 1, memory_order_relaxed) + 1;
-      dfsan_check_label(label);
-      __dfsan_label_info[label].l1 = l1;
-      __dfsan_label_info[label].l2 = l2;
-    }
+    else
+      label = dfsan_create_union_label(l1, l2);
     atomic_store(table_ent, label, memory_order_release);
   } else if (label == kInitializingLabel) {
     // Another thread is initializing the entry.  Wait until it is finished.
@@ -185,10 +256,53 @@ dfsan_label __dfsan_union(dfsan_label l1, dfsan_label l2) {
   return label;
 }
 
+#ifdef __SSE2__
+// The shadow of most buffers is a run of a single label, usually 0, so the
+// helpers below compare kLabelsPerVector labels at a time and only fall back
+// to looking at individual labels when a vector is not uniform.
+static const uptr kLabelsPerVector = sizeof(__m128i) / sizeof(dfsan_label);
+
+static ALWAYS_INLINE __m128i load_labels(const dfsan_label *ls) {
+  return _mm_loadu_si128(reinterpret_cast<const __m128i *>(ls));
+}
+
+static ALWAYS_INLINE void store_labels(dfsan_label *ls, __m128i v) {
+  _mm_storeu_si128(reinterpret_cast<__m128i *>(ls), v);
+}
+
+static ALWAYS_INLINE bool all_labels_equal(__m128i v1, __m128i v2) {
+  return _mm_movemask_epi8(_mm_cmpeq_epi16(v1, v2)) == 0xffff;
+}
+#endif
+
 extern "C" SANITIZER_INTERFACE_ATTRIBUTE
 dfsan_label __dfsan_union_load(const dfsan_label *ls, uptr n) {
   dfsan_label label = ls[0];
-  for (uptr i = 1; i != n; ++i) {
+  uptr i = 1;
+#ifdef __SSE2__
+  // Unioning |label| with 0, with itself or with the last label unioned into
+  // it gives |label| again, so a vector of labels which are all one of these
+  // can be skipped.  This gives the same label as the loop below, which
+  // unions the labels in order.
+  dfsan_label last_label = label;
+  for (; i + kLabelsPerVector <= n; i += kLabelsPerVector) {
+    __m128i v = load_labels(ls + i);
+    __m128i same = _mm_or_si128(
+        _mm_or_si128(_mm_cmpeq_epi16(v, _mm_setzero_si128()),
+                     _mm_cmpeq_epi16(v, _mm_set1_epi16(label))),
+        _mm_cmpeq_epi16(v, _mm_set1_epi16(last_label)));
+    if (_mm_movemask_epi8(same) == 0xffff)
+      continue;
+    for (uptr j = i; j != i + kLabelsPerVector; ++j) {
+      dfsan_label next_label = ls[j];
+      if (label != next_label && next_label != 0) {
+        label = __dfsan_union(label, next_label);
+        last_label = next_label;
+      }
+    }
+  }
+#endif
+  for (; i != n; ++i) {
     dfsan_label next_label = ls[i];
     if (label != next_label)
       label = __dfsan_union(label, next_label);
@@ -237,12 +351,25 @@ dfsan_label dfsan_create_label(const char *desc, void *userdata) {
   __dfsan_label_info[label].l1 = __dfsan_label_info[label].l2 = 0;
   __dfsan_label_info[label].desc = desc;
   __dfsan_label_info[label].userdata = userdata;
+  uptr base_index =
+      atomic_fetch_add(&__dfsan_num_base_labels, 1, memory_order_relaxed);
+  __dfsan_label_base_bits[label] = 1ULL << Min(base_index, kNumExactBaseLabels);
   return label;
 }
 
 extern "C" SANITIZER_INTERFACE_ATTRIBUTE
 void __dfsan_set_label(dfsan_label label, void *addr, uptr size) {
-  for (dfsan_label *labelp = shadow_for(addr); size != 0; --size, ++labelp) {
+  dfsan_label *labelp = shadow_for(addr);
+#ifdef __SSE2__
+  // Same as below, a vector at a time: only store the vectors which have a
+  // label other than |label|.
+  const __m128i splat = _mm_set1_epi16(label);
+  for (; size >= kLabelsPerVector;
+       size -= kLabelsPerVector, labelp += kLabelsPerVector)
+    if (!all_labels_equal(load_labels(labelp), splat))
+      store_labels(labelp, splat);
+#endif
+  for (; size != 0; --size, ++labelp) {
     // Don't write the label if it is already the value we need it to be.
     // In a program where most addresses are not labeled, it is common that
     // a page of shadow memory is entirely zeroed.  The Linux copy-on-write
@@ -265,11 +392,47 @@ void dfsan_set_label(dfsan_label label, void *addr, uptr size) {
 
 SANITIZER_INTERFACE_ATTRIBUTE
 void dfsan_add_label(dfsan_label label, void *addr, uptr size) {
-  for (dfsan_label *labelp = shadow_for(addr); size != 0; --size, ++labelp)
+  dfsan_label *labelp = shadow_for(addr);
+#ifdef __SSE2__
+  // A vector of identical labels gets the same union label throughout, so
+  // compute it once.
+  const __m128i splat = _mm_set1_epi16(label);
+  for (; size >= kLabelsPerVector;
+       size -= kLabelsPerVector, labelp += kLabelsPerVector) {
+    __m128i v = load_labels(labelp);
+    if (all_labels_equal(v, splat))
+      continue;
+    if (all_labels_equal(v, _mm_set1_epi16(labelp[0]))) {
+      store_labels(labelp, _mm_set1_epi16(__dfsan_union(labelp[0], label)));
+      continue;
+    }
+    for (uptr i = 0; i != kLabelsPerVector; ++i)
+      if (labelp[i] != label)
+        labelp[i] = __dfsan_union(labelp[i], label);
+  }
+#endif
+  for (; size != 0; --size, ++labelp)
     if (*labelp != label)
       *labelp = __dfsan_union(*labelp, label);
 }
 
+void __dfsan::copy_labels(dfsan_label *dst, const dfsan_label *src, uptr n) {
+  uptr i = 0;
+#ifdef __SSE2__
+  // Like __dfsan_set_label, leave the vectors which already hold the right
+  // labels alone, so that copying unlabeled data into unlabeled memory does
+  // not un-share zero pages of shadow memory.
+  for (; i + kLabelsPerVector <= n; i += kLabelsPerVector) {
+    __m128i v = load_labels(src + i);
+    if (!all_labels_equal(load_labels(dst + i), v))
+      store_labels(dst + i, v);
+  }
+#endif
+  for (; i != n; ++i)
+    if (dst[i] != src[i])
+      dst[i] = src[i];
+}
+
 // Unlike the other dfsan interface functions the behavior of this function
 // depends on the label of one of its arguments.  Hence it is implemented as a
 // custom function.
@@ -292,27 +455,154 @@ const struct dfsan_label_info *dfsan_get_label_info(dfsan_label label) {
   return &__dfsan_label_info[label];
 }
 
+namespace {
+
+// The bitmaps of the LabelSets too large to be kept in the object.  Freed
+// bitmaps are kept for reuse in a few slots shared by all threads, so that
+// exited threads leave nothing behind.  The slots are taken and refilled with
+// atomic exchanges, which is safe in a query from a signal handler as well.
+static const uptr kNumFreeLabelSetBitmaps = 16;
+static const uptr kLabelSetBitmapSize = kNumLabels / 64 * sizeof(u64);
+atomic_uintptr_t free_label_set_bitmaps[kNumFreeLabelSetBitmaps];
+
+u64 *AllocateLabelSetBitmap() {
+  for (uptr i = 0; i < kNumFreeLabelSetBitmaps; i++) {
+    if (!atomic_load(&free_label_set_bitmaps[i], memory_order_relaxed))
+      continue;
+    if (uptr bitmap = atomic_exchange(&free_label_set_bitmaps[i], 0,
+                                      memory_order_acquire))
+      return (u64 *)bitmap;
+  }
+  return (u64 *)MmapOrDie(kLabelSetBitmapSize, "LabelSet");
+}
+
+void FreeLabelSetBitmap(u64 *bitmap) {
+  for (uptr i = 0; i < kNumFreeLabelSetBitmaps; i++) {
+    uptr empty = 0;
+    if (atomic_compare_exchange_strong(&free_label_set_bitmaps[i], &empty,
+                                       (uptr)bitmap, memory_order_release))
+      return;
+  }
+  UnmapOrDie(bitmap, kLabelSetBitmapSize);
+}
+
+// A set of labels no greater than |highest|.  The bitmap of all the labels
+// would take 8KB, so only the first few hundred labels are kept in the object;
+// larger sets use a bitmap from the pool above.  Only the part of the bitmap
+// that can be used is cleared.
+class LabelSet {
+ public:
+  explicit LabelSet(dfsan_label highest) : num_words_(highest / 64 + 1) {
+    words_ = num_words_ <= kInlineWords ? inline_words_
+                                        : AllocateLabelSetBitmap();
+    internal_memset(words_, 0, num_words_ * sizeof(u64));
+  }
+
+  ~LabelSet() {
+    if (words_ != inline_words_)
+      FreeLabelSetBitmap(words_);
+  }
+
+  void Add(dfsan_label label) { words_[label / 64] |= 1ULL << (label % 64); }
+
+  bool Contains(dfsan_label label) const {
+    return words_[label / 64] & (1ULL << (label % 64));
+  }
+
+  // Adds |label| and the labels it is made of, down to |lowest|, in a single
+  // pass.
+  // A union label is always created after the labels it is the union of, so
+  // visiting the labels in decreasing order visits every label after all the
+  // labels containing it.  This is linear where walking the DAG recursively
+  // is exponential in the depth of shared unions.
+  void AddLabelsOf(dfsan_label label, dfsan_label lowest) {
+    Add(label);
+    for (uptr i = label / 64 + 1; i-- > lowest / 64;) {
+      u64 visited = 0;
+      while (u64 pending = words_[i] & ~visited) {
+        uptr bit = MostSignificantSetBitIndex(pending);
+        visited |= 1ULL << bit;
+        dfsan_label l = i * 64 + bit;
+        if (l < lowest)
+          return;
+        const dfsan_label_info &info = __dfsan_label_info[l];
+        if (info.l1 != 0) {
+          Add(info.l1);
+          Add(info.l2);
+        }
+      }
+    }
+  }
+
+  // Calls |callback| for the base labels in the set, in increasing order,
+  // until it returns true.  Returns the label it returned true for, or 0.
+  template <typename Callback>
+  dfsan_label FindBaseLabel(Callback callback) const {
+    for (uptr i = 0; i < num_words_; i++) {
+      for (u64 word = words_[i]; word; word &= word - 1) {
+        dfsan_label l = i * 64 + LeastSignificantSetBitIndex(word);
+        if (l != 0 && __dfsan_label_info[l].l1 == 0 && callback(l))
+          return l;
+      }
+    }
+    return 0;
+  }
+
+ private:
+  static const uptr kInlineWords = 8;
+
+  uptr num_words_;
+  u64 *words_;
+  u64 inline_words_[kInlineWords];
+
+  LabelSet(const LabelSet &);
+  void operator=(const LabelSet &);
+};
+
+}  // namespace
+
 extern "C" SANITIZER_INTERFACE_ATTRIBUTE int
 dfsan_has_label(dfsan_label label, dfsan_label elem) {
   if (label == elem)
     return true;
-  const dfsan_label_info *info = dfsan_get_label_info(label);
-  if (info->l1 != 0) {
-    return dfsan_has_label(info->l1, elem) || dfsan_has_label(info->l2, elem);
-  } else {
+  // A label is only made of labels created before it.
+  if (elem > label)
     return false;
-  }
+  u64 label_bits = __dfsan_label_base_bits[label];
+  u64 elem_bits = __dfsan_label_base_bits[elem];
+  if ((label_bits & elem_bits) != elem_bits)
+    return false;
+  // The bit of a base label other than the shared one is its alone.
+  if (__dfsan_label_info[elem].l1 == 0 && elem_bits != 0 &&
+      elem_bits != kSharedBaseLabelBit)
+    return true;
+  LabelSet labels(label);
+  labels.AddLabelsOf(label, elem);
+  return labels.Contains(elem);
 }
 
 extern "C" SANITIZER_INTERFACE_ATTRIBUTE dfsan_label
 dfsan_has_label_with_desc(dfsan_label label, const char *desc) {
-  const dfsan_label_info *info = dfsan_get_label_info(label);
-  if (info->l1 != 0) {
-    return dfsan_has_label_with_desc(info->l1, desc) ||
-           dfsan_has_label_with_desc(info->l2, desc);
-  } else {
-    return internal_strcmp(desc, info->desc) == 0;
-  }
+  LabelSet labels(label);
+  labels.AddLabelsOf(label, 1);
+  return labels.FindBaseLabel([=](dfsan_label l) {
+    return __dfsan_label_info[l].desc &&
+           internal_strcmp(desc, __dfsan_label_info[l].desc) == 0;
+  });
+}
+
+extern "C" SANITIZER_INTERFACE_ATTRIBUTE uptr
+dfsan_get_base_labels(dfsan_label label, dfsan_label *labels, uptr n) {
+  LabelSet set(label);
+  set.AddLabelsOf(label, 1);
+  uptr count = 0;
+  set.FindBaseLabel([&](dfsan_label l) {
+    if (count < n)
+      labels[count] = l;
+    count++;
+    return false;
+  });
+  return count;
 }
 
 extern "C" SANITIZER_INTERFACE_ATTRIBUTE uptr
@@ -52,6 +52,10 @@ inline const dfsan_label *shadow_for(const void *ptr) {
   return shadow_for(const_cast<void *>(ptr));
 }
 
+// Copies |n| labels from |src| to |dst|, skipping the stores of labels which
+// are already equal.  The ranges must not overlap.
+void copy_labels(dfsan_label *dst, const dfsan_label *src, uptr n);
+
 struct Flags {
 #define DFSAN_FLAG(Type, Name, DefaultValue, Description) Type Name;
 #include "dfsan_flags.inc"
@@ -246,7 +246,7 @@ __dfsw_strlen(const char *s, dfsan_label s_label, dfsan_label *ret_label) {
 static void *dfsan_memcpy(void *dest, const void *src, size_t n) {
   dfsan_label *sdest = shadow_for(dest);
   const dfsan_label *ssrc = shadow_for(src);
-  internal_memcpy((void *)sdest, (const void *)ssrc, n * sizeof(dfsan_label));
+  copy_labels(sdest, ssrc, n);
   return internal_memcpy(dest, src, n);
 }
 
@@ -508,8 +508,7 @@ char *__dfsw_strcpy(char *dest, const char *src, dfsan_label dst_label,
                     dfsan_label src_label, dfsan_label *ret_label) {
   char *ret = strcpy(dest, src);
   if (ret) {
-    internal_memcpy(shadow_for(dest), shadow_for(src),
-                    sizeof(dfsan_label) * (strlen(src) + 1));
+    copy_labels(shadow_for(dest), shadow_for(src), strlen(src) + 1);
   }
   *ret_label = dst_label;
   return ret;
@@ -1054,9 +1053,8 @@ static int format_buffer(char *str, size_t size, const char *fmt,
           char *arg = va_arg(ap, char *);
           retval = formatter.format(arg);
           va_labels++;
-          internal_memcpy(shadow_for(formatter.str_cur()), shadow_for(arg),
-                          sizeof(dfsan_label) *
-                              formatter.num_written_bytes(retval));
+          copy_labels(shadow_for(formatter.str_cur()), shadow_for(arg),
+                      formatter.num_written_bytes(retval));
           end_fmt = true;
           break;
         }
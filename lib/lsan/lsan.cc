@@ -85,6 +85,7 @@ extern "C" void __lsan_init() {
 
   if (common_flags()->detect_leaks && common_flags()->leak_check_at_exit)
     Atexit(DoLeakCheck);
+  MaybeStartPeriodicLeakCheckThread();
 
   InitializeCoverage(common_flags()->coverage, common_flags()->coverage_dir);
 
@@ -198,6 +198,10 @@ void ForEachChunk(ForEachChunkCallback callback, void *arg) {
   allocator.ForEachChunk(callback, arg);
 }
 
+void ForEachUserRange(RangeIteratorCallback callback, void *arg) {
+  allocator.ForEachUserRange(callback, arg);
+}
+
 IgnoreObjectResult IgnoreObjectLocked(const void *p) {
   void *chunk = allocator.GetBlockBegin(p);
   if (!chunk || p < chunk) return kIgnoreObjectInvalid;
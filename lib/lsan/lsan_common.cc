@@ -18,6 +18,7 @@
 #include "sanitizer_common/sanitizer_flags.h"
 #include "sanitizer_common/sanitizer_flag_parser.h"
 #include "sanitizer_common/sanitizer_placement_new.h"
+#include "sanitizer_common/sanitizer_posix.h"
 #include "sanitizer_common/sanitizer_procmaps.h"
 #include "sanitizer_common/sanitizer_stackdepot.h"
 #include "sanitizer_common/sanitizer_stacktrace.h"
@@ -137,6 +138,77 @@ static inline bool CanBeAHeapPointer(uptr p) {
 #endif
 }
 
+// A compact, conservative filter over the address ranges which may contain
+// allocator chunks, built before each leak check. The ranges are split into
+// granules (pages, or larger granules for big heaps, so that the bitmap stays
+// sparse) which are hashed into a fixed-size bitmap. A clear bit means that no
+// granule with this hash contains a chunk, so the word can be rejected without
+// consulting the allocator. A set bit is only a hint.
+class HeapPointerFilter {
+ public:
+  HeapPointerFilter()
+      : heap_begin_(~(uptr)0), heap_end_(0), heap_size_(0),
+        granularity_log_(0) {
+    bits_ = reinterpret_cast<u64 *>(
+        MmapOrDie(kNumBits / 8, "HeapPointerFilter"));
+    ForEachUserRange(AddRangeBoundsCb, this);
+    uptr granularity = GetPageSizeCached();
+    // Keep at most 1/8 of the bits set.
+    if (heap_size_ / granularity > kNumBits / 8)
+      granularity = RoundUpToPowerOfTwo(heap_size_ / (kNumBits / 8));
+    granularity_log_ = Log2(granularity);
+    ForEachUserRange(AddRangeCb, this);
+  }
+
+  ~HeapPointerFilter() {
+    UnmapOrDie(bits_, kNumBits / 8);
+  }
+
+  bool MayPointIntoHeap(uptr p) const {
+    if (p - heap_begin_ >= heap_end_ - heap_begin_)
+      return false;
+    uptr bit = Hash(p >> granularity_log_);
+    return (bits_[bit / 64] >> (bit % 64)) & 1;
+  }
+
+ private:
+  static const uptr kNumBitsLog = 18;
+  static const uptr kNumBits = 1ULL << kNumBitsLog;
+
+  static uptr Hash(uptr granule) {
+    return (granule ^ (granule >> kNumBitsLog)) & (kNumBits - 1);
+  }
+
+  static void AddRangeBoundsCb(uptr begin, uptr end, void *arg) {
+    HeapPointerFilter *filter = reinterpret_cast<HeapPointerFilter *>(arg);
+    filter->heap_begin_ = Min(filter->heap_begin_, begin);
+    filter->heap_end_ = Max(filter->heap_end_, end);
+    filter->heap_size_ += end - begin;
+  }
+
+  static void AddRangeCb(uptr begin, uptr end, void *arg) {
+    HeapPointerFilter *filter = reinterpret_cast<HeapPointerFilter *>(arg);
+    if (begin >= end) return;
+    uptr last = (end - 1) >> filter->granularity_log_;
+    for (uptr granule = begin >> filter->granularity_log_; granule <= last;
+         granule++) {
+      uptr bit = Hash(granule);
+      filter->bits_[bit / 64] |= 1ULL << (bit % 64);
+    }
+  }
+
+  u64 *bits_;
+  uptr heap_begin_, heap_end_, heap_size_;
+  uptr granularity_log_;
+
+  // Prohibit copy and assign.
+  HeapPointerFilter(const HeapPointerFilter&);
+  void operator=(const HeapPointerFilter&);
+};
+
+// Set for the duration of ClassifyAllChunks().
+static HeapPointerFilter *heap_pointer_filter;
+
 // Scans the memory range, looking for byte patterns that point into allocator
 // chunks. Marks those chunks with |tag| and adds them to |frontier|.
 // There are two usage modes for this function: finding reachable chunks
@@ -152,9 +224,12 @@ void ScanRangeForPointers(uptr begin, uptr end,
   uptr pp = begin;
   if (pp % alignment)
     pp = pp + alignment - pp % alignment;
+  const HeapPointerFilter *filter = heap_pointer_filter;
   for (; pp + sizeof(void *) <= end; pp += alignment) {  // NOLINT
     void *p = *reinterpret_cast<void **>(pp);
     if (!CanBeAHeapPointer(reinterpret_cast<uptr>(p))) continue;
+    if (filter && !filter->MayPointIntoHeap(reinterpret_cast<uptr>(p)))
+      continue;
     uptr chunk = PointsIntoChunk(p);
     if (!chunk) continue;
     // Pointers to self don't count. This matters when tag == kIndirectlyLeaked.
@@ -184,9 +259,12 @@ void ForEachExtraStackRangeCb(uptr begin, uptr end, void* arg) {
   ScanRangeForPointers(begin, end, frontier, "FAKE STACK", kReachable);
 }
 
-// Scans thread data (stacks and TLS) for heap pointers.
+// Scans thread data (stacks and TLS) for heap pointers. If
+// |registers_available| is false (e.g. when scanning a fork snapshot, where
+// the other threads keep running in the parent), registers are not scanned and
+// entire stacks are considered to be reachable.
 static void ProcessThreads(SuspendedThreadsList const &suspended_threads,
-                           Frontier *frontier) {
+                           Frontier *frontier, bool registers_available) {
   InternalScopedBuffer<uptr> registers(SuspendedThreadsList::RegisterCount());
   uptr registers_begin = reinterpret_cast<uptr>(registers.data());
   uptr registers_end = registers_begin + registers.size();
@@ -205,10 +283,14 @@ static void ProcessThreads(SuspendedThreadsList const &suspended_threads,
       continue;
     }
     uptr sp;
-    bool have_registers =
-        (suspended_threads.GetRegistersAndSP(i, registers.data(), &sp) == 0);
+    bool have_registers = false;
+    if (registers_available) {
+      have_registers = (suspended_threads.GetRegistersAndSP(
+                            i, registers.data(), &sp) == 0);
+      if (!have_registers)
+        Report("Unable to get registers from thread %d.\n");
+    }
     if (!have_registers) {
-      Report("Unable to get registers from thread %d.\n");
       // If unable to get SP, consider the entire stack to be reachable.
       sp = stack_begin;
     }
@@ -329,13 +411,16 @@ static void CollectIgnoredCb(uptr chunk, void *arg) {
 }
 
 // Sets the appropriate tag on each chunk.
-static void ClassifyAllChunks(SuspendedThreadsList const &suspended_threads) {
+static void ClassifyAllChunks(SuspendedThreadsList const &suspended_threads,
+                              bool registers_available) {
   // Holds the flood fill frontier.
   Frontier frontier(1);
+  HeapPointerFilter filter;
+  heap_pointer_filter = &filter;
 
   ForEachChunk(CollectIgnoredCb, &frontier);
   ProcessGlobalRegions(&frontier);
-  ProcessThreads(suspended_threads, &frontier);
+  ProcessThreads(suspended_threads, &frontier, registers_available);
   ProcessRootRegions(&frontier);
   FloodFillTag(&frontier, kReachable);
 
@@ -351,6 +436,7 @@ static void ClassifyAllChunks(SuspendedThreadsList const &suspended_threads) {
   // leaked chunks.
   LOG_POINTERS("Scanning leaked chunks.\n");
   ForEachChunk(MarkIndirectlyLeakedCb, nullptr);
+  heap_pointer_filter = nullptr;
 }
 
 // ForEachChunk callback. Resets the tags to pre-leak-check state.
@@ -367,6 +453,20 @@ static void PrintStackTraceById(u32 stack_trace_id) {
   StackDepotGet(stack_trace_id).Print();
 }
 
+// Adds a leaked chunk to the report, aggregating its stack trace according to
+// the resolution flag.
+static void AddLeakedChunkToReport(LeakReport *leak_report, uptr chunk,
+                                   u32 stack_trace_id, uptr leaked_size,
+                                   ChunkTag tag) {
+  u32 resolution = flags()->resolution;
+  if (resolution > 0) {
+    StackTrace stack = StackDepotGet(stack_trace_id);
+    stack.size = Min(stack.size, resolution);
+    stack_trace_id = StackDepotPut(stack);
+  }
+  leak_report->AddLeakedChunk(chunk, stack_trace_id, leaked_size, tag);
+}
+
 // ForEachChunk callback. Aggregates information about unreachable chunks into
 // a LeakReport.
 static void CollectLeaksCb(uptr chunk, void *arg) {
@@ -375,19 +475,9 @@ static void CollectLeaksCb(uptr chunk, void *arg) {
   chunk = GetUserBegin(chunk);
   LsanMetadata m(chunk);
   if (!m.allocated()) return;
-  if (m.tag() == kDirectlyLeaked || m.tag() == kIndirectlyLeaked) {
-    u32 resolution = flags()->resolution;
-    u32 stack_trace_id = 0;
-    if (resolution > 0) {
-      StackTrace stack = StackDepotGet(m.stack_trace_id());
-      stack.size = Min(stack.size, resolution);
-      stack_trace_id = StackDepotPut(stack);
-    } else {
-      stack_trace_id = m.stack_trace_id();
-    }
-    leak_report->AddLeakedChunk(chunk, stack_trace_id, m.requested_size(),
-                                m.tag());
-  }
+  if (m.tag() == kDirectlyLeaked || m.tag() == kIndirectlyLeaked)
+    AddLeakedChunkToReport(leak_report, chunk, m.stack_trace_id(),
+                           m.requested_size(), m.tag());
 }
 
 static void PrintMatchedSuppressions() {
@@ -415,7 +505,7 @@ static void CheckForLeaksCallback(const SuspendedThreadsList &suspended_threads,
   CheckForLeaksParam *param = reinterpret_cast<CheckForLeaksParam *>(arg);
   CHECK(param);
   CHECK(!param->success);
-  ClassifyAllChunks(suspended_threads);
+  ClassifyAllChunks(suspended_threads, /* registers_available */ true);
   ForEachChunk(CollectLeaksCb, &param->leak_report);
   // Clean up for subsequent leak checks. This assumes we did not overwrite any
   // kIgnored tags.
@@ -423,17 +513,144 @@ static void CheckForLeaksCallback(const SuspendedThreadsList &suspended_threads,
   param->success = true;
 }
 
-static bool CheckForLeaks() {
+///// Fork snapshot leak checking. /////
+
+// In fork snapshot mode the marking and classification run in a forked
+// copy-on-write child, which streams the leaked chunks back to the parent as a
+// sequence of these records. A record with chunk == 0 terminates the stream, so
+// the parent can tell a complete report from a child that died midway.
+struct LeakedChunkRecord {
+  uptr chunk;
+  uptr size;
+  u32 stack_trace_id;
+  u32 tag;
+};
+
+static const uptr kLeakedChunkRecordsPerIO = 256;
+
+class LeakedChunkWriter {
+ public:
+  explicit LeakedChunkWriter(fd_t fd) : fd_(fd), count_(0), failed_(false) {}
+  void Add(uptr chunk, uptr size, u32 stack_trace_id, ChunkTag tag) {
+    LeakedChunkRecord &record = records_[count_++];
+    record.chunk = chunk;
+    record.size = size;
+    record.stack_trace_id = stack_trace_id;
+    record.tag = tag;
+    if (count_ == kLeakedChunkRecordsPerIO)
+      Flush();
+  }
+  void Flush() {
+    if (!failed_ && count_)
+      failed_ =
+          !WriteToSnapshotPipe(fd_, records_, count_ * sizeof(records_[0]));
+    count_ = 0;
+  }
+
+ private:
+  fd_t fd_;
+  uptr count_;
+  bool failed_;
+  LeakedChunkRecord records_[kLeakedChunkRecordsPerIO];
+};
+
+// ForEachChunk callback. Streams unreachable chunks to the parent process.
+static void StreamLeaksCb(uptr chunk, void *arg) {
+  CHECK(arg);
+  LeakedChunkWriter *writer = reinterpret_cast<LeakedChunkWriter *>(arg);
+  chunk = GetUserBegin(chunk);
+  LsanMetadata m(chunk);
+  if (!m.allocated()) return;
+  if (m.tag() == kDirectlyLeaked || m.tag() == kIndirectlyLeaked)
+    writer->Add(chunk, m.requested_size(), m.stack_trace_id(), m.tag());
+}
+
+// Runs in the snapshot child. Tags are modified in the child's copy of the
+// heap only, so there is no need to reset them afterwards. Stack trace ids are
+// sent unaggregated, because new ids created by StackDepotPut() in the child
+// would be meaningless to the parent.
+static void CheckForLeaksInSnapshotCallback(
+    const SuspendedThreadsList &threads, fd_t fd, void *arg) {
+  ClassifyAllChunks(threads, /* registers_available */ false);
+  LeakedChunkWriter writer(fd);
+  ForEachChunk(StreamLeaksCb, &writer);
+  writer.Add(/* chunk */ 0, /* size */ 0, /* stack_trace_id */ 0,
+             kDirectlyLeaked);
+  writer.Flush();
+}
+
+// With the compact stack depot, StackDepotGet() may allocate memory, which
+// could deadlock if a suspended thread was in the middle of StackDepotPut().
+static void LockStackDepot() {
+  if (common_flags()->compact_stack_depot)
+    StackDepotLockAll();
+}
+
+static void UnlockStackDepot() {
+  if (common_flags()->compact_stack_depot)
+    StackDepotUnlockAll();
+}
+
+// Collects leaks from a fork snapshot of the process. The world is stopped
+// only for the duration of fork(); the caller then waits for the child on its
+// own while the other threads keep running.
+static void CheckForLeaksInSnapshot(CheckForLeaksParam *param) {
+  CHECK(!param->success);
+  fd_t fd;
+  int pid;
+  {
+    BlockingMutexLock l(&global_mutex);
+    LockThreadRegistry();
+    LockAllocator();
+    LockStackDepot();
+    pid = DoForkSnapshot(CheckForLeaksInSnapshotCallback, nullptr, &fd);
+    UnlockStackDepot();
+    UnlockAllocator();
+    UnlockThreadRegistry();
+  }
+  if (pid < 0)
+    return;
+  bool got_terminator = false;
+  LeakedChunkRecord records[kLeakedChunkRecordsPerIO];
+  for (;;) {
+    uptr bytes_read;
+    if (!ReadFromSnapshotPipe(fd, records, sizeof(records), &bytes_read) ||
+        bytes_read % sizeof(records[0]) != 0)
+      break;
+    uptr count = bytes_read / sizeof(records[0]);
+    for (uptr i = 0; i < count; i++) {
+      if (!records[i].chunk) {
+        got_terminator = true;
+        break;
+      }
+      AddLeakedChunkToReport(&param->leak_report, records[i].chunk,
+                             records[i].stack_trace_id, records[i].size,
+                             static_cast<ChunkTag>(records[i].tag));
+    }
+    if (got_terminator || count < kLeakedChunkRecordsPerIO)
+      break;
+  }
+  FinishForkSnapshot(pid, fd);
+  param->success = got_terminator;
+}
+
+static bool CheckForLeaks(bool use_fork_snapshot) {
   if (&__lsan_is_turned_off && __lsan_is_turned_off())
       return false;
   EnsureMainThreadIDIsCorrect();
   CheckForLeaksParam param;
   param.success = false;
-  LockThreadRegistry();
-  LockAllocator();
-  DoStopTheWorld(CheckForLeaksCallback, &param);
-  UnlockAllocator();
-  UnlockThreadRegistry();
+  if (use_fork_snapshot) {
+    CheckForLeaksInSnapshot(&param);
+  } else {
+    LockThreadRegistry();
+    LockAllocator();
+    LockStackDepot();
+    DoStopTheWorld(CheckForLeaksCallback, &param);
+    UnlockStackDepot();
+    UnlockAllocator();
+    UnlockThreadRegistry();
+  }
 
   if (!param.success) {
     Report("LeakSanitizer has encountered a fatal error.\n");
@@ -465,7 +682,7 @@ void DoLeakCheck() {
   static bool already_done;
   if (already_done) return;
   already_done = true;
-  bool have_leaks = CheckForLeaks();
+  bool have_leaks = CheckForLeaks(/* use_fork_snapshot */ false);
   if (!have_leaks) {
     return;
   }
@@ -474,13 +691,44 @@ void DoLeakCheck() {
   }
 }
 
+// Serializes recoverable leak checks that run in a fork snapshot. Those only
+// take global_mutex around the fork itself.
+static BlockingMutex snapshot_mutex(LINKER_INITIALIZED);
+
 static int DoRecoverableLeakCheck() {
-  BlockingMutexLock l(&global_mutex);
-  bool have_leaks = CheckForLeaks();
+  bool have_leaks;
+  if (flags()->use_fork_snapshot) {
+    BlockingMutexLock l(&snapshot_mutex);
+    have_leaks = CheckForLeaks(/* use_fork_snapshot */ true);
+  } else {
+    BlockingMutexLock l(&global_mutex);
+    have_leaks = CheckForLeaks(/* use_fork_snapshot */ false);
+  }
   return have_leaks ? 1 : 0;
 }
 
-static Suppression *GetSuppressionForAddr(uptr addr) {
+static void PeriodicLeakCheckThread(void *arg) {
+  (void)arg;
+  int interval_ms = flags()->recoverable_leak_check_interval_ms;
+  for (;;) {
+    SleepForMillis(interval_ms);
+    DoRecoverableLeakCheck();
+  }
+}
+
+void MaybeStartPeriodicLeakCheckThread() {
+  if (!common_flags()->detect_leaks ||
+      flags()->recoverable_leak_check_interval_ms <= 0)
+    return;
+  if (!&real_pthread_create) {
+    VReport(1, "LeakSanitizer: periodic leak checking is not supported.\n");
+    return;
+  }
+  internal_start_thread(PeriodicLeakCheckThread, nullptr);
+}
+
+static Suppression *GetSuppressionForAddr(uptr addr,
+                                          SymbolizedStack *frames) {
   Suppression *s = nullptr;
 
   // Suppress by module name.
@@ -491,22 +739,32 @@ static Suppression *GetSuppressionForAddr(uptr addr) {
       return s;
 
   // Suppress by file or function name.
-  SymbolizedStack *frames = Symbolizer::GetOrInit()->SymbolizePC(addr);
   for (SymbolizedStack *cur = frames; cur; cur = cur->next) {
     if (suppressions->Match(cur->info.function, kSuppressionLeak, &s) ||
         suppressions->Match(cur->info.file, kSuppressionLeak, &s)) {
       break;
     }
   }
-  frames->ClearAll();
   return s;
 }
 
 static Suppression *GetSuppressionForStack(u32 stack_trace_id) {
   StackTrace stack = StackDepotGet(stack_trace_id);
-  for (uptr i = 0; i < stack.size; i++) {
-    Suppression *s = GetSuppressionForAddr(
-        StackTrace::GetPreviousInstructionPc(stack.trace[i]));
+  // Symbolize the stack in batches, kept off the stack.
+  const uptr kBatchSize = 64;
+  InternalScopedBuffer<uptr> pcs(kBatchSize);
+  InternalScopedBuffer<SymbolizedStack *> frames(kBatchSize);
+  for (uptr first = 0; first < stack.size; first += kBatchSize) {
+    uptr n = Min(stack.size - first, kBatchSize);
+    for (uptr i = 0; i < n; i++)
+      pcs[i] = StackTrace::GetPreviousInstructionPc(stack.trace[first + i]);
+    Symbolizer::GetOrInit()->SymbolizePCs(pcs.data(), n, frames.data());
+    Suppression *s = nullptr;
+    for (uptr i = 0; i < n; i++) {
+      if (!s)
+        s = GetSuppressionForAddr(pcs[i], frames[i]);
+      frames[i]->ClearAll();
+    }
     if (s) return s;
   }
   return nullptr;
@@ -103,6 +103,21 @@ void ProcessGlobalRegions(Frontier *frontier);
 void ProcessPlatformSpecificAllocations(Frontier *frontier);
 // Run stoptheworld while holding any platform-specific locks.
 void DoStopTheWorld(StopTheWorldCallback callback, void* argument);
+// Fork a copy-on-write snapshot of the process while holding any
+// platform-specific locks, and run the callback in the child. The callback gets
+// the threads that were running at the time of fork (their registers are not
+// available) and the write end of a pipe to the parent. The child exits when
+// the callback returns. Returns the child's pid and the read end of the pipe in
+// |fd|, or -1 on failure.
+typedef void (*ForkSnapshotCallback)(const SuspendedThreadsList &threads,
+                                     fd_t fd, void *argument);
+int DoForkSnapshot(ForkSnapshotCallback callback, void *argument, fd_t *fd);
+// Close the pipe and reap the snapshot process.
+void FinishForkSnapshot(int pid, fd_t fd);
+// Transfer the whole buffer over the snapshot pipe, retrying on EINTR and short
+// transfers. Reading stops early at end of file.
+bool WriteToSnapshotPipe(fd_t fd, const void *buf, uptr size);
+bool ReadFromSnapshotPipe(fd_t fd, void *buf, uptr size, uptr *bytes_read);
 
 void ScanRangeForPointers(uptr begin, uptr end,
                           Frontier *frontier,
@@ -116,6 +131,8 @@ enum IgnoreObjectResult {
 
 // Functions called from the parent tool.
 void InitCommonLsan();
+// Must be called after interceptors are initialized.
+void MaybeStartPeriodicLeakCheckThread();
 void DoLeakCheck();
 bool DisabledInThisThread();
 
@@ -141,6 +158,8 @@ inline bool IsSpecialCaseOfOperatorNew0(uptr chunk_beg, uptr chunk_size,
 // The following must be implemented in the parent tool.
 
 void ForEachChunk(ForEachChunkCallback callback, void *arg);
+// Iterates over the address ranges which may contain allocator chunks.
+void ForEachUserRange(RangeIteratorCallback callback, void *arg);
 // Returns the address range occupied by the global allocator object.
 void GetAllocatorGlobalRange(uptr *begin, uptr *end);
 // Wrappers for allocator's ForceLock()/ForceUnlock().
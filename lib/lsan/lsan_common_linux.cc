@@ -16,11 +16,13 @@
 #include "lsan_common.h"
 
 #if CAN_SANITIZE_LEAKS && SANITIZER_LINUX
+#include <errno.h>
 #include <link.h>
 
 #include "sanitizer_common/sanitizer_common.h"
 #include "sanitizer_common/sanitizer_flags.h"
 #include "sanitizer_common/sanitizer_linux.h"
+#include "sanitizer_common/sanitizer_posix.h"
 #include "sanitizer_common/sanitizer_stackdepot.h"
 
 namespace __lsan {
@@ -88,9 +90,9 @@ void ProcessGlobalRegions(Frontier *frontier) {
   dl_iterate_phdr(ProcessGlobalRegionsCallback, frontier);
 }
 
-static uptr GetCallerPC(u32 stack_id, StackDepotReverseMap *map) {
+static uptr GetCallerPC(u32 stack_id) {
   CHECK(stack_id);
-  StackTrace stack = map->Get(stack_id);
+  StackTrace stack = StackDepotGet(stack_id);
   // The top frame is our malloc/calloc/etc. The next frame is the caller.
   if (stack.size >= 2)
     return stack.trace[1];
@@ -99,7 +101,6 @@ static uptr GetCallerPC(u32 stack_id, StackDepotReverseMap *map) {
 
 struct ProcessPlatformAllocParam {
   Frontier *frontier;
-  StackDepotReverseMap *stack_depot_reverse_map;
   bool skip_linker_allocations;
 };
 
@@ -115,7 +116,7 @@ static void ProcessPlatformSpecificAllocationsCb(uptr chunk, void *arg) {
     u32 stack_id = m.stack_trace_id();
     uptr caller_pc = 0;
     if (stack_id > 0)
-      caller_pc = GetCallerPC(stack_id, param->stack_depot_reverse_map);
+      caller_pc = GetCallerPC(stack_id);
     // If caller_pc is unknown, this chunk may be allocated in a coroutine. Mark
     // it as reachable, as we can't properly report its allocation stack anyway.
     if (caller_pc == 0 || (param->skip_linker_allocations &&
@@ -144,10 +145,8 @@ static void ProcessPlatformSpecificAllocationsCb(uptr chunk, void *arg) {
 // guaranteed to include all dynamic TLS blocks (and possibly other allocations
 // which we don't care about).
 void ProcessPlatformSpecificAllocations(Frontier *frontier) {
-  StackDepotReverseMap stack_depot_reverse_map;
   ProcessPlatformAllocParam arg;
   arg.frontier = frontier;
-  arg.stack_depot_reverse_map = &stack_depot_reverse_map;
   arg.skip_linker_allocations =
       flags()->use_tls && flags()->use_ld_allocations && linker != nullptr;
   ForEachChunk(ProcessPlatformSpecificAllocationsCb, &arg);
@@ -178,6 +177,118 @@ void DoStopTheWorld(StopTheWorldCallback callback, void *argument) {
   dl_iterate_phdr(DoStopTheWorldCallback, &param);
 }
 
+struct DoForkSnapshotParam {
+  ForkSnapshotCallback callback;
+  void *argument;
+  fd_t read_fd;
+  int pid;
+};
+
+static int DoForkSnapshotCallback(struct dl_phdr_info *info, size_t size,
+                                  void *data) {
+  DoForkSnapshotParam *param = reinterpret_cast<DoForkSnapshotParam *>(data);
+  int fds[2];
+  int local_errno;
+  if (internal_iserror(internal_pipe(fds), &local_errno)) {
+    VReport(1, "LeakSanitizer: failed to create a pipe (errno %d).\n",
+            local_errno);
+    return 1;
+  }
+  // The child has only one thread, so the thread list must be taken before
+  // forking. The caller holds the thread registry lock, so no new threads can
+  // be registered until the fork is done.
+  SuspendedThreadsList threads;
+  ThreadLister thread_lister(internal_getpid());
+  for (pid_t tid = thread_lister.GetNextTID(); tid >= 0;
+       tid = thread_lister.GetNextTID())
+    threads.Append(tid);
+  if (thread_lister.error()) {
+    VReport(1, "LeakSanitizer: failed to list threads.\n");
+    internal_close(fds[0]);
+    internal_close(fds[1]);
+    return 1;
+  }
+  int pid = internal_fork();
+  if (internal_iserror(pid, &local_errno)) {
+    VReport(1, "LeakSanitizer: failed to fork a snapshot (errno %d).\n",
+            local_errno);
+    internal_close(fds[0]);
+    internal_close(fds[1]);
+    return 1;
+  }
+  if (pid == 0) {
+    // Child. It still runs inside dl_iterate_phdr() in the thread that forked
+    // it, which owns the (reentrant) libdl lock, so the callback may use
+    // dl_iterate_phdr() itself. internal_fork() does not run pthread_atfork()
+    // handlers, so the callback should not call any libc functions.
+    internal_close(fds[0]);
+    param->callback(threads, fds[1], param->argument);
+    internal__exit(0);
+  }
+  internal_close(fds[1]);
+  param->read_fd = fds[0];
+  param->pid = pid;
+  return 1;
+}
+
+// As in DoStopTheWorld(), the fork happens inside a dl_iterate_phdr() callback,
+// so the libdl lock cannot be held by some other thread at the time of fork.
+int DoForkSnapshot(ForkSnapshotCallback callback, void *argument, fd_t *fd) {
+  DoForkSnapshotParam param = {callback, argument, kInvalidFd, -1};
+  dl_iterate_phdr(DoForkSnapshotCallback, &param);
+  *fd = param.read_fd;
+  return param.pid;
+}
+
+void FinishForkSnapshot(int pid, fd_t fd) {
+  internal_close(fd);
+  for (;;) {
+    int local_errno;
+    uptr waitpid_status = internal_waitpid(pid, nullptr, 0);
+    if (!internal_iserror(waitpid_status, &local_errno))
+      break;
+    if (local_errno == EINTR)
+      continue;
+    VReport(1, "Waiting on the snapshot process failed (errno %d).\n",
+            local_errno);
+    break;
+  }
+}
+
+bool WriteToSnapshotPipe(fd_t fd, const void *buf, uptr size) {
+  const char *p = reinterpret_cast<const char *>(buf);
+  while (size > 0) {
+    uptr bytes_written;
+    error_t err;
+    if (!WriteToFile(fd, p, size, &bytes_written, &err)) {
+      if (err == EINTR)
+        continue;
+      return false;
+    }
+    p += bytes_written;
+    size -= bytes_written;
+  }
+  return true;
+}
+
+bool ReadFromSnapshotPipe(fd_t fd, void *buf, uptr size, uptr *bytes_read) {
+  char *p = reinterpret_cast<char *>(buf);
+  *bytes_read = 0;
+  while (*bytes_read < size) {
+    uptr n;
+    error_t err;
+    if (!ReadFromFile(fd, p + *bytes_read, size - *bytes_read, &n, &err)) {
+      if (err == EINTR)
+        continue;
+      return false;
+    }
+    if (n == 0)
+      break;
+    *bytes_read += n;
+  }
+  return true;
+}
+
 } // namespace __lsan
 
 #endif // CAN_SANITIZE_LEAKS && SANITIZER_LINUX
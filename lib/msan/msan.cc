@@ -195,6 +195,14 @@ static void InitializeFlags() {
     OverrideCommonFlags(cf);
   }
 
+  // MSan needs stack depot use counts, which the compact depot doesn't keep.
+  if (common_flags()->compact_stack_depot) {
+    CommonFlags cf;
+    cf.CopyFrom(*common_flags());
+    cf.compact_stack_depot = false;
+    OverrideCommonFlags(cf);
+  }
+
   // Check flag values:
   if (f->origin_history_size < 0 ||
       f->origin_history_size > Origin::kMaxDepth) {
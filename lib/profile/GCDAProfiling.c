@@ -157,17 +157,6 @@ static uint32_t read_32bit_value() {
   return val;
 }
 
-static uint64_t read_64bit_value() {
-  uint64_t val;
-
-  if (new_file)
-    return (uint64_t)-1;
-
-  val = *(uint64_t*)&write_buffer[cur_pos];
-  cur_pos += 8;
-  return val;
-}
-
 static char *mangle_filename(const char *orig_filename) {
   char *new_filename;
   size_t filename_len, prefix_len;
@@ -233,13 +222,10 @@ static int map_file() {
 }
 
 static void unmap_file() {
-  if (msync(write_buffer, file_size, MS_SYNC) == -1) {
-    int errnum = errno;
-    fprintf(stderr, "profiling: %s: cannot msync: %s\n", filename,
-            strerror(errnum));
-  }
-
-  /* We explicitly ignore errors from unmapping because at this point the data
+  /* The merged counters are in the page cache already, where other processes
+   * see them. Writing them back is left to the kernel rather than waited for.
+   *
+   * We explicitly ignore errors from unmapping because at this point the data
    * is written and we don't care.
    */
   (void)munmap(write_buffer, file_size);
@@ -257,56 +243,45 @@ static void unmap_file() {
  */
 void llvm_gcda_start_file(const char *orig_filename, const char version[4],
                           uint32_t checksum) {
-  const char *mode = "r+b";
   filename = mangle_filename(orig_filename);
 
-  /* Try just opening the file. */
-  new_file = 0;
-  fd = open(filename, O_RDWR);
-
+  /* Try opening the file, creating it if necessary. */
+  fd = open(filename, O_RDWR | O_CREAT, 0644);
   if (fd == -1) {
-    /* Try opening the file, creating it if necessary. */
-    new_file = 1;
-    mode = "w+b";
+    /* Try creating the directories first then opening the file. */
+    __llvm_profile_recursive_mkdir(filename);
     fd = open(filename, O_RDWR | O_CREAT, 0644);
     if (fd == -1) {
-      /* Try creating the directories first then opening the file. */
-      __llvm_profile_recursive_mkdir(filename);
-      fd = open(filename, O_RDWR | O_CREAT, 0644);
-      if (fd == -1) {
-        /* Bah! It's hopeless. */
-        int errnum = errno;
-        fprintf(stderr, "profiling: %s: cannot open: %s\n", filename,
-                strerror(errnum));
-        return;
-      }
+      /* Bah! It's hopeless. */
+      int errnum = errno;
+      fprintf(stderr, "profiling: %s: cannot open: %s\n", filename,
+              strerror(errnum));
+      return;
     }
   }
 
   /* Try to flock the file to serialize concurrent processes writing out to the
    * same GCDA. This can fail if the filesystem doesn't support it, but in that
    * case we'll just carry on with the old racy behaviour and hope for the best.
+   * Whether there is something to merge is only decided under the lock: a
+   * process that created the file may still be writing it.
    */
   flock(fd, LOCK_EX);
-  output_file = fdopen(fd, mode);
+  output_file = fdopen(fd, "r+b");
 
   /* Initialize the write buffer. */
+  new_file = 0;
   write_buffer = NULL;
   cur_buffer_size = 0;
   cur_pos = 0;
 
-  if (new_file) {
+  if (map_file() == -1) {
+    /* The file is empty or mmap failed, write it from scratch. */
+    new_file = 1;
+    write_buffer = NULL;
+    cur_buffer_size = 0;
     resize_write_buffer(WRITE_BUFFER_SIZE);
     memset(write_buffer, 0, WRITE_BUFFER_SIZE);
-  } else {
-    if (map_file() == -1) {
-      /* mmap failed, try to recover by clobbering */
-      new_file = 1;
-      write_buffer = NULL;
-      cur_buffer_size = 0;
-      resize_write_buffer(WRITE_BUFFER_SIZE);
-      memset(write_buffer, 0, WRITE_BUFFER_SIZE);
-    }
   }
 
   /* gcda file, version, stamp checksum. */
@@ -370,9 +345,23 @@ void llvm_gcda_emit_function(uint32_t ident, const char *function_name,
     write_string(function_name);
 }
 
+/* Add the counters to the ones at the current position of the mapped file, in
+ * place. The file only guarantees 4-byte alignment.
+ */
+static void merge_64bit_values(uint64_t *counters, uint32_t num_counters) {
+  char *file_counters = &write_buffer[cur_pos];
+  uint32_t i;
+  for (i = 0; i < num_counters; ++i) {
+    uint64_t old_counter;
+    memcpy(&old_counter, file_counters + i * 8, 8);
+    counters[i] += old_counter;
+    memcpy(file_counters + i * 8, &counters[i], 8);
+  }
+  cur_pos += num_counters * 8;
+}
+
 void llvm_gcda_emit_arcs(uint32_t num_counters, uint64_t *counters) {
   uint32_t i;
-  uint64_t *old_ctrs = NULL;
   uint32_t val = 0;
   uint64_t save_cur_pos = cur_pos;
 
@@ -397,23 +386,18 @@ void llvm_gcda_emit_arcs(uint32_t num_counters, uint64_t *counters) {
       return;
     }
 
-    old_ctrs = malloc(sizeof(uint64_t) * num_counters);
-    for (i = 0; i < num_counters; ++i)
-      old_ctrs[i] = read_64bit_value();
-  }
-
-  cur_pos = save_cur_pos;
+    /* The tag and the number of counters stay the same. */
+    merge_64bit_values(counters, num_counters);
+  } else {
+    cur_pos = save_cur_pos;
 
-  /* Counter #1 (arcs) tag */
-  write_bytes("\0\0\xa1\1", 4);
-  write_32bit_value(num_counters * 2);
-  for (i = 0; i < num_counters; ++i) {
-    counters[i] += (old_ctrs ? old_ctrs[i] : 0);
-    write_64bit_value(counters[i]);
+    /* Counter #1 (arcs) tag */
+    write_bytes("\0\0\xa1\1", 4);
+    write_32bit_value(num_counters * 2);
+    for (i = 0; i < num_counters; ++i)
+      write_64bit_value(counters[i]);
   }
 
-  free(old_ctrs);
-
 #ifdef DEBUG_GCDAPROFILING
   fprintf(stderr, "llvmgcda:   %u arcs\n", num_counters);
   for (i = 0; i < num_counters; ++i)
@@ -481,13 +465,16 @@ void llvm_gcda_end_file() {
 
     if (new_file) {
       fwrite(write_buffer, cur_pos, 1, output_file);
+      fflush(output_file);
+      flock(fd, LOCK_UN);
       free(write_buffer);
     } else {
+      /* Let the next process in before tearing the mapping down. */
+      flock(fd, LOCK_UN);
       unmap_file();
     }
 
     fclose(output_file);
-    flock(fd, LOCK_UN);
     output_file = NULL;
     write_buffer = NULL;
   }
@@ -62,6 +62,25 @@ uint64_t *__llvm_profile_end_counters(void);
  */
 void __llvm_profile_reset_counters(void);
 
+/*!
+ * \brief Get the calling thread's copy of the counters.
+ *
+ * Experimental and unsupported: no compiler emits calls to it, so the
+ * counters of instrumented code never go through a shard. Only code calling
+ * it directly uses the shards.
+ *
+ * The returned shard has the layout of the counters section. Incrementing
+ * the counters through it doesn't bounce the cache lines of hot counters
+ * between threads. Shards are allocated on first use, handed out to threads
+ * round-robin (LLVM_PROFILE_COUNTER_SHARDS of them, 64 by default), and what
+ * was counted in them since the previous write is added to the counters
+ * section whenever the profile is written. Threads beyond the number of
+ * shards share one, and plain increments from them race like they do on the
+ * counters section. Returns the counters section itself if sharding is off or
+ * a shard can't be allocated.
+ */
+uint64_t *__llvm_profile_get_counters_shard(void);
+
 /*!
  * \brief Counts the number of times a target value is seen.
  *
@@ -11,14 +11,26 @@
 #include "InstrProfilingInternal.h"
 #include "InstrProfilingUtil.h"
 #include <errno.h>
+#include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#if defined(_WIN32)
+#include "WindowsMMap.h"
+#else
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
 #ifdef COMPILER_RT_HAS_UNAME
 #include <sys/utsname.h>
 #endif
 
 #define UNCONST(ptr) ((void *)(uintptr_t)(ptr))
+#define MAX_PID_SIZE 16
+
+int getpid(void);
 
 #ifdef COMPILER_RT_HAS_UNAME
 int GetHostName(char *Name, int Len) {
@@ -30,6 +42,7 @@ int GetHostName(char *Name, int Len) {
 }
 #endif
 
+#if defined(_WIN32)
 /* Return 1 if there is an error, otherwise return  0.  */
 static uint32_t fileWriter(ProfDataIOVec *IOVecs, uint32_t NumIOVecs,
                            void **WriterCtx) {
@@ -42,6 +55,57 @@ static uint32_t fileWriter(ProfDataIOVec *IOVecs, uint32_t NumIOVecs,
   }
   return 0;
 }
+#else
+#define WRITEV_BATCH_SIZE 256
+
+/* Write all of \c IOV, resuming after partial writes. */
+static int writevAll(int Fd, struct iovec *IOV, int NumIOV) {
+  while (NumIOV > 0) {
+    ssize_t Written = writev(Fd, IOV, NumIOV);
+    if (Written < 0) {
+      if (errno == EINTR)
+        continue;
+      return -1;
+    }
+    while (NumIOV > 0 && (size_t)Written >= IOV->iov_len) {
+      Written -= IOV->iov_len;
+      IOV++;
+      NumIOV--;
+    }
+    if (NumIOV > 0) {
+      IOV->iov_base = (char *)IOV->iov_base + Written;
+      IOV->iov_len -= Written;
+    }
+  }
+  return 0;
+}
+
+/* Write the data straight from memory with as few writev calls as possible,
+ * bypassing the stdio buffer (which is flushed first to keep the order).
+ * Return 1 if there is an error, otherwise return  0.  */
+static uint32_t fileWriter(ProfDataIOVec *IOVecs, uint32_t NumIOVecs,
+                           void **WriterCtx) {
+  struct iovec IOV[WRITEV_BATCH_SIZE];
+  FILE *File = (FILE *)*WriterCtx;
+  uint32_t I = 0;
+  if (fflush(File))
+    return 1;
+  while (I < NumIOVecs) {
+    int NumIOV = 0;
+    for (; I < NumIOVecs && NumIOV < WRITEV_BATCH_SIZE; I++) {
+      size_t Length = IOVecs[I].ElmSize * IOVecs[I].NumElm;
+      if (!Length)
+        continue;
+      IOV[NumIOV].iov_base = (void *)(uintptr_t)IOVecs[I].Data;
+      IOV[NumIOV].iov_len = Length;
+      NumIOV++;
+    }
+    if (writevAll(fileno(File), IOV, NumIOV))
+      return 1;
+  }
+  return 0;
+}
+#endif
 
 COMPILER_RT_VISIBILITY ProfBufferIO *
 llvmCreateBufferIOInternal(void *File, uint32_t BufferSz) {
@@ -50,31 +114,504 @@ llvmCreateBufferIOInternal(void *File, uint32_t BufferSz) {
   return llvmCreateBufferIO(fileWriter, File, BufferSz);
 }
 
-static int writeFile(FILE *File) {
-  const char *BufferSzStr = 0;
-  uint64_t ValueDataSize = 0;
-  struct ValueProfData **ValueDataArray =
-      __llvm_profile_gather_value_data(&ValueDataSize);
+static int writeFile(FILE *File, struct ValueProfData **ValueDataArray,
+                     uint64_t ValueDataSize) {
   FreeHook = &free;
   CallocHook = &calloc;
-  BufferSzStr = getenv("LLVM_VP_BUFFER_SIZE");
-  if (BufferSzStr && BufferSzStr[0])
-    VPBufferSize = atoi(BufferSzStr);
   return llvmWriteProfData(fileWriter, File, ValueDataArray, ValueDataSize);
 }
 
+/* Returns a signature of the profile data layout of this module: processes
+ * running the same binary get the same signature, a rebuilt binary most likely
+ * gets a different one. */
+static uint64_t getModuleSignature(void) {
+  const __llvm_profile_data *DataBegin = __llvm_profile_begin_data();
+  const __llvm_profile_data *DataEnd = __llvm_profile_end_data();
+  const char *NamesBegin = __llvm_profile_begin_names();
+  const char *NamesEnd = __llvm_profile_end_names();
+  const __llvm_profile_data *Data;
+  const char *Name;
+  /* FNV-1a */
+  uint64_t Signature = 0xcbf29ce484222325ULL;
+#define HASH_VALUE(Value)                                                      \
+  Signature = (Signature ^ (uint64_t)(Value)) * 0x100000001b3ULL
+  HASH_VALUE(__llvm_profile_end_counters() - __llvm_profile_begin_counters());
+  for (Data = DataBegin; Data != DataEnd; ++Data) {
+    HASH_VALUE(Data->FuncHash);
+    HASH_VALUE(Data->NumCounters);
+  }
+  for (Name = NamesBegin; Name != NamesEnd; ++Name)
+    HASH_VALUE((unsigned char)*Name);
+#undef HASH_VALUE
+  return Signature;
+}
+
+/* Returns 1 if the profile with the header \c Header was written by this
+ * module, i.e. it has the same functions with the same counters. */
+static int isProfileOfThisModule(const __llvm_profile_header *Header) {
+  const __llvm_profile_data *DataBegin = __llvm_profile_begin_data();
+  const __llvm_profile_data *DataEnd = __llvm_profile_end_data();
+  const uint64_t *CountersBegin = __llvm_profile_begin_counters();
+  const char *NamesBegin = __llvm_profile_begin_names();
+  const char *NamesEnd = __llvm_profile_end_names();
+  const __llvm_profile_data *SrcData =
+      (const __llvm_profile_data *)(Header + 1);
+  const char *SrcNames;
+  uint64_t I;
+
+  if (Header->DataSize != (uint64_t)(DataEnd - DataBegin) ||
+      Header->CountersSize !=
+          (uint64_t)(__llvm_profile_end_counters() - CountersBegin) ||
+      Header->NamesSize != (uint64_t)(NamesEnd - NamesBegin))
+    return 0;
+
+  /* The addresses differ between processes, compare the offsets. */
+  for (I = 0; I < Header->DataSize; I++) {
+    const __llvm_profile_data *Data = &DataBegin[I];
+    if (SrcData[I].NameSize != Data->NameSize ||
+        SrcData[I].NumCounters != Data->NumCounters ||
+        SrcData[I].FuncHash != Data->FuncHash ||
+        (uint64_t)(uintptr_t)SrcData[I].CounterPtr - Header->CountersDelta !=
+            (uint64_t)((uintptr_t)Data->CounterPtr - (uintptr_t)CountersBegin) ||
+        (uint64_t)(uintptr_t)SrcData[I].NamePtr - Header->NamesDelta !=
+            (uint64_t)((uintptr_t)Data->NamePtr - (uintptr_t)NamesBegin))
+      return 0;
+  }
+
+  SrcNames = (const char *)(SrcData + Header->DataSize) +
+             Header->CountersSize * sizeof(uint64_t);
+  return !memcmp(SrcNames, NamesBegin, Header->NamesSize);
+}
+
+/* Returns the size of the profile with the header \c Header. */
+static uint64_t getProfileSize(const __llvm_profile_header *Header) {
+  return sizeof(__llvm_profile_header) +
+         Header->DataSize * sizeof(__llvm_profile_data) +
+         Header->CountersSize * sizeof(uint64_t) + Header->NamesSize +
+         __llvm_profile_get_num_padding_bytes(Header->NamesSize) +
+         Header->ValueDataSize;
+}
+
+/* Looks for the profile of this module in the mapped profile file \c Buffer
+ * of \c Size bytes, starting at \c *Offset. Returns 0 and sets \c *Offset to
+ * the offset of the profile if it was found, 1 if the file has no more
+ * profiles of this module and -1 if it can't be parsed. */
+static int findProfileOfThisModule(const char *Buffer, uint64_t Size,
+                                   uint64_t *Offset) {
+  while (*Offset < Size) {
+    const __llvm_profile_header *Header =
+        (const __llvm_profile_header *)(Buffer + *Offset);
+    uint64_t Left = Size - *Offset;
+
+    if (*Offset % sizeof(uint64_t) || Left < sizeof(__llvm_profile_header) ||
+        Header->Magic != __llvm_profile_get_magic() ||
+        Header->Version != __llvm_profile_get_version())
+      return -1;
+    Left -= sizeof(__llvm_profile_header);
+    if (Header->DataSize > Left / sizeof(__llvm_profile_data))
+      return -1;
+    Left -= Header->DataSize * sizeof(__llvm_profile_data);
+    if (Header->CountersSize > Left / sizeof(uint64_t))
+      return -1;
+    Left -= Header->CountersSize * sizeof(uint64_t);
+    if (Header->NamesSize > Left)
+      return -1;
+    Left -= Header->NamesSize;
+    if (__llvm_profile_get_num_padding_bytes(Header->NamesSize) > Left)
+      return -1;
+    Left -= __llvm_profile_get_num_padding_bytes(Header->NamesSize);
+    if (Header->ValueDataSize > Left)
+      return -1;
+
+    if (isProfileOfThisModule(Header))
+      return 0;
+    *Offset += getProfileSize(Header);
+  }
+  return 1;
+}
+
+/* Returns the counters of the profile at \c Offset in the mapped profile file
+ * \c Buffer. */
+static uint64_t *getProfileCounters(char *Buffer, uint64_t Offset) {
+  const __llvm_profile_header *Header =
+      (const __llvm_profile_header *)(Buffer + Offset);
+  return (uint64_t *)((const __llvm_profile_data *)(Header + 1) +
+                      Header->DataSize);
+}
+
+/* Adds the counters of this module to its profile in the mapped profile file
+ * \c Buffer of \c Size bytes. Returns 0 if the counters were merged, 1 if the
+ * file has no profile of this module and -1 if it can't be merged into.  */
+static int mergeIntoProfileFile(char *Buffer, uint64_t Size) {
+  const uint64_t *CountersBegin = __llvm_profile_begin_counters();
+  const uint64_t *CountersEnd = __llvm_profile_end_counters();
+  uint64_t Offset = 0, *DstCounters, I;
+  int Found = findProfileOfThisModule(Buffer, Size, &Offset);
+
+  if (Found)
+    return Found;
+  /* Value profile data left in the file by an older runtime is kept as it
+   * is. */
+  DstCounters = getProfileCounters(Buffer, Offset);
+  for (I = 0; I < (uint64_t)(CountersEnd - CountersBegin); I++)
+    DstCounters[I] += CountersBegin[I];
+  return 0;
+}
+
+/* Opens \c OutputName creating it if needed, and locks it against concurrent
+ * writers. Returns -1 on failure. */
+static int openAndLockFile(const char *OutputName) {
+  int Fd = open(OutputName, O_RDWR | O_CREAT, 0644);
+  if (Fd == -1)
+    return -1;
+  /* Like the GCDA writer, carry on unlocked if the filesystem doesn't support
+   * flock. */
+  flock(Fd, LOCK_EX);
+  return Fd;
+}
+
+/* Merges the profile of this module into \c OutputName which is shared by
+ * many processes running the same binary. The counters are added in place
+ * if the file already has a profile of this module, otherwise the profile is
+ * appended (a shared object writes its own profile to the same file).
+ * If the file can't be merged into, e.g. it was written by an older build,
+ * the profile is written to a new "<OutputName>.<pid>" file instead.
+ * Only the counters are written: value profile data has a variable size and
+ * its target addresses differ between processes, so it can't be merged in
+ * place and is dropped. */
+static int writeFileMerged(const char *OutputName) {
+  int RetVal, Fd, Merged = 1;
+  long Size;
+  FILE *OutputFile;
+
+  Fd = openAndLockFile(OutputName);
+  if (Fd == -1)
+    return -1;
+  OutputFile = fdopen(Fd, "r+b");
+  if (!OutputFile) {
+    close(Fd);
+    return -1;
+  }
+  fseek(OutputFile, 0L, SEEK_END);
+  Size = ftell(OutputFile);
+
+  if (Size > 0) {
+    char *Buffer = mmap(0, Size, PROT_READ | PROT_WRITE, MAP_FILE | MAP_SHARED,
+                        Fd, 0);
+    if (Buffer == MAP_FAILED) {
+      fclose(OutputFile);
+      return -1;
+    }
+    Merged = mergeIntoProfileFile(Buffer, Size);
+    munmap(Buffer, Size);
+  }
+
+  RetVal = 0;
+  if (Merged == 1)
+    RetVal = writeFile(OutputFile, 0, 0);
+  /* Closing the file releases the lock. */
+  if (fclose(OutputFile))
+    RetVal = -1;
+
+  if (Merged == -1) {
+    char *FallbackName = malloc(strlen(OutputName) + MAX_PID_SIZE + 2);
+    if (!FallbackName)
+      return -1;
+    sprintf(FallbackName, "%s.%d", OutputName, getpid());
+    PROF_ERR("LLVM Profile: Can't merge into \"%s\", writing \"%s\"\n",
+             OutputName, FallbackName);
+    OutputFile = fopen(FallbackName, "wb");
+    free(FallbackName);
+    if (!OutputFile)
+      return -1;
+    RetVal = writeFile(OutputFile, 0, 0);
+    fclose(OutputFile);
+  }
+  return RetVal;
+}
+
+/* Set when the counters of this module are mapped onto the profile file. */
+static int ContinuousModeActive = 0;
+/* The counters past the last page of the counters section which is mapped
+ * onto the profile file, and their offset in the file. */
+static uint64_t *ContinuousTailBegin;
+static uint64_t ContinuousTailOffset;
+
+#define PADDING_FUNCTION_NAME "__llvm_profile_padding"
+
+/* Writes a profile of a single, never executed, function that takes up
+ * exactly \c Size bytes. Its names section soaks up the padding. */
+static int writePaddingProfile(FILE *File, uint64_t Size) {
+  static const uint64_t Counter = 0;
+  const uint64_t DataSize = 1;
+  const uint64_t CountersSize = 1;
+  const uint64_t NamesSize = Size - sizeof(__llvm_profile_header) -
+                             sizeof(__llvm_profile_data) - sizeof(uint64_t);
+  const uint64_t ValueDataSize = 0;
+  const void *ValueDataBegin = 0;
+  const uint64_t *CountersBegin = &Counter;
+  const char *NamesBegin = PADDING_FUNCTION_NAME;
+  __llvm_profile_data Data = {sizeof(PADDING_FUNCTION_NAME) - 1,
+                              1,
+                              0,
+                              (IntPtrT)(uintptr_t)NamesBegin,
+                              (IntPtrT)(uintptr_t)CountersBegin,
+                              0,
+                              0,
+                              {0}};
+  __llvm_profile_header Header;
+  uint64_t I;
+
+#define INSTR_PROF_RAW_HEADER(Type, Name, Init) Header.Name = Init;
+#include "InstrProfData.inc"
+
+  if (fwrite(&Header, sizeof(Header), 1, File) != 1 ||
+      fwrite(&Data, sizeof(Data), 1, File) != 1 ||
+      fwrite(&Counter, sizeof(Counter), 1, File) != 1 ||
+      fwrite(NamesBegin, sizeof(PADDING_FUNCTION_NAME) - 1, 1, File) != 1)
+    return -1;
+  for (I = sizeof(PADDING_FUNCTION_NAME) - 1; I < NamesSize; I++)
+    if (fputc(0, File) == EOF)
+      return -1;
+  return 0;
+}
+
+/* Maps the counters section onto the profile of this module in
+ * \c OutputName, so that the counters are updated in the file as the program
+ * runs and survive a crash or a SIGKILL.
+ *
+ * Other processes running this module without "%p" in the filename, and
+ * other modules, may have mapped their counters onto the same file already:
+ * it is never truncated under them. If the file has a profile of this module
+ * with page-aligned counters, this process maps them and adds its own
+ * counters to them, so the processes share the counters. Otherwise the
+ * profile of this module is appended. Only a file which can't be parsed is
+ * overwritten.
+ *
+ * The reader expects the counters right after the data records, so the
+ * file offset of the counters is page-aligned by writing a padding profile
+ * first. Only whole pages inside the counters section are mapped: a mapping
+ * of the last, partial, page would share the variables after the counters
+ * with the file and with forked children. The aligned marker of the runtime
+ * normally pads the end of the section to a page boundary. If another object
+ * ends up after it, the counters on the last page are written at exit.
+ * Value profile data is not written in this mode. */
+static int initializeContinuousMode(const char *OutputName) {
+#if defined(_WIN32)
+  return -1;
+#else
+  const __llvm_profile_data *DataBegin = __llvm_profile_begin_data();
+  const __llvm_profile_data *DataEnd = __llvm_profile_end_data();
+  uint64_t *CountersBegin = __llvm_profile_begin_counters();
+  uint64_t *CountersEnd = __llvm_profile_end_counters();
+  const char *NamesBegin = __llvm_profile_begin_names();
+  const char *NamesEnd = __llvm_profile_end_names();
+  const uint64_t PageSize = sysconf(_SC_PAGESIZE);
+  const uint64_t DataSize = DataEnd - DataBegin;
+  const uint64_t CountersSize = CountersEnd - CountersBegin;
+  const uint64_t MappedSize =
+      CountersSize * sizeof(uint64_t) / PageSize * PageSize;
+  const uint64_t NamesSize = NamesEnd - NamesBegin;
+  const uint64_t Padding = __llvm_profile_get_num_padding_bytes(NamesSize);
+  const uint64_t ValueDataSize = 0;
+  const void *ValueDataBegin = 0;
+  const uint64_t CountersOffsetInProfile =
+      sizeof(__llvm_profile_header) + DataSize * sizeof(__llvm_profile_data);
+  const uint64_t MinPaddingSize = sizeof(__llvm_profile_header) +
+                                  sizeof(__llvm_profile_data) +
+                                  sizeof(uint64_t) +
+                                  sizeof(PADDING_FUNCTION_NAME);
+  const char Zeroes[sizeof(uint64_t)] = {0};
+  uint64_t ProfileOffset = 0, CountersOffset, PaddingSize, I;
+  uint64_t *InitialCounters = 0;
+  __llvm_profile_header Header;
+  FILE *OutputFile;
+  void *Mapping;
+  long FileSize;
+  int Fd, Found = 1;
+
+  if (!DataSize || !CountersSize || (uintptr_t)CountersBegin % PageSize) {
+    PROF_ERR("LLVM Profile: Continuous mode needs a page-aligned counters "
+             "section%s\n", "");
+    return -1;
+  }
+
+  Fd = openAndLockFile(OutputName);
+  if (Fd == -1)
+    return -1;
+  OutputFile = fdopen(Fd, "r+b");
+  if (!OutputFile) {
+    close(Fd);
+    return -1;
+  }
+  fseek(OutputFile, 0L, SEEK_END);
+  FileSize = ftell(OutputFile);
+
+  if (FileSize > 0) {
+    char *Buffer = mmap(0, FileSize, PROT_READ, MAP_FILE | MAP_SHARED, Fd, 0);
+    if (Buffer == MAP_FAILED) {
+      fclose(OutputFile);
+      return -1;
+    }
+    while (!(Found = findProfileOfThisModule(Buffer, FileSize,
+                                             &ProfileOffset))) {
+      if ((ProfileOffset + CountersOffsetInProfile) % PageSize == 0)
+        break;
+      /* Written by a process which wasn't in continuous mode. */
+      ProfileOffset +=
+          getProfileSize((const __llvm_profile_header *)(Buffer +
+                                                         ProfileOffset));
+    }
+    munmap(Buffer, FileSize);
+  }
+
+  if (Found == -1) {
+    PROF_ERR("LLVM Profile: Can't parse \"%s\", overwriting it\n",
+             OutputName);
+    if (ftruncate(Fd, 0)) {
+      fclose(OutputFile);
+      return -1;
+    }
+    FileSize = 0;
+  }
+
+  if (!Found) {
+    /* The counters counted so far are added to the mapped ones. */
+    CountersOffset = ProfileOffset + CountersOffsetInProfile;
+    InitialCounters = MappedSize ? malloc(MappedSize) : 0;
+    if (MappedSize && !InitialCounters) {
+      fclose(OutputFile);
+      return -1;
+    }
+    if (MappedSize)
+      memcpy(InitialCounters, CountersBegin, MappedSize);
+  } else {
+    CountersOffset = FileSize + CountersOffsetInProfile;
+    PaddingSize = (PageSize - CountersOffset % PageSize) % PageSize;
+    while (PaddingSize && PaddingSize < MinPaddingSize)
+      PaddingSize += PageSize;
+    CountersOffset += PaddingSize;
+
+#define INSTR_PROF_RAW_HEADER(Type, Name, Init) Header.Name = Init;
+#include "InstrProfData.inc"
+
+    {
+      ProfDataIOVec IOVec[] = {
+          {&Header, sizeof(__llvm_profile_header), 1},
+          {DataBegin, sizeof(__llvm_profile_data), DataSize},
+          {CountersBegin, sizeof(uint64_t), CountersSize},
+          {NamesBegin, sizeof(uint8_t), NamesSize},
+          {Zeroes, sizeof(uint8_t), Padding}};
+      void *File = OutputFile;
+      if (fseek(OutputFile, FileSize, SEEK_SET) ||
+          (PaddingSize && writePaddingProfile(OutputFile, PaddingSize)) ||
+          fileWriter(IOVec, sizeof(IOVec) / sizeof(*IOVec), &File) ||
+          fflush(OutputFile)) {
+        fclose(OutputFile);
+        return -1;
+      }
+    }
+  }
+
+  /* From now on the counters live in the file. */
+  Mapping = MappedSize ? mmap(CountersBegin, MappedSize,
+                              PROT_READ | PROT_WRITE, MAP_FIXED | MAP_SHARED,
+                              Fd, CountersOffset)
+                       : CountersBegin;
+  if (Mapping != MAP_FAILED && InitialCounters)
+    for (I = 0; I < MappedSize / sizeof(uint64_t); I++)
+      CountersBegin[I] += InitialCounters[I];
+  free(InitialCounters);
+  /* Closing the file releases the lock. */
+  fclose(OutputFile);
+  if (Mapping == MAP_FAILED) {
+    PROF_ERR("LLVM Profile: Failed to map the counters onto \"%s\": %s\n",
+             OutputName, strerror(errno));
+    return -1;
+  }
+  ContinuousTailBegin = CountersBegin + MappedSize / sizeof(uint64_t);
+  ContinuousTailOffset = CountersOffset + MappedSize;
+  ContinuousModeActive = 1;
+  return 0;
+#endif
+}
+
+/* Writes the counters which are not mapped onto the profile file. The last
+ * process to exit wins. */
+static int writeContinuousTail(const char *OutputName) {
+  const uint64_t *CountersEnd = __llvm_profile_end_counters();
+  const uint64_t TailSize = CountersEnd - ContinuousTailBegin;
+  FILE *OutputFile;
+  int RetVal = 0;
+
+  if (!TailSize)
+    return 0;
+  OutputFile = fopen(OutputName, "r+b");
+  if (!OutputFile)
+    return -1;
+  if (fseek(OutputFile, (long)ContinuousTailOffset, SEEK_SET) ||
+      fwrite(ContinuousTailBegin, sizeof(uint64_t), TailSize, OutputFile) !=
+          TailSize)
+    RetVal = -1;
+  if (fclose(OutputFile))
+    RetVal = -1;
+  return RetVal;
+}
+
+/* Moves the counters back from the profile file to anonymous memory, after
+ * writing the counters which are not mapped. From then on the profile is
+ * written at exit as usual. If other processes shared the counters, their
+ * counts so far are carried along. */
+static void leaveContinuousMode(const char *OutputName) {
+#if !defined(_WIN32)
+  uint64_t *CountersBegin = __llvm_profile_begin_counters();
+  const uint64_t MappedSize =
+      (ContinuousTailBegin - CountersBegin) * sizeof(uint64_t);
+  uint64_t *Copy;
+
+  writeContinuousTail(OutputName);
+  ContinuousModeActive = 0;
+  /* Without a copy, the counters keep being updated in the old file as well,
+   * which does no harm. */
+  Copy = MappedSize ? malloc(MappedSize) : 0;
+  if (!Copy)
+    return;
+  memcpy(Copy, CountersBegin, MappedSize);
+  if (mmap(CountersBegin, MappedSize, PROT_READ | PROT_WRITE,
+           MAP_FIXED | MAP_PRIVATE | MAP_ANON, -1, 0) != MAP_FAILED)
+    memcpy(CountersBegin, Copy, MappedSize);
+  free(Copy);
+#endif
+}
+
+COMPILER_RT_WEAK int __llvm_profile_MergeFile = 0;
+/* Set when the filename asks for the continuous mode. */
+static int ContinuousModeRequested = 0;
+
 static int writeFileWithName(const char *OutputName) {
   int RetVal;
   FILE *OutputFile;
+  uint64_t ValueDataSize = 0;
+  struct ValueProfData **ValueDataArray;
   if (!OutputName || !OutputName[0])
     return -1;
+  __llvm_profile_merge_counter_shards();
+  /* The mapped counters are already in the file, only the counters on the
+   * last page are not. */
+  if (ContinuousModeActive)
+    return writeContinuousTail(OutputName);
+
+  if (__llvm_profile_MergeFile)
+    return writeFileMerged(OutputName);
+
+  ValueDataArray = __llvm_profile_gather_value_data(&ValueDataSize);
 
   /* Append to the file to support profiling multiple shared objects. */
   OutputFile = fopen(OutputName, "ab");
   if (!OutputFile)
     return -1;
 
-  RetVal = writeFile(OutputFile);
+  RetVal = writeFile(OutputFile, ValueDataArray, ValueDataSize);
 
   fclose(OutputFile);
   return RetVal;
@@ -99,6 +636,11 @@ static void truncateCurrentFile(void) {
     free(Copy);
   }
 
+  /* Processes merge into the file or map their counters onto it, it must
+   * outlive them. */
+  if (__llvm_profile_MergeFile || ContinuousModeRequested)
+    return;
+
   /* Truncate the file.  Later we'll reopen and append. */
   File = fopen(Filename, "w");
   if (!File)
@@ -110,6 +652,9 @@ static void setFilename(const char *Filename, int OwnsFilename) {
   /* Check if this is a new filename and therefore needs truncation. */
   int NewFile = !__llvm_profile_CurrentFilename ||
       (Filename && strcmp(Filename, __llvm_profile_CurrentFilename));
+  /* The counters must not keep going to the old file. */
+  if (NewFile && ContinuousModeActive)
+    leaveContinuousMode(__llvm_profile_CurrentFilename);
   if (__llvm_profile_OwnsFilename)
     free(UNCONST(__llvm_profile_CurrentFilename));
 
@@ -121,13 +666,18 @@ static void setFilename(const char *Filename, int OwnsFilename) {
     truncateCurrentFile();
 }
 
-static void resetFilenameToDefault(void) { setFilename("default.profraw", 0); }
+static void resetFilenameToDefault(void) {
+  __llvm_profile_MergeFile = 0;
+  ContinuousModeRequested = 0;
+  setFilename("default.profraw", 0);
+}
 
-int getpid(void);
 static int setFilenamePossiblyWithPid(const char *Filename) {
-#define MAX_PID_SIZE 16
+#define SIGNATURE_SIZE 16
   char PidChars[MAX_PID_SIZE] = {0};
+  char SignatureChars[SIGNATURE_SIZE + 1] = {0};
   int NumPids = 0, PidLength = 0, NumHosts = 0, HostNameLength = 0;
+  int NumSignatures = 0, NumContinuous = 0;
   char *Allocated;
   int I, J;
   char Hostname[COMPILER_RT_MAX_HOSTLEN];
@@ -138,7 +688,10 @@ static int setFilenamePossiblyWithPid(const char *Filename) {
     return 0;
   }
 
-  /* Check the filename for "%p", which indicates a pid-substitution. */
+  /* Check the filename for "%p", which indicates a pid-substitution, and for
+   * "%m" which is replaced by the signature of the module and makes all
+   * processes merge their counters into the same file, without value profile
+   * data. A "%c" turns on the continuous mode. */
   for (I = 0; Filename[I]; ++I)
     if (Filename[I] == '%') {
       if (Filename[++I] == 'p') {
@@ -152,17 +705,26 @@ static int setFilenamePossiblyWithPid(const char *Filename) {
           if (COMPILER_RT_GETHOSTNAME(Hostname, COMPILER_RT_MAX_HOSTLEN))
             return -1;
           HostNameLength = strlen(Hostname);
-      }
+      } else if (Filename[I] == 'm') {
+        if (!NumSignatures++)
+          snprintf(SignatureChars, sizeof(SignatureChars), "%016" PRIx64,
+                   getModuleSignature());
+      } else if (Filename[I] == 'c')
+        NumContinuous++;
     }
 
-  if (!(NumPids || NumHosts)) {
+  /* The counters can't be both merged and mapped onto the file. */
+  __llvm_profile_MergeFile = NumSignatures > 0 && !NumContinuous;
+  ContinuousModeRequested = NumContinuous > 0;
+  if (!(NumPids || NumHosts || NumSignatures || NumContinuous)) {
     setFilename(Filename, 0);
     return 0;
   }
 
   /* Allocate enough space for the substituted filename. */
   Allocated = malloc(I + NumPids*(PidLength - 2) +
-                     NumHosts*(HostNameLength - 2) + 1);
+                     NumHosts*(HostNameLength - 2) +
+                     NumSignatures*(SIGNATURE_SIZE - 2) + 1);
   if (!Allocated)
     return -1;
 
@@ -177,6 +739,10 @@ static int setFilenamePossiblyWithPid(const char *Filename) {
         memcpy(Allocated + J, Hostname, HostNameLength);
         J += HostNameLength;
       }
+      else if (Filename[I] == 'm') {
+        memcpy(Allocated + J, SignatureChars, SIGNATURE_SIZE);
+        J += SIGNATURE_SIZE;
+      }
       /* Drop any unknown substitutions. */
     } else
       Allocated[J++] = Filename[I];
@@ -184,6 +750,9 @@ static int setFilenamePossiblyWithPid(const char *Filename) {
 
   /* Use the computed name. */
   setFilename(Allocated, 1);
+  /* Without the mapping the profile is written at exit as usual. */
+  if (NumContinuous && !ContinuousModeActive)
+    initializeContinuousMode(Allocated);
   return 0;
 }
 
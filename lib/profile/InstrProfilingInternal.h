@@ -110,9 +110,37 @@ int llvmWriteProfDataImpl(WriterCallback Writer, void *WriterCtx,
                           const uint64_t ValueDataSize, const char *NamesBegin,
                           const char *NamesEnd);
 
+/*!
+ * The value profile counters of a value site: a fixed-capacity open
+ * addressing table of values, updated without locks and without allocating.
+ * A zero value marks a free slot. Once the table is full, new values replace
+ * the value with the smallest count. The values and the counts are in separate
+ * cache lines so that the lookups don't contend with the count updates.
+ */
+#define INSTR_PROF_NUM_VALUE_SITE_SLOTS 8
+typedef struct COMPILER_RT_ALIGNAS(64) ValueProfSite {
+  uint64_t Values[INSTR_PROF_NUM_VALUE_SITE_SLOTS];
+  uint64_t Counts[INSTR_PROF_NUM_VALUE_SITE_SLOTS];
+} ValueProfSite;
+
+/*!
+ * Return the total number of value sites of \c Data.
+ */
+uint64_t __llvm_profile_get_num_value_sites(const __llvm_profile_data *Data);
+
+/*!
+ * Add to the counters section what was counted in the counter shards since
+ * the previous call.
+ */
+void __llvm_profile_merge_counter_shards(void);
+
+/*!
+ * Clear the counter shards and their merged values.
+ */
+void __llvm_profile_reset_counter_shards(void);
+
 extern char *(*GetEnvHook)(const char *);
 extern void (*FreeHook)(void *);
 extern void* (*CallocHook)(size_t, size_t);
-extern uint32_t VPBufferSize;
 
 #endif
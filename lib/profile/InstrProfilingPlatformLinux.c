@@ -32,8 +32,11 @@ extern char PROF_NAME_STOP COMPILER_RT_VISIBILITY;
 /* Add dummy data to ensure the section is always created. */
 __llvm_profile_data
     __prof_data_sect_data[0] COMPILER_RT_SECTION(INSTR_PROF_DATA_SECT_NAME_STR);
-uint64_t
-    __prof_cnts_sect_data[0] COMPILER_RT_SECTION(INSTR_PROF_CNTS_SECT_NAME_STR);
+/* The counters section is page-aligned so that the continuous mode can map
+ * it onto the profile file. The runtime is linked after the instrumented
+ * objects, so the marker also pads the end of the section to a page. */
+uint64_t __prof_cnts_sect_data[0] COMPILER_RT_ALIGNAS(4096)
+    COMPILER_RT_SECTION(INSTR_PROF_CNTS_SECT_NAME_STR);
 char __prof_nms_sect_data[0] COMPILER_RT_SECTION(INSTR_PROF_NAME_SECT_NAME_STR);
 
 COMPILER_RT_VISIBILITY const __llvm_profile_data *
@@ -14,10 +14,12 @@
 #define COMPILER_RT_ALIGNAS(x) __declspec(align(x))
 #define COMPILER_RT_VISIBILITY
 #define COMPILER_RT_WEAK __declspec(selectany)
+#define COMPILER_RT_THREAD_LOCAL __declspec(thread)
 #elif __GNUC__
 #define COMPILER_RT_ALIGNAS(x) __attribute__((aligned(x)))
 #define COMPILER_RT_VISIBILITY __attribute__((visibility("hidden")))
 #define COMPILER_RT_WEAK __attribute__((weak))
+#define COMPILER_RT_THREAD_LOCAL __thread
 #endif
 
 #define COMPILER_RT_SECTION(Sect) __attribute__((section(Sect)))
@@ -54,6 +56,17 @@
   BoolCmpXchg((void **)Ptr, OldV, NewV)
 #endif
 
+#if COMPILER_RT_HAS_ATOMICS == 1
+#ifdef _MSC_VER
+#define COMPILER_RT_ATOMIC_ADD(Ptr, V)                                         \
+  InterlockedExchangeAdd64((LONGLONG volatile *)Ptr, (LONGLONG)V)
+#else
+#define COMPILER_RT_ATOMIC_ADD(Ptr, V) __sync_fetch_and_add(Ptr, V)
+#endif
+#else /* COMPILER_RT_HAS_ATOMICS != 1 */
+#define COMPILER_RT_ATOMIC_ADD(Ptr, V) (*(Ptr) += (V))
+#endif
+
 #define PROF_ERR(Format, ...)                                                  \
   if (GetEnvHook && GetEnvHook("LLVM_PROFILE_VERBOSE_ERRORS"))                 \
     fprintf(stderr, Format, __VA_ARGS__);
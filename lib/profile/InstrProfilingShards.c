@@ -0,0 +1,117 @@
+/*===- InstrProfilingShards.c - Per-thread copies of the profile counters -===*\
+|*
+|*                     The LLVM Compiler Infrastructure
+|*
+|* This file is distributed under the University of Illinois Open Source
+|* License. See LICENSE.TXT for details.
+|*
+\*===----------------------------------------------------------------------===*/
+
+#include "InstrProfiling.h"
+#include "InstrProfilingInternal.h"
+#include <stdlib.h>
+#include <string.h>
+
+/* Threads are given one of up to INSTR_PROF_MAX_COUNTER_SHARDS shards in a
+ * round-robin fashion. LLVM_PROFILE_COUNTER_SHARDS sets the number of shards
+ * (default INSTR_PROF_DEFAULT_COUNTER_SHARDS); 0 or 1 turns sharding off.
+ * Threads beyond the number of shards share a shard, which is no worse than
+ * all of them sharing the counters section.
+ *
+ * Each shard is followed by the values of its counters which were last added
+ * to the counters section, so that every write of the profile adds only what
+ * was counted since the previous one. */
+#define INSTR_PROF_MAX_COUNTER_SHARDS 256
+#define INSTR_PROF_DEFAULT_COUNTER_SHARDS 64
+#define INSTR_PROF_SHARD_ALIGNMENT 64
+
+static uint64_t *CounterShards[INSTR_PROF_MAX_COUNTER_SHARDS];
+static uint32_t NumCounterShards;
+static uint32_t NextCounterShard;
+static COMPILER_RT_THREAD_LOCAL uint64_t *ThreadCounterShard;
+
+static uint32_t getNumCounterShards(void) {
+  const char *NumShardsStr;
+  uint32_t NumShards = NumCounterShards;
+  if (NumShards)
+    return NumShards;
+  NumShards = INSTR_PROF_DEFAULT_COUNTER_SHARDS;
+  NumShardsStr = getenv("LLVM_PROFILE_COUNTER_SHARDS");
+  if (NumShardsStr && NumShardsStr[0])
+    NumShards = atoi(NumShardsStr);
+  if (NumShards < 1)
+    NumShards = 1;
+  if (NumShards > INSTR_PROF_MAX_COUNTER_SHARDS)
+    NumShards = INSTR_PROF_MAX_COUNTER_SHARDS;
+  NumCounterShards = NumShards;
+  return NumShards;
+}
+
+/* Return the shard with index \c Idx, allocating it (aligned to cache lines)
+ * along with its merged values if this is the first thread using it. Returns
+ * 0 if allocation fails. */
+static uint64_t *getCounterShard(uint32_t Idx) {
+  uint64_t *Shard = CounterShards[Idx];
+  size_t Size;
+  char *Mem;
+  if (Shard)
+    return Shard;
+  Size = (__llvm_profile_end_counters() - __llvm_profile_begin_counters()) *
+         sizeof(uint64_t);
+  Mem = (char *)calloc(1, 2 * Size + INSTR_PROF_SHARD_ALIGNMENT);
+  if (!Mem)
+    return 0;
+  Shard = (uint64_t *)(((uintptr_t)Mem + INSTR_PROF_SHARD_ALIGNMENT - 1) &
+                       ~(uintptr_t)(INSTR_PROF_SHARD_ALIGNMENT - 1));
+  if (!COMPILER_RT_BOOL_CMPXCHG(&CounterShards[Idx], 0, Shard)) {
+    free(Mem);
+    return CounterShards[Idx];
+  }
+  return Shard;
+}
+
+COMPILER_RT_VISIBILITY uint64_t *__llvm_profile_get_counters_shard(void) {
+  uint64_t *Shard = ThreadCounterShard;
+  uint32_t NumShards;
+  if (Shard)
+    return Shard;
+  NumShards = getNumCounterShards();
+  if (NumShards > 1)
+    Shard = getCounterShard(COMPILER_RT_ATOMIC_ADD(&NextCounterShard, 1) %
+                            NumShards);
+  if (!Shard)
+    Shard = __llvm_profile_begin_counters();
+  ThreadCounterShard = Shard;
+  return Shard;
+}
+
+/* The shards are only read here, never written: a thread sharing its shard
+ * with other threads increments it without atomics, and would overwrite
+ * anything subtracted from it concurrently. */
+COMPILER_RT_VISIBILITY void __llvm_profile_merge_counter_shards(void) {
+  uint64_t *CountersBegin = __llvm_profile_begin_counters();
+  uint64_t NumCounters = __llvm_profile_end_counters() - CountersBegin;
+  uint32_t Idx;
+  uint64_t I;
+  for (Idx = 0; Idx < INSTR_PROF_MAX_COUNTER_SHARDS; Idx++) {
+    const uint64_t *Shard = CounterShards[Idx];
+    uint64_t *Merged;
+    if (!Shard)
+      continue;
+    Merged = (uint64_t *)Shard + NumCounters;
+    for (I = 0; I < NumCounters; I++) {
+      uint64_t Value = Shard[I];
+      CountersBegin[I] += Value - Merged[I];
+      Merged[I] = Value;
+    }
+  }
+}
+
+COMPILER_RT_VISIBILITY void __llvm_profile_reset_counter_shards(void) {
+  uint64_t NumCounters =
+      __llvm_profile_end_counters() - __llvm_profile_begin_counters();
+  uint32_t Idx;
+  for (Idx = 0; Idx < INSTR_PROF_MAX_COUNTER_SHARDS; Idx++)
+    if (CounterShards[Idx])
+      memset(CounterShards[Idx], 0, 2 * NumCounters * sizeof(uint64_t));
+}
@@ -56,78 +56,134 @@ __llvm_get_function_addr(const __llvm_profile_data *Data) {
   return Data->FunctionPointer;
 }
 
-/* Allocate an array that holds the pointers to the linked lists of
- * value profile counter nodes. The number of element of the array
- * is the total number of value profile sites instrumented. Returns
- * 0 if allocation fails.
- */
-
-static int allocateValueProfileCounters(__llvm_profile_data *Data) {
+COMPILER_RT_VISIBILITY uint64_t
+__llvm_profile_get_num_value_sites(const __llvm_profile_data *Data) {
   uint64_t NumVSites = 0;
   uint32_t VKI;
   for (VKI = IPVK_First; VKI <= IPVK_Last; ++VKI)
     NumVSites += Data->NumValueSites[VKI];
+  return NumVSites;
+}
 
-  ValueProfNode **Mem =
-      (ValueProfNode **)calloc(NumVSites, sizeof(ValueProfNode *));
+/* Allocate the value sites of \c Data, aligned to cache lines. Returns the
+ * sites, which may have been allocated by another thread, or 0 if allocation
+ * fails.
+ */
+static ValueProfSite *allocateValueProfileSites(__llvm_profile_data *Data) {
+  uint64_t NumVSites = __llvm_profile_get_num_value_sites(Data);
+  char *Mem = (char *)calloc(1, (NumVSites + 1) * sizeof(ValueProfSite));
+  ValueProfSite *Sites;
   if (!Mem)
     return 0;
-  if (!COMPILER_RT_BOOL_CMPXCHG(&Data->Values, 0, Mem)) {
+  Sites = (ValueProfSite *)(((uintptr_t)Mem + sizeof(ValueProfSite) - 1) &
+                            ~(uintptr_t)(sizeof(ValueProfSite) - 1));
+  if (!COMPILER_RT_BOOL_CMPXCHG(&Data->Values, 0, Sites)) {
     free(Mem);
-    return 0;
+    return (ValueProfSite *)Data->Values;
   }
-  return 1;
+  return Sites;
 }
 
+/* The state of the xorshift generator deciding evictions. It is per thread:
+ * a shared one would be written by every thread instrumenting a full site. */
+static COMPILER_RT_THREAD_LOCAL uint64_t EvictionRandom = 0x2545F4914F6CDD1DULL;
+
 COMPILER_RT_VISIBILITY void
 __llvm_profile_instrument_target(uint64_t TargetValue, void *Data,
                                  uint32_t CounterIndex) {
-
   __llvm_profile_data *PData = (__llvm_profile_data *)Data;
-  if (!PData)
-    return;
-
-  if (!PData->Values) {
-    if (!allocateValueProfileCounters(PData))
-      return;
-  }
+  ValueProfSite *Sites, *Site;
+  uint32_t I, Slot, MinSlot;
+  uint64_t OldValue, Random;
 
-  ValueProfNode **ValueCounters = (ValueProfNode **)PData->Values;
-  ValueProfNode *PrevVNode = NULL;
-  ValueProfNode *CurrentVNode = ValueCounters[CounterIndex];
+  /* A zero value marks a free slot, and is not a valid call target. */
+  if (!PData || !TargetValue)
+    return;
 
-  uint8_t VDataCount = 0;
-  while (CurrentVNode) {
-    if (TargetValue == CurrentVNode->VData.Value) {
-      CurrentVNode->VData.Count++;
+  Sites = (ValueProfSite *)PData->Values;
+  if (!Sites && !(Sites = allocateValueProfileSites(PData)))
+    return;
+  Site = &Sites[CounterIndex];
+
+  Slot = (uint32_t)((TargetValue * 0x9E3779B97F4A7C15ULL) >> 32) %
+         INSTR_PROF_NUM_VALUE_SITE_SLOTS;
+  for (I = 0; I < INSTR_PROF_NUM_VALUE_SITE_SLOTS; I++) {
+    uint64_t Value = Site->Values[Slot];
+    if (!Value) {
+      /* Claim the free slot, unless another thread was faster. */
+      COMPILER_RT_BOOL_CMPXCHG(&Site->Values[Slot], 0, TargetValue);
+      Value = Site->Values[Slot];
+    }
+    if (Value == TargetValue) {
+      COMPILER_RT_ATOMIC_ADD(&Site->Counts[Slot], 1);
       return;
     }
-    PrevVNode = CurrentVNode;
-    CurrentVNode = CurrentVNode->Next;
-    ++VDataCount;
+    Slot = (Slot + 1) % INSTR_PROF_NUM_VALUE_SITE_SLOTS;
   }
 
-  if (VDataCount >= INSTR_PROF_MAX_NUM_VAL_PER_SITE)
-    return;
-
-  CurrentVNode = (ValueProfNode *)calloc(1, sizeof(ValueProfNode));
-  if (!CurrentVNode)
+  /* The site is full. With probability 1/(C+1), where C is the smallest
+   * count, replace that value; the new value inherits its count plus one.
+   * On average, each occurrence of a value which is not in the site credits
+   * it with 1, so its own count is unbiased. The evicted value loses its C
+   * counts to it, and the total of the site only grows by 1/(C+1) per miss
+   * on average, so the site total undercounts the values which miss. Hot
+   * values showing up late still displace cold early ones, and the
+   * replacements (and their writes to the site) become rare as the counts
+   * grow. This is a randomized variant of the space-saving algorithm. */
+  MinSlot = 0;
+  for (I = 1; I < INSTR_PROF_NUM_VALUE_SITE_SLOTS; I++)
+    if (Site->Counts[I] < Site->Counts[MinSlot])
+      MinSlot = I;
+  Random = EvictionRandom;
+  Random ^= Random << 13;
+  Random ^= Random >> 7;
+  Random ^= Random << 17;
+  EvictionRandom = Random;
+  if (Random % (Site->Counts[MinSlot] + 1))
     return;
+  OldValue = Site->Values[MinSlot];
+  /* If another thread replaced it first, drop the value. */
+  if (COMPILER_RT_BOOL_CMPXCHG(&Site->Values[MinSlot], OldValue, TargetValue))
+    COMPILER_RT_ATOMIC_ADD(&Site->Counts[MinSlot], 1);
+}
 
-  CurrentVNode->VData.Value = TargetValue;
-  CurrentVNode->VData.Count++;
-
-  uint32_t Success = 0;
-  if (!ValueCounters[CounterIndex])
-    Success =
-        COMPILER_RT_BOOL_CMPXCHG(&ValueCounters[CounterIndex], 0, CurrentVNode);
-  else if (PrevVNode && !PrevVNode->Next)
-    Success = COMPILER_RT_BOOL_CMPXCHG(&(PrevVNode->Next), 0, CurrentVNode);
-
-  if (!Success) {
-    free(CurrentVNode);
-    return;
+/* Build the linked lists of value nodes the serializer takes from the value
+ * sites of \c Data, each sorted by value like the reader does. Racing
+ * replacements can leave a value in two slots, their counts are added up.
+ * The lists and the nodes are allocated in one block. Returns 0 if allocation
+ * fails.
+ */
+static ValueProfNode **createValueProfNodes(const __llvm_profile_data *Data) {
+  const ValueProfSite *Sites = (const ValueProfSite *)Data->Values;
+  uint64_t NumVSites = __llvm_profile_get_num_value_sites(Data), S;
+  ValueProfNode **Lists, *Nodes;
+  uint32_t I;
+
+  Lists = (ValueProfNode **)calloc(
+      1, NumVSites * (sizeof(ValueProfNode *) +
+                      INSTR_PROF_NUM_VALUE_SITE_SLOTS * sizeof(ValueProfNode)));
+  if (!Lists)
+    return 0;
+  Nodes = (ValueProfNode *)(Lists + NumVSites);
+  for (S = 0; S < NumVSites; S++) {
+    for (I = 0; I < INSTR_PROF_NUM_VALUE_SITE_SLOTS; I++) {
+      ValueProfNode **Link = &Lists[S];
+      if (!Sites[S].Counts[I])
+        continue;
+      Nodes->VData.Value = Sites[S].Values[I];
+      Nodes->VData.Count = Sites[S].Counts[I];
+      while (*Link && (*Link)->VData.Value < Nodes->VData.Value)
+        Link = &(*Link)->Next;
+      if (*Link && (*Link)->VData.Value == Nodes->VData.Value) {
+        (*Link)->VData.Count += Nodes->VData.Count;
+        continue;
+      }
+      Nodes->Next = *Link;
+      *Link = Nodes;
+      Nodes++;
+    }
   }
+  return Lists;
 }
 
 COMPILER_RT_VISIBILITY ValueProfData **
@@ -153,7 +209,10 @@ __llvm_profile_gather_value_data(uint64_t *ValueDataSize) {
    */
   for (I = (__llvm_profile_data *)DataBegin; I != DataEnd; ++I) {
     ValueProfRuntimeRecord R;
-    if (initializeValueProfRuntimeRecord(&R, I->NumValueSites, I->Values))
+    ValueProfNode **Nodes = 0;
+    if (I->Values && !(Nodes = createValueProfNodes(I)))
+      PROF_OOM_RETURN("Failed to write value profile data ");
+    if (initializeValueProfRuntimeRecord(&R, I->NumValueSites, Nodes))
       PROF_OOM_RETURN("Failed to write value profile data ");
 
     /* Compute the size of ValueProfData from this runtime record.  */
@@ -168,6 +227,7 @@ __llvm_profile_gather_value_data(uint64_t *ValueDataSize) {
       S += VS;
     }
     finalizeValueProfRuntimeRecord(&R);
+    free(Nodes);
   }
 
   if (!S) {
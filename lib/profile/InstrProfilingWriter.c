@@ -15,7 +15,6 @@
 #include "InstrProfData.inc"
 void (*FreeHook)(void *) = NULL;
 void* (*CallocHook)(size_t, size_t) = NULL;
-uint32_t VPBufferSize = 0;
 
 /* The buffer writer is reponsponsible in keeping writer state
  * across the call.
@@ -102,37 +101,41 @@ COMPILER_RT_VISIBILITY int llvmWriteProfData(WriterCallback Writer,
   const uint64_t *CountersEnd = __llvm_profile_end_counters();
   const char *NamesBegin = __llvm_profile_begin_names();
   const char *NamesEnd = __llvm_profile_end_names();
+  __llvm_profile_merge_counter_shards();
   return llvmWriteProfDataImpl(Writer, WriterCtx, DataBegin, DataEnd,
                                CountersBegin, CountersEnd, ValueDataArray,
                                ValueDataSize, NamesBegin, NamesEnd);
 }
 
-#define VP_BUFFER_SIZE 8 * 1024
+/* The value profile records are handed to the writer in batches of
+ * VP_IOVEC_BATCH_SIZE, without copying them. */
+#define VP_IOVEC_BATCH_SIZE 256
 static int writeValueProfData(WriterCallback Writer, void *WriterCtx,
                               ValueProfData **ValueDataBegin,
                               uint64_t NumVData) {
-  ProfBufferIO *BufferIO;
-  uint32_t I = 0, BufferSz;
+  ProfDataIOVec IOVec[VP_IOVEC_BATCH_SIZE];
+  uint32_t NumIOVecs = 0;
+  uint64_t I;
 
   if (!ValueDataBegin)
     return 0;
 
-  BufferSz = VPBufferSize ? VPBufferSize : VP_BUFFER_SIZE;
-  BufferIO = llvmCreateBufferIO(Writer, WriterCtx, BufferSz);
-
   for (I = 0; I < NumVData; I++) {
     ValueProfData *CurVData = ValueDataBegin[I];
     if (!CurVData)
       continue;
-    if (llvmBufferIOWrite(BufferIO, (const uint8_t *)CurVData,
-                          CurVData->TotalSize) != 0)
-      return -1;
+    IOVec[NumIOVecs].Data = CurVData;
+    IOVec[NumIOVecs].ElmSize = sizeof(uint8_t);
+    IOVec[NumIOVecs].NumElm = CurVData->TotalSize;
+    if (++NumIOVecs == VP_IOVEC_BATCH_SIZE) {
+      if (Writer(IOVec, NumIOVecs, &WriterCtx))
+        return -1;
+      NumIOVecs = 0;
+    }
   }
 
-  if (llvmBufferIOFlush(BufferIO) != 0)
+  if (NumIOVecs && Writer(IOVec, NumIOVecs, &WriterCtx))
     return -1;
-  llvmDeleteBufferIO(BufferIO);
-
   return 0;
 }
 
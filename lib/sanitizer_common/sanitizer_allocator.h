@@ -465,6 +465,17 @@ class SizeClassAllocator64 {
     }
   }
 
+  // Iterate over the address ranges which may contain chunks.
+  // The allocator must be locked when calling this function.
+  void ForEachUserRange(RangeIteratorCallback callback, void *arg) {
+    for (uptr class_id = 1; class_id < kNumClasses; class_id++) {
+      RegionInfo *region = GetRegionInfo(class_id);
+      uptr region_beg = kSpaceBeg + class_id * kRegionSize;
+      if (region->allocated_user)
+        callback(region_beg, region_beg + region->allocated_user, arg);
+    }
+  }
+
   static uptr AdditionalSize() {
     return RoundUpTo(sizeof(RegionInfo) * kNumClassesRounded,
                      GetPageSizeCached());
@@ -820,6 +831,14 @@ class SizeClassAllocator32 {
       }
   }
 
+  // Iterate over the address ranges which may contain chunks.
+  // The allocator must be locked when calling this function.
+  void ForEachUserRange(RangeIteratorCallback callback, void *arg) {
+    for (uptr region = 0; region < kNumPossibleRegions; region++)
+      if (possible_regions[region])
+        callback(region * kRegionSize, (region + 1) * kRegionSize, arg);
+  }
+
   void PrintStats() {
   }
 
@@ -1218,6 +1237,14 @@ class LargeMmapAllocator {
       callback(reinterpret_cast<uptr>(GetUser(chunks_[i])), arg);
   }
 
+  // Iterate over the address ranges which may contain chunks.
+  // The allocator must be locked when calling this function.
+  void ForEachUserRange(RangeIteratorCallback callback, void *arg) {
+    for (uptr i = 0; i < n_chunks_; i++)
+      callback(chunks_[i]->map_beg, chunks_[i]->map_beg + chunks_[i]->map_size,
+               arg);
+  }
+
  private:
   static const int kMaxNumChunks = 1 << FIRST_32_SECOND_64(15, 18);
   struct Header {
@@ -1439,6 +1466,13 @@ class CombinedAllocator {
     secondary_.ForEachChunk(callback, arg);
   }
 
+  // Iterate over the address ranges which may contain chunks.
+  // The allocator must be locked when calling this function.
+  void ForEachUserRange(RangeIteratorCallback callback, void *arg) {
+    primary_.ForEachUserRange(callback, arg);
+    secondary_.ForEachUserRange(callback, arg);
+  }
+
  private:
   PrimaryAllocator primary_;
   SecondaryAllocator secondary_;
@@ -338,9 +338,20 @@ void LoadedModule::set(const char *module_name, uptr base_address) {
   base_address_ = base_address;
 }
 
+void LoadedModule::setBuildId(const u8 *build_id, uptr size) {
+  size = Min(size, kMaxBuildIdSize);
+  static const char kHexDigits[] = "0123456789abcdef";
+  for (uptr i = 0; i < size; i++) {
+    build_id_[2 * i] = kHexDigits[build_id[i] >> 4];
+    build_id_[2 * i + 1] = kHexDigits[build_id[i] & 0xf];
+  }
+  build_id_[2 * size] = '\0';
+}
+
 void LoadedModule::clear() {
   InternalFree(full_name_);
   full_name_ = nullptr;
+  build_id_[0] = '\0';
   while (!ranges_.empty()) {
     AddressRange *r = ranges_.front();
     ranges_.pop_front();
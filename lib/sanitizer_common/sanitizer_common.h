@@ -44,9 +44,6 @@ const uptr kWordSizeInBits = 8 * kWordSize;
 
 const uptr kMaxPathLength = 4096;
 
-// 16K loaded modules should be enough for everyone.
-static const uptr kMaxNumberOfModules = 1 << 14;
-
 const uptr kMaxThreadStackSize = 1 << 30;  // 1Gb
 
 static const uptr kErrorMessageBufferSize = 1 << 16;
@@ -639,14 +636,21 @@ uptr InternalBinarySearch(const Container &v, uptr first, uptr last,
 // executable or a shared object).
 class LoadedModule {
  public:
-  LoadedModule() : full_name_(nullptr), base_address_(0) { ranges_.clear(); }
+  LoadedModule() : full_name_(nullptr), base_address_(0) {
+    build_id_[0] = '\0';
+    ranges_.clear();
+  }
   void set(const char *module_name, uptr base_address);
+  // Stores the build ID (e.g. the contents of the NT_GNU_BUILD_ID note).
+  void setBuildId(const u8 *build_id, uptr size);
   void clear();
   void addAddressRange(uptr beg, uptr end, bool executable);
   bool containsAddress(uptr address) const;
 
   const char *full_name() const { return full_name_; }
   uptr base_address() const { return base_address_; }
+  // The build ID in hex, or nullptr if it is unknown.
+  const char *build_id() const { return build_id_[0] ? build_id_ : nullptr; }
 
   struct AddressRange {
     AddressRange *next;
@@ -661,8 +665,11 @@ class LoadedModule {
   const IntrusiveList<AddressRange> &ranges() const { return ranges_; }
 
  private:
+  static const uptr kMaxBuildIdSize = 32;
+
   char *full_name_;  // Owned.
   uptr base_address_;
+  char build_id_[2 * kMaxBuildIdSize + 1];
   IntrusiveList<AddressRange> ranges_;
 };
 
@@ -673,6 +680,13 @@ class LoadedModule {
 typedef bool (*string_predicate_t)(const char *);
 uptr GetListOfModules(LoadedModule *modules, uptr max_modules,
                       string_predicate_t filter);
+// Same as above, but appends the descriptions of all the modules that pass the
+// filter to |modules|, however many there are. The caller should clear() them.
+void GetListOfModules(InternalMmapVector<LoadedModule> *modules,
+                      string_predicate_t filter);
+// OS-dependent function that returns a number which changes whenever a module
+// is loaded or unloaded, or 0 if it can't be computed cheaply.
+u64 GetLoadedModulesStamp();
 
 // Callback type for iterating over a set of memory ranges.
 typedef void (*RangeIteratorCallback)(uptr begin, uptr end, void *arg);
@@ -46,6 +46,24 @@ void SetSandboxingCallback(void (*f)()) {
   sandboxing_callback = f;
 }
 
+#if !SANITIZER_GO
+void GetListOfModules(InternalMmapVector<LoadedModule> *modules,
+                      string_predicate_t filter) {
+  for (uptr capacity = Max(modules->capacity(), (uptr)64);; capacity *= 2) {
+    InternalScopedBuffer<LoadedModule> buffer(capacity);
+    uptr n_modules = GetListOfModules(buffer.data(), capacity, filter);
+    if (n_modules < capacity) {
+      for (uptr i = 0; i < n_modules; i++)
+        modules->push_back(buffer[i]);
+      return;
+    }
+    // The buffer might have been too small, retry with a larger one.
+    for (uptr i = 0; i < n_modules; i++)
+      buffer[i].clear();
+  }
+}
+#endif
+
 void ReportErrorSummary(const char *error_type, StackTrace *stack) {
 #if !SANITIZER_GO
   if (!common_flags()->print_summary)
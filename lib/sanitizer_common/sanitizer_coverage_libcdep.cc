@@ -30,6 +30,9 @@
 // one of 0xC0BFFFFFFFFFFF64 and 0xC0BFFFFFFFFFFF32. The last byte of the
 // magic defines the size of the following offsets.
 // The rest of the data is the offsets in the module.
+// With coverage_compact=1 the magic is 0xC0BFFFFFFFFFFFC8 and the sorted
+// offsets follow as ULEB128-encoded deltas from the previous offset (the
+// first one from zero).
 //
 // Eventually, this coverage implementation should be obsoleted by a more
 // powerful general purpose Clang/LLVM coverage instrumentation.
@@ -47,10 +50,27 @@
 #include "sanitizer_symbolizer.h"
 #include "sanitizer_flags.h"
 
+#if SANITIZER_CAN_TRACE_CMP && SANITIZER_POSIX
+#include <pthread.h>
+#endif
+
+#ifdef __SSE2__
+// <emmintrin.h> transitively includes <stdlib.h>,
+// and it's prohibited to include std headers into the runtime.
+// So we do this dirty trick.
+#define _MM_MALLOC_H_INCLUDED
+#define __MM_MALLOC_H
+#include <emmintrin.h>
+#endif
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
 static const u64 kMagic64 = 0xC0BFFFFFFFFFFF64ULL;
 static const u64 kMagic32 = 0xC0BFFFFFFFFFFF32ULL;
 static const uptr kNumWordsForMagic = SANITIZER_WORDSIZE == 64 ? 1 : 2;
 static const u64 kMagic = SANITIZER_WORDSIZE == 64 ? kMagic64 : kMagic32;
+static const u64 kMagicCompact = 0xC0BFFFFFFFFFFFC8ULL;
 
 static atomic_uint32_t dump_once_guard;  // Ensure that CovDump runs only once.
 
@@ -70,6 +90,15 @@ static void ResetGlobalCounters() {
 // In this mode, __sanitizer_cov_dump does nothing, and CovUpdateMapping()
 // dump current memory layout to another file.
 
+// With coverage_live=1 in ASAN_OPTIONS, a bitmap of the covered blocks is
+// mapped to <coverage_dir>/<pid>.sancov.live, so that other processes can
+// watch the coverage of a running process. The file starts with CovLiveHeader
+// followed by one byte per block (numbered as in the .bitset-sancov files),
+// which is set to 1 when the block is executed for the first time. Use a
+// tmpfs coverage_dir (e.g. /dev/shm) to keep the file in memory.
+// The bitmap is only written when a guard fires for the first time, so it
+// adds nothing to the __sanitizer_cov fast path.
+
 static bool cov_sandboxed = false;
 static fd_t cov_fd = kInvalidFd;
 static unsigned int cov_max_block_size = 0;
@@ -78,6 +107,21 @@ static const char *coverage_dir;
 
 namespace __sanitizer {
 
+// Layout of the .sancov.live file header. All fields are in the native byte
+// order, bump kLiveVersion when changing this.
+struct CovLiveHeader {
+  u64 magic;                    // kLiveMagic.
+  u32 version;                  // kLiveVersion.
+  u32 header_size;              // Offset of the bitmap in the file.
+  u64 pid;
+  atomic_uint64_t num_blocks;   // Number of valid bytes in the bitmap.
+  atomic_uint64_t num_covered;  // Number of bitmap bytes set to 1.
+  u64 reserved[3];
+};
+
+static const u64 kLiveMagic = 0xC0BFFFFFFFFF11FEULL;
+static const u32 kLiveVersion = 1;
+
 class CoverageData {
  public:
   void Init();
@@ -87,6 +131,7 @@ class CoverageData {
   void BeforeFork();
   void AfterFork(int child_pid);
   void Extend(uptr npcs);
+  void EnableLive();
   void Add(uptr pc, u32 *guard);
   void IndirCall(uptr caller, uptr callee, uptr callee_cache[],
                  uptr cache_size);
@@ -119,6 +164,7 @@ class CoverageData {
   };
 
   void DirectOpen();
+  void ExtendLive(uptr num_blocks);
   void UpdateModuleNameVec(uptr caller_pc, uptr range_beg, uptr range_end);
   void GetRangeOffsets(const NamedPcRange& r, Symbolizer* s,
       InternalMmapVector<uptr>* offsets) const;
@@ -145,6 +191,15 @@ class CoverageData {
 
   uptr *pc_buffer;
 
+  // The file mapped live coverage file, a CovLiveHeader followed by
+  // live_bitmap. The whole kLiveMaxSize range is reserved up front and the
+  // file is mapped into it by kPcArrayMmapSize chunks.
+  static const uptr kLiveMaxSize = sizeof(CovLiveHeader) + kPcArrayMaxSize;
+  CovLiveHeader *live_header;
+  u8 *live_bitmap;
+  uptr live_mapped_size;
+  fd_t live_fd;
+
   // Vector of coverage guard arrays, protected by mu.
   InternalMmapVectorNoCtor<s32*> guard_array_vec;
 
@@ -202,6 +257,66 @@ void CoverageData::DirectOpen() {
 
 void CoverageData::Init() {
   pc_fd = kInvalidFd;
+  live_fd = kInvalidFd;
+}
+
+void CoverageData::EnableLive() {
+  if (!coverage_enabled || !common_flags()->coverage_live || live_header)
+    return;
+  InternalScopedString path(kMaxPathLength);
+  internal_snprintf((char *)path.data(), path.size(), "%s/%zd.sancov.live",
+                    coverage_dir, internal_getpid());
+  live_fd = OpenFile(path.data(), RdWr);
+  if (live_fd == kInvalidFd) {
+    Report("Coverage: failed to open %s for reading/writing\n", path.data());
+    Die();
+  }
+  live_header = reinterpret_cast<CovLiveHeader *>(
+      MmapNoReserveOrDie(kLiveMaxSize, "CovInit::live"));
+  live_bitmap = reinterpret_cast<u8 *>(live_header + 1);
+  live_mapped_size = 0;
+  SpinMutexLock l(&mu);
+  uptr n = size();
+  ExtendLive(n);
+  live_header->magic = kLiveMagic;
+  live_header->version = kLiveVersion;
+  live_header->header_size = sizeof(CovLiveHeader);
+  live_header->pid = internal_getpid();
+  // Blocks might have been executed before coverage was enabled.
+  uptr num_covered = 0;
+  for (uptr i = 0; i < n; i++) {
+    if (pc_array[i]) {
+      live_bitmap[i] = 1;
+      num_covered++;
+    }
+  }
+  atomic_store(&live_header->num_covered, num_covered, memory_order_relaxed);
+  atomic_store(&live_header->num_blocks, n, memory_order_release);
+  VReport(1, " CovLive: %s: %zd blocks, %zd covered\n", path.data(), n,
+          num_covered);
+}
+
+// Makes sure that the live bitmap fits num_blocks blocks. Requires mu.
+void CoverageData::ExtendLive(uptr num_blocks) {
+  if (!live_header) return;
+  uptr size = sizeof(CovLiveHeader) + num_blocks;
+  if (size > live_mapped_size) {
+    uptr new_mapped_size = RoundUpTo(size, kPcArrayMmapSize);
+    CHECK_LE(new_mapped_size, kLiveMaxSize);
+    uptr res = internal_ftruncate(live_fd, new_mapped_size);
+    int err;
+    if (internal_iserror(res, &err)) {
+      Printf("failed to extend live coverage file: %d\n", err);
+      Die();
+    }
+    uptr next_map_base = reinterpret_cast<uptr>(live_header) + live_mapped_size;
+    void *p = MapWritableFileToMemory((void *)next_map_base,
+                                      new_mapped_size - live_mapped_size,
+                                      live_fd, live_mapped_size);
+    CHECK_EQ((uptr)p, next_map_base);
+    live_mapped_size = new_mapped_size;
+  }
+  atomic_store(&live_header->num_blocks, num_blocks, memory_order_release);
 }
 
 void CoverageData::Enable() {
@@ -273,6 +388,15 @@ void CoverageData::Disable() {
     CloseFile(pc_fd);
     pc_fd = kInvalidFd;
   }
+  if (live_header) {
+    UnmapOrDie(live_header, kLiveMaxSize);
+    live_header = nullptr;
+    live_bitmap = nullptr;
+  }
+  if (live_fd != kInvalidFd) {
+    CloseFile(live_fd);
+    live_fd = kInvalidFd;
+  }
 }
 
 void CoverageData::ReinitializeGuards() {
@@ -280,6 +404,10 @@ void CoverageData::ReinitializeGuards() {
   atomic_store(&pc_array_index, 0, memory_order_relaxed);
   for (uptr i = 0; i < guard_array_vec.size(); i++)
     InitializeGuardArray(guard_array_vec[i]);
+  if (live_header) {
+    internal_memset(live_bitmap, 0, size());
+    atomic_store(&live_header->num_covered, 0, memory_order_relaxed);
+  }
 }
 
 void CoverageData::ReInit() {
@@ -301,6 +429,8 @@ void CoverageData::ReInit() {
   // We are single-threaded now, no need to grab any lock.
   CHECK_EQ(atomic_load(&pc_array_index, memory_order_relaxed), 0);
   ReinitializeGuards();
+  // The child gets its own live file, the mapping of the parent's one is gone.
+  EnableLive();
 }
 
 void CoverageData::BeforeFork() {
@@ -385,6 +515,7 @@ void CoverageData::InitializeGuards(s32 *guards, uptr n,
   comp_unit_name_vec.push_back({comp_unit_name, range_beg, range_end});
   guard_array_vec.push_back(guards);
   UpdateModuleNameVec(caller_pc, range_beg, range_end);
+  ExtendLive(range_end);
 }
 
 static const uptr kBundleCounterBits = 16;
@@ -431,6 +562,11 @@ void CoverageData::Add(uptr pc, u32 *guard) {
   uptr counter = atomic_fetch_add(&coverage_counter, 1, memory_order_relaxed);
   pc_array[idx] = BundlePcAndCounter(pc, counter);
   if (pc_buffer) pc_buffer[counter] = pc;
+  CovLiveHeader *live = live_header;
+  if (live && idx < atomic_load(&live->num_blocks, memory_order_acquire)) {
+    live_bitmap[idx] = 1;
+    atomic_fetch_add(&live->num_covered, 1, memory_order_relaxed);
+  }
 }
 
 // Registers a pair caller=>callee.
@@ -471,11 +607,85 @@ uptr CoverageData::GetNumberOf8bitCounters() {
   return num_8bit_counters;
 }
 
+// Every counter value is mapped to one of 8 bits:
+// 1, 2, 3, 4-7, 8-15, 16-31, 32-127, 128+.
+static u64 CounterToBit(u64 x) {
+  /**/ if (x >= 128) return 128;
+  else if (x >= 32) return 64;
+  else if (x >= 16) return 32;
+  else if (x >= 8) return 16;
+  else if (x >= 4) return 8;
+  else if (x >= 3) return 4;
+  else if (x >= 2) return 2;
+  else if (x >= 1) return 1;
+  return 0;
+}
+
+#ifdef __SSE2__
+// Vector version of CounterToBit for 16 counters at once.
+static ALWAYS_INLINE __m128i CountersToBits(__m128i x) {
+  // The bytes of x that are >= c.
+#define GE(c) _mm_cmpeq_epi8(_mm_max_epu8(x, _mm_set1_epi8((char)c)), x)
+  // The bytes of x that are in [lo, hi) mapped to bit.
+#define RANGE(lo, hi, bit) \
+  _mm_and_si128(_mm_andnot_si128(hi, lo), _mm_set1_epi8((char)bit))
+  __m128i lt1 = _mm_cmpeq_epi8(x, _mm_setzero_si128());
+  __m128i ge2 = GE(2), ge3 = GE(3), ge4 = GE(4), ge8 = GE(8), ge16 = GE(16),
+          ge32 = GE(32), ge128 = GE(128);
+  __m128i res = _mm_and_si128(ge128, _mm_set1_epi8((char)128));
+  res = _mm_or_si128(res, RANGE(ge32, ge128, 64));
+  res = _mm_or_si128(res, RANGE(ge16, ge32, 32));
+  res = _mm_or_si128(res, RANGE(ge8, ge16, 16));
+  res = _mm_or_si128(res, RANGE(ge4, ge8, 8));
+  res = _mm_or_si128(res, RANGE(ge3, ge4, 4));
+  res = _mm_or_si128(res, RANGE(ge2, ge3, 2));
+  res = _mm_or_si128(res, _mm_andnot_si128(_mm_or_si128(lt1, ge2),
+                                           _mm_set1_epi8(1)));
+#undef RANGE
+#undef GE
+  return res;
+}
+
+// Updates the bitset for 16 counters and clears them. Returns the number of
+// new bits.
+static ALWAYS_INLINE uptr UpdateBitset16(u8 *c, u8 *b) {
+  __m128i zero = _mm_setzero_si128();
+  __m128i x = _mm_load_si128(reinterpret_cast<__m128i *>(c));
+  if (_mm_movemask_epi8(_mm_cmpeq_epi8(x, zero)) == 0xffff)
+    return 0;
+  _mm_store_si128(reinterpret_cast<__m128i *>(c), zero);
+  __m128i old_bits = _mm_loadu_si128(reinterpret_cast<__m128i *>(b));
+  __m128i bits = CountersToBits(x);
+  _mm_storeu_si128(reinterpret_cast<__m128i *>(b),
+                   _mm_or_si128(old_bits, bits));
+  // Every byte of bits has at most one bit set, so count the bytes with a new
+  // bit: map them to 1 and sum them up.
+  __m128i new_bits = _mm_min_epu8(_mm_andnot_si128(old_bits, bits),
+                                  _mm_set1_epi8(1));
+  __m128i sum = _mm_sad_epu8(new_bits, zero);
+  return _mm_cvtsi128_si32(sum) + _mm_extract_epi16(sum, 4);
+}
+#endif
+
+#ifdef __AVX2__
+// Updates the bitset for 32 counters and clears them. Returns the number of
+// new bits.
+static ALWAYS_INLINE uptr UpdateBitset32(u8 *c, u8 *b) {
+  __m256i x = _mm256_loadu_si256(reinterpret_cast<__m256i *>(c));
+  if (_mm256_testz_si256(x, x))
+    return 0;
+  return UpdateBitset16(c, b) + UpdateBitset16(c + 16, b + 16);
+}
+#endif
+
 // Map every 8bit counter to a 8-bit bitset and clear the counter.
+// Most of the counters are zero after an execution, so all-zero spans are
+// skipped as fast as possible. With SSE2 the counters are checked 64 bytes
+// at a time and converted to bits 16 at a time in parallel, otherwise they
+// are processed 8 at a time. The result is the same in either case.
 uptr CoverageData::Update8bitCounterBitsetAndClearCounters(u8 *bitset) {
   uptr num_new_bits = 0;
   uptr cur = 0;
-  // For better speed we map 8 counters to 8 bytes of bitset at once.
   static const uptr kBatchSize = 8;
   CHECK_EQ(reinterpret_cast<uptr>(bitset) % kBatchSize, 0);
   for (uptr i = 0, len = counters_vec.size(); i < len; i++) {
@@ -483,43 +693,52 @@ uptr CoverageData::Update8bitCounterBitsetAndClearCounters(u8 *bitset) {
     uptr n = counters_vec[i].n;
     CHECK_EQ(n % 16, 0);
     CHECK_EQ(cur % kBatchSize, 0);
-    CHECK_EQ(reinterpret_cast<uptr>(c) % kBatchSize, 0);
+    CHECK_EQ(reinterpret_cast<uptr>(c) % 16, 0);
     if (!bitset) {
       internal_bzero_aligned16(c, n);
       cur += n;
       continue;
     }
-    for (uptr j = 0; j < n; j += kBatchSize, cur += kBatchSize) {
-      CHECK_LT(cur, num_8bit_counters);
+    CHECK_LE(cur + n, num_8bit_counters);
+    u8 *b = bitset + cur;
+    uptr j = 0;
+#ifdef __SSE2__
+    for (; j + 64 <= n; j += 64) {
+      __m128i *x = reinterpret_cast<__m128i *>(c + j);
+      __m128i any = _mm_or_si128(
+          _mm_or_si128(_mm_load_si128(x), _mm_load_si128(x + 1)),
+          _mm_or_si128(_mm_load_si128(x + 2), _mm_load_si128(x + 3)));
+      if (_mm_movemask_epi8(_mm_cmpeq_epi8(any, _mm_setzero_si128())) ==
+          0xffff)
+        continue;
+#ifdef __AVX2__
+      num_new_bits += UpdateBitset32(c + j, b + j);
+      num_new_bits += UpdateBitset32(c + j + 32, b + j + 32);
+#else
+      for (uptr k = 0; k < 64; k += 16)
+        num_new_bits += UpdateBitset16(c + j + k, b + j + k);
+#endif
+    }
+    for (; j < n; j += 16)
+      num_new_bits += UpdateBitset16(c + j, b + j);
+#endif
+    for (; j < n; j += kBatchSize) {
       u64 *pc64 = reinterpret_cast<u64*>(c + j);
-      u64 *pb64 = reinterpret_cast<u64*>(bitset + cur);
+      u64 *pb64 = reinterpret_cast<u64*>(b + j);
       u64 c64 = *pc64;
-      u64 old_bits_64 = *pb64;
-      u64 new_bits_64 = old_bits_64;
-      if (c64) {
-        *pc64 = 0;
-        for (uptr k = 0; k < kBatchSize; k++) {
-          u64 x = (c64 >> (8 * k)) & 0xff;
-          if (x) {
-            u64 bit = 0;
-            /**/ if (x >= 128) bit = 128;
-            else if (x >= 32) bit = 64;
-            else if (x >= 16) bit = 32;
-            else if (x >= 8) bit = 16;
-            else if (x >= 4) bit = 8;
-            else if (x >= 3) bit = 4;
-            else if (x >= 2) bit = 2;
-            else if (x >= 1) bit = 1;
-            u64 mask = bit << (8 * k);
-            if (!(new_bits_64 & mask)) {
-              num_new_bits++;
-              new_bits_64 |= mask;
-            }
-          }
+      if (!c64) continue;
+      *pc64 = 0;
+      u64 new_bits_64 = *pb64;
+      for (uptr k = 0; k < kBatchSize; k++) {
+        u64 mask = CounterToBit((c64 >> (8 * k)) & 0xff) << (8 * k);
+        if (mask && !(new_bits_64 & mask)) {
+          num_new_bits++;
+          new_bits_64 |= mask;
         }
-        *pb64 = new_bits_64;
       }
+      *pb64 = new_bits_64;
     }
+    cur += n;
   }
   CHECK_EQ(cur, num_8bit_counters);
   return num_new_bits;
@@ -579,6 +798,59 @@ static void CovWritePacked(int pid, const char *module, const void *blob,
   }
 }
 
+// Writes the sorted offsets of one module in the compact format, either to fd
+// or, if fd is kInvalidFd, as packed blocks. The data is encoded into a
+// fixed-size buffer which is written out whenever it fills up. In packed mode
+// every chunk becomes a separate block; unpacking appends the blocks of a
+// module, which restores the stream.
+class CompactOffsetsWriter {
+ public:
+  CompactOffsetsWriter(fd_t fd, const char *module_name)
+      : fd_(fd), module_name_(module_name), buffer_(kChunkSize), pos_(0),
+        last_offset_(0), bytes_written_(0) {
+    internal_memcpy(buffer_.data(), &kMagicCompact, sizeof(kMagicCompact));
+    pos_ = sizeof(kMagicCompact);
+  }
+
+  void Write(uptr offset) {
+    CHECK_GE(offset, last_offset_);
+    if (pos_ + kMaxEncodedSize > kChunkSize)
+      Flush();
+    u64 delta = offset - last_offset_;
+    last_offset_ = offset;
+    u8 *p = buffer_.data() + pos_;
+    do {
+      u8 byte = delta & 0x7f;
+      delta >>= 7;
+      *p++ = delta ? byte | 0x80 : byte;
+    } while (delta);
+    pos_ = p - buffer_.data();
+  }
+
+  void Flush() {
+    if (!pos_) return;
+    if (fd_ == kInvalidFd)
+      CovWritePacked(internal_getpid(), module_name_, buffer_.data(), pos_);
+    else
+      WriteToFile(fd_, buffer_.data(), pos_);
+    bytes_written_ += pos_;
+    pos_ = 0;
+  }
+
+  uptr bytes_written() const { return bytes_written_; }
+
+ private:
+  static const uptr kChunkSize = 1 << 16;
+  static const uptr kMaxEncodedSize = 10;  // ULEB128 of a 64-bit value.
+
+  fd_t fd_;
+  const char *module_name_;
+  InternalScopedBuffer<u8> buffer_;
+  uptr pos_;
+  uptr last_offset_;
+  uptr bytes_written_;
+};
+
 // If packed = false: <name>.<pid>.<sancov> (name = module name).
 // If packed = true and name == 0: <pid>.<sancov>.<packed>.
 // If packed = true and name != 0: <name>.<sancov>.<packed> (name is
@@ -808,6 +1080,9 @@ void CoverageData::DumpOffsets() {
   CHECK_NE(sym, nullptr);
   InternalMmapVector<uptr> offsets(0);
   InternalScopedString path(kMaxPathLength);
+  // The compact format needs sorted offsets.
+  bool compact = common_flags()->coverage_compact &&
+                 !(SANITIZER_WORDSIZE == 64 && common_flags()->coverage_order_pcs);
 
   InternalMmapVector<char *> sancov_argv(module_name_vec.size() + 2);
   sancov_argv.push_back(FindPathToBinary(common_flags()->sancov_path));
@@ -834,7 +1109,24 @@ void CoverageData::DumpOffsets() {
     *magic_p = kMagic;
 
     const char *module_name = StripModuleName(r.copied_module_name);
-    if (cov_sandboxed) {
+    if (compact) {
+      fd_t fd = kInvalidFd;
+      if (cov_sandboxed) {
+        if (cov_fd == kInvalidFd) continue;
+      } else {
+        fd = CovOpenFile(&path, false /* packed */, module_name);
+        if (fd == kInvalidFd) continue;
+      }
+      CompactOffsetsWriter writer(fd, module_name);
+      for (uptr i = kNumWordsForMagic; i < offsets.size(); i++)
+        writer.Write(offsets[i]);
+      writer.Flush();
+      if (fd != kInvalidFd)
+        CloseFile(fd);
+      VReport(1, " CovDump: %s: %zd PCs written in %zd bytes (compact)\n",
+              cov_sandboxed ? module_name : path.data(), num_offsets,
+              writer.bytes_written());
+    } else if (cov_sandboxed) {
       if (cov_fd != kInvalidFd) {
         CovWritePacked(internal_getpid(), module_name, offsets.data(),
                        offsets.size() * sizeof(offsets[0]));
@@ -909,7 +1201,10 @@ void InitializeCoverage(bool enabled, const char *dir) {
   coverage_enabled = enabled;
   coverage_dir = dir;
   coverage_data.Init();
-  if (enabled) coverage_data.Enable();
+  if (enabled) {
+    coverage_data.Enable();
+    coverage_data.EnableLive();
+  }
   if (!common_flags()->coverage_direct) Atexit(__sanitizer_cov_dump);
   AddDieCallback(MaybeDumpCoverage);
 }
@@ -925,6 +1220,75 @@ void CoverageUpdateMapping() {
     CovUpdateMapping(coverage_dir);
 }
 
+// Per-thread tables of the most recent comparison operands, filled by the
+// trace-cmp instrumentation. In-process fuzzers read them to find the values
+// the input has to contain to take the other side of a comparison.
+// Keep in sync with __sanitizer_cmp_trace_entry in coverage_interface.h.
+struct CmpTraceEntry {
+  u64 pc;
+  u64 arg1;
+  u64 arg2;
+  u32 size;  // Operand size in bits.
+  u32 type;  // Comparison predicate, 0 for switch statements.
+};
+
+static const uptr kCmpTraceSize = 128;  // Must be a power of two.
+
+#if SANITIZER_CAN_TRACE_CMP
+// The table of a thread is mapped on its first traced comparison, so that
+// threads which never run trace-cmp code only pay for two words of TLS. On
+// POSIX, a TSD destructor unmaps the table when its thread exits.
+static THREADLOCAL CmpTraceEntry *cmp_trace_entries;
+// Number of comparisons recorded since the last reset. The table is a ring
+// buffer, only the last kCmpTraceSize comparisons are kept.
+static THREADLOCAL uptr cmp_trace_pos;
+
+#if SANITIZER_POSIX
+static StaticSpinMutex cmp_trace_key_mu;
+static bool cmp_trace_key_created;
+static pthread_key_t cmp_trace_key;
+
+static void FreeCmpTrace(void *entries) {
+  // Comparisons traced by the TSD destructors which run after this one map a
+  // new table, which is freed in the next round of destructors.
+  cmp_trace_entries = nullptr;
+  cmp_trace_pos = 0;
+  UnmapOrDie(entries, kCmpTraceSize * sizeof(CmpTraceEntry));
+}
+#endif
+
+static NOINLINE CmpTraceEntry *AllocateCmpTrace() {
+  cmp_trace_entries = (CmpTraceEntry *)MmapOrDie(
+      kCmpTraceSize * sizeof(CmpTraceEntry), "CmpTrace");
+#if SANITIZER_POSIX
+  {
+    SpinMutexLock l(&cmp_trace_key_mu);
+    if (!cmp_trace_key_created) {
+      CHECK_EQ(0, pthread_key_create(&cmp_trace_key, FreeCmpTrace));
+      cmp_trace_key_created = true;
+    }
+  }
+  CHECK_EQ(0, pthread_setspecific(cmp_trace_key, cmp_trace_entries));
+#endif
+  return cmp_trace_entries;
+}
+
+static ALWAYS_INLINE void TraceCmp(uptr pc, u32 size, u32 type, u64 arg1,
+                                   u64 arg2) {
+  CmpTraceEntry *entries = cmp_trace_entries;
+  if (UNLIKELY(!entries))
+    entries = AllocateCmpTrace();
+  CmpTraceEntry *entry = &entries[cmp_trace_pos++ & (kCmpTraceSize - 1)];
+  entry->pc = pc;
+  entry->arg1 = arg1;
+  entry->arg2 = arg2;
+  entry->size = size;
+  entry->type = type;
+}
+#else
+static void TraceCmp(uptr pc, u32 size, u32 type, u64 arg1, u64 arg2) {}
+#endif
+
 } // namespace __sanitizer
 
 extern "C" {
@@ -1017,9 +1381,49 @@ SANITIZER_INTERFACE_ATTRIBUTE
 uptr __sanitizer_update_counter_bitset_and_clear_counters(u8 *bitset) {
   return coverage_data.Update8bitCounterBitsetAndClearCounters(bitset);
 }
-// Default empty implementations (weak). Users should redefine them.
+// Default implementations record the operands in the per-thread comparison
+// tables. They are weak so that users can replace them.
+// SizeAndType is (operand size in bits) << 32 | (comparison predicate).
 SANITIZER_INTERFACE_ATTRIBUTE SANITIZER_WEAK_ATTRIBUTE
-void __sanitizer_cov_trace_cmp() {}
+void __sanitizer_cov_trace_cmp(u64 SizeAndType, u64 Arg1, u64 Arg2) {
+  TraceCmp(GET_CALLER_PC(), SizeAndType >> 32, (u32)SizeAndType, Arg1, Arg2);
+}
+// Cases[0] is the number of cases, Cases[1] is the size of Val in bits and
+// the case values follow. Only the case closest to Val is recorded, that is
+// the one a fuzzer is most likely to reach by mutating the input.
 SANITIZER_INTERFACE_ATTRIBUTE SANITIZER_WEAK_ATTRIBUTE
-void __sanitizer_cov_trace_switch() {}
+void __sanitizer_cov_trace_switch(u64 Val, u64 *Cases) {
+  u64 num_cases = Cases[0];
+  if (num_cases == 0)
+    return;
+  u64 closest = Cases[2];
+  u64 closest_distance = Val > closest ? Val - closest : closest - Val;
+  for (u64 i = 1; i < num_cases && closest_distance; i++) {
+    u64 c = Cases[i + 2];
+    u64 distance = Val > c ? Val - c : c - Val;
+    if (distance < closest_distance) {
+      closest = c;
+      closest_distance = distance;
+    }
+  }
+  TraceCmp(GET_CALLER_PC(), Cases[1], 0, Val, closest);
+}
+
+SANITIZER_INTERFACE_ATTRIBUTE
+uptr __sanitizer_get_cmp_trace(const CmpTraceEntry **entries) {
+#if SANITIZER_CAN_TRACE_CMP
+  *entries = cmp_trace_entries;
+  return cmp_trace_entries ? Min(cmp_trace_pos, kCmpTraceSize) : 0;
+#else
+  *entries = nullptr;
+  return 0;
+#endif
+}
+
+SANITIZER_INTERFACE_ATTRIBUTE
+void __sanitizer_reset_cmp_trace() {
+#if SANITIZER_CAN_TRACE_CMP
+  cmp_trace_pos = 0;
+#endif
+}
 } // extern "C"
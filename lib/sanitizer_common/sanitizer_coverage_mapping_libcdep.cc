@@ -72,13 +72,11 @@ void CovUpdateMapping(const char *coverage_dir, uptr caller_pc) {
   InternalScopedString text(kMaxTextSize);
 
   {
-    InternalScopedBuffer<LoadedModule> modules(kMaxNumberOfModules);
-    CHECK(modules.data());
-    int n_modules = GetListOfModules(modules.data(), kMaxNumberOfModules,
-                                     /* filter */ nullptr);
+    InternalMmapVector<LoadedModule> modules(/* initial_capacity */ 64);
+    GetListOfModules(&modules, /* filter */ nullptr);
 
     text.append("%d\n", sizeof(uptr) * 8);
-    for (int i = 0; i < n_modules; ++i) {
+    for (uptr i = 0; i < modules.size(); ++i) {
       const char *module_name = StripModuleName(modules[i].full_name());
       uptr base = modules[i].base_address();
       for (const auto &range : modules[i].ranges()) {
@@ -276,6 +276,14 @@ uptr internal_dup2(int oldfd, int newfd) {
 #endif
 }
 
+uptr internal_pipe(int fds[2]) {
+#if SANITIZER_USES_CANONICAL_LINUX_SYSCALLS
+  return internal_syscall(SYSCALL(pipe2), (uptr)fds, 0);
+#else
+  return internal_syscall(SYSCALL(pipe), (uptr)fds);
+#endif
+}
+
 uptr internal_readlink(const char *path, char *buf, uptr bufsize) {
 #if SANITIZER_USES_CANONICAL_LINUX_SYSCALLS
   return internal_syscall(SYSCALL(readlinkat), AT_FDCWD,
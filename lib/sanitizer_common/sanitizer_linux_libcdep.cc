@@ -33,6 +33,7 @@
 #include <link.h>
 #include <pthread.h>
 #include <signal.h>
+#include <stddef.h>
 #include <sys/resource.h>
 
 #if SANITIZER_FREEBSD
@@ -405,6 +406,7 @@ void GetThreadStackAndTls(bool main, uptr *stk_addr, uptr *stk_size,
 
 # if !SANITIZER_FREEBSD
 typedef ElfW(Phdr) Elf_Phdr;
+typedef ElfW(Nhdr) Elf_Nhdr;
 # elif SANITIZER_WORDSIZE == 32 && __FreeBSD_version <= 902001  // v9.2
 #  define Elf_Phdr XElf32_Phdr
 #  define dl_phdr_info xdl_phdr_info
@@ -419,6 +421,34 @@ struct DlIteratePhdrData {
   string_predicate_t filter;
 };
 
+#ifndef NT_GNU_BUILD_ID
+#define NT_GNU_BUILD_ID 3
+#endif
+
+// Looks for the NT_GNU_BUILD_ID note in a PT_NOTE segment.
+static void ReadBuildId(dl_phdr_info *info, const Elf_Phdr *phdr,
+                        LoadedModule *module) {
+  uptr align = phdr->p_align == 8 ? 8 : 4;
+  const char *note = (const char *)(info->dlpi_addr + phdr->p_vaddr);
+  uptr size = phdr->p_memsz;
+  while (size >= sizeof(Elf_Nhdr)) {
+    const Elf_Nhdr *nhdr = (const Elf_Nhdr *)note;
+    uptr name_size = RoundUpTo(nhdr->n_namesz, align);
+    uptr desc_size = RoundUpTo(nhdr->n_descsz, align);
+    uptr note_size = sizeof(Elf_Nhdr) + name_size + desc_size;
+    if (note_size > size)
+      return;
+    const char *name = note + sizeof(Elf_Nhdr);
+    if (nhdr->n_type == NT_GNU_BUILD_ID && nhdr->n_namesz == 4 &&
+        !internal_memcmp(name, "GNU", 4)) {
+      module->setBuildId((const u8 *)name + name_size, nhdr->n_descsz);
+      return;
+    }
+    note += note_size;
+    size -= note_size;
+  }
+}
+
 static int dl_iterate_phdr_cb(dl_phdr_info *info, size_t size, void *arg) {
   DlIteratePhdrData *data = (DlIteratePhdrData*)arg;
   if (data->current_n == data->max_n)
@@ -445,6 +475,8 @@ static int dl_iterate_phdr_cb(dl_phdr_info *info, size_t size, void *arg) {
       uptr cur_end = cur_beg + phdr->p_memsz;
       bool executable = phdr->p_flags & PF_X;
       cur_module->addAddressRange(cur_beg, cur_end, executable);
+    } else if (phdr->p_type == PT_NOTE && !cur_module->build_id()) {
+      ReadBuildId(info, phdr, cur_module);
     }
   }
   return 0;
@@ -473,6 +505,25 @@ uptr GetListOfModules(LoadedModule *modules, uptr max_modules,
   return data.current_n;
 }
 
+static int GetLoadedModulesStampCb(dl_phdr_info *info, size_t size,
+                                   void *arg) {
+  u64 *stamp = (u64 *)arg;
+  if (size >= offsetof(dl_phdr_info, dlpi_subs) + sizeof(info->dlpi_subs))
+    *stamp = info->dlpi_adds + info->dlpi_subs;
+  // The counters are the same for every module, stop after the first one.
+  return 1;
+}
+
+u64 GetLoadedModulesStamp() {
+#if SANITIZER_ANDROID
+  return 0;
+#else
+  u64 stamp = 0;
+  dl_iterate_phdr(GetLoadedModulesStampCb, &stamp);
+  return stamp;
+#endif
+}
+
 // getrusage does not give us the current RSS, only the max RSS.
 // Still, this is better than nothing if /proc/self/statm is not available
 // for some reason, e.g. due to a sandbox.
@@ -140,6 +140,10 @@ uptr internal_dup2(int oldfd, int newfd) {
   return dup2(oldfd, newfd);
 }
 
+uptr internal_pipe(int fds[2]) {
+  return pipe(fds);
+}
+
 uptr internal_readlink(const char *path, char *buf, uptr bufsize) {
   return readlink(path, buf, bufsize);
 }
@@ -367,6 +371,10 @@ uptr GetListOfModules(LoadedModule *modules, uptr max_modules,
   return memory_mapping.DumpListOfModules(modules, max_modules, filter);
 }
 
+u64 GetLoadedModulesStamp() {
+  return 0;
+}
+
 bool IsHandledDeadlySignal(int signum) {
   if ((SANITIZER_WATCHOS || SANITIZER_TVOS) && !(SANITIZER_IOSSIM))
     // Handling fatal signals on watchOS and tvOS devices is disallowed.
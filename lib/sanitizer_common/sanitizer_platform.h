@@ -151,6 +151,10 @@
 # define HAVE_TIRPC_RPC_XDR_H 0
 #endif
 
+// The comparison tables of -fsanitize-coverage=trace-cmp are found through
+// THREADLOCAL, which is not supported on Android.
+#define SANITIZER_CAN_TRACE_CMP (!SANITIZER_ANDROID)
+
 /// \macro MSC_PREREQ
 /// \brief Is the compiler MSVC of at least the specified version?
 /// The common \param version values to check for are:
@@ -14,6 +14,7 @@
 #include "sanitizer_stackdepot.h"
 
 #include "sanitizer_common.h"
+#include "sanitizer_flags.h"
 #include "sanitizer_stackdepotbase.h"
 
 namespace __sanitizer {
@@ -99,65 +100,214 @@ void StackDepotHandle::inc_use_count_unsafe() {
   CHECK_LT(prev + 1, StackDepotNode::kMaxUseCount);
 }
 
+// Compact depot layout (common_flags()->compact_stack_depot).
+// Stack traces of a program tend to share their outermost frames (main, event
+// loops, thread start routines). The compact depot cuts every trace into
+// segments of up to kSegmentSize frames, aligned at the outermost frame, and
+// stores each segment once, together with a pointer to the segment of frames
+// below it. The id of a trace is the id of its innermost segment.
+// Traces are only stored contiguously when they are retrieved by Get(), which
+// for most traces never happens. A trace retrieved once keeps its contiguous
+// copy (size * sizeof(uptr) bytes, counted in the depot stats) for the
+// lifetime of the process, so the memory saved shrinks as stacks are read
+// back, e.g. when many leaks or races are reported.
+struct CompactStackDepotNode {
+  CompactStackDepotNode *link;
+  u32 id;
+  u32 hash_bits;
+  CompactStackDepotNode *parent;  // Segment with the outer frames, if any.
+  u32 size;  // Number of frames in the whole trace, including the parents.
+  u32 tag;
+  atomic_uintptr_t trace;  // Whole trace, materialized on the first load().
+  uptr frames[1];  // [size - parent->size]
+
+  static const u32 kTabSizeLog = 20;
+  static const u32 kSegmentSize = 8;
+
+  // A segment of a trace to store, or a whole trace returned by load().
+  struct args_type {
+    const uptr *frames;
+    u32 num_frames;
+    u32 tag;
+    CompactStackDepotNode *parent;
+  };
+  typedef CompactStackDepotNode *handle_type;
+
+  u32 num_frames() const { return size - (parent ? parent->size : 0); }
+  bool eq(u32 hash, const args_type &args) const {
+    if (hash != hash_bits || args.parent != parent || args.tag != tag ||
+        args.num_frames != num_frames())
+      return false;
+    for (uptr i = 0; i < args.num_frames; i++) {
+      if (frames[i] != args.frames[i]) return false;
+    }
+    return true;
+  }
+  static uptr storage_size(const args_type &args) {
+    return sizeof(CompactStackDepotNode) +
+           (args.num_frames - 1) * sizeof(uptr);
+  }
+  static u32 hash(const args_type &args) {
+    // murmur2, seeded with the parent id.
+    const u32 m = 0x5bd1e995;
+    const u32 seed = 0x9747b28c ^ (args.parent ? args.parent->id : 0);
+    const u32 r = 24;
+    u32 h = seed ^ (args.num_frames * sizeof(uptr));
+    for (uptr i = 0; i < args.num_frames; i++) {
+      u32 k = args.frames[i];
+      k *= m;
+      k ^= k >> r;
+      k *= m;
+      h *= m;
+      h ^= k;
+    }
+    h ^= h >> 13;
+    h *= m;
+    h ^= h >> 15;
+    return h;
+  }
+  static bool is_valid(const args_type &args) {
+    return args.num_frames > 0 && args.frames;
+  }
+  void store(const args_type &args, u32 hash) {
+    hash_bits = hash;
+    parent = args.parent;
+    size = args.num_frames + (parent ? parent->size : 0);
+    tag = args.tag;
+    internal_memcpy(frames, args.frames, args.num_frames * sizeof(uptr));
+    if (!parent)
+      atomic_store(&trace, (uptr)frames, memory_order_relaxed);
+  }
+  args_type load();
+  handle_type get_handle() { return this; }
+};
+
+// Allocates the traces materialized by CompactStackDepotNode::load(). Unlike
+// PersistentAlloc() it never takes a lock, so StackDepotGet() may be called
+// from the StopTheWorld tracer or a forked child whatever the other threads
+// were doing when they were suspended.
+class TraceAllocator {
+ public:
+  uptr *alloc(uptr num_frames);
+
+ private:
+  struct Block {
+    atomic_uintptr_t pos;
+    uptr end;
+  };
+  static const uptr kBlockSize = 64 * 1024;
+  atomic_uintptr_t block_;  // Block *
+};
+
+uptr *TraceAllocator::alloc(uptr num_frames) {
+  uptr size = num_frames * sizeof(uptr);
+  for (;;) {
+    uptr cmp = atomic_load(&block_, memory_order_acquire);
+    if (Block *b = (Block *)cmp) {
+      uptr pos = atomic_load(&b->pos, memory_order_relaxed);
+      while (pos + size <= b->end) {
+        if (atomic_compare_exchange_weak(&b->pos, &pos, pos + size,
+                                         memory_order_relaxed))
+          return (uptr *)pos;
+      }
+    }
+    // The block is full. Map a new one, and drop it if another thread was
+    // faster.
+    uptr allocsz = Max(kBlockSize, sizeof(Block) + size);
+    Block *nb = (Block *)MmapOrDie(allocsz, "stack depot");
+    nb->end = (uptr)nb + allocsz;
+    atomic_store(&nb->pos, (uptr)(nb + 1), memory_order_relaxed);
+    if (!atomic_compare_exchange_strong(&block_, &cmp, (uptr)nb,
+                                        memory_order_acq_rel))
+      UnmapOrDie(nb, allocsz);
+  }
+}
+
+static TraceAllocator theTraceAllocator;
+
 // FIXME(dvyukov): this single reserved bit is used in TSan.
 typedef StackDepotBase<StackDepotNode, 1, StackDepotNode::kTabSizeLog>
     StackDepot;
 static StackDepot theDepot;
 
+typedef StackDepotBase<CompactStackDepotNode, 1,
+                       CompactStackDepotNode::kTabSizeLog> CompactStackDepot;
+static CompactStackDepot theCompactDepot;
+
+CompactStackDepotNode::args_type CompactStackDepotNode::load() {
+  uptr t = atomic_load(&trace, memory_order_acquire);
+  if (!t) {
+    uptr *buf = theTraceAllocator.alloc(size);
+    theCompactDepot.GetStats()->allocated += size * sizeof(uptr);
+    uptr pos = 0;
+    for (CompactStackDepotNode *s = this; s; s = s->parent) {
+      internal_memcpy(&buf[pos], s->frames, s->num_frames() * sizeof(uptr));
+      pos += s->num_frames();
+    }
+    CHECK_EQ(pos, size);
+    // If we race with another load(), the loser's buffer is wasted.
+    if (atomic_compare_exchange_strong(&trace, &t, (uptr)buf,
+                                       memory_order_acq_rel))
+      t = (uptr)buf;
+  }
+  args_type res = {(const uptr *)t, size, tag, nullptr};
+  return res;
+}
+
+static u32 CompactStackDepotPut(StackTrace stack) {
+  CompactStackDepotNode *node = nullptr;
+  for (u32 end = stack.size; end > 0;) {
+    u32 beg = end > CompactStackDepotNode::kSegmentSize
+                  ? end - CompactStackDepotNode::kSegmentSize
+                  : 0;
+    CompactStackDepotNode::args_type segment = {&stack.trace[beg], end - beg,
+                                                stack.tag, node};
+    node = theCompactDepot.Put(segment);
+    if (!node) return 0;
+    end = beg;
+  }
+  return node ? node->id : 0;
+}
+
 StackDepotStats *StackDepotGetStats() {
+  if (common_flags()->compact_stack_depot)
+    return theCompactDepot.GetStats();
   return theDepot.GetStats();
 }
 
 u32 StackDepotPut(StackTrace stack) {
+  if (common_flags()->compact_stack_depot)
+    return stack.trace ? CompactStackDepotPut(stack) : 0;
   StackDepotHandle h = theDepot.Put(stack);
   return h.valid() ? h.id() : 0;
 }
 
 StackDepotHandle StackDepotPut_WithHandle(StackTrace stack) {
+  // Compact depot nodes don't have use counts.
+  CHECK(!common_flags()->compact_stack_depot);
   return theDepot.Put(stack);
 }
 
 StackTrace StackDepotGet(u32 id) {
+  if (common_flags()->compact_stack_depot) {
+    CompactStackDepotNode::args_type trace = theCompactDepot.Get(id);
+    return StackTrace(trace.frames, trace.num_frames, trace.tag);
+  }
   return theDepot.Get(id);
 }
 
 void StackDepotLockAll() {
-  theDepot.LockAll();
+  if (common_flags()->compact_stack_depot)
+    theCompactDepot.LockAll();
+  else
+    theDepot.LockAll();
 }
 
 void StackDepotUnlockAll() {
-  theDepot.UnlockAll();
-}
-
-bool StackDepotReverseMap::IdDescPair::IdComparator(
-    const StackDepotReverseMap::IdDescPair &a,
-    const StackDepotReverseMap::IdDescPair &b) {
-  return a.id < b.id;
-}
-
-StackDepotReverseMap::StackDepotReverseMap()
-    : map_(StackDepotGetStats()->n_uniq_ids + 100) {
-  for (int idx = 0; idx < StackDepot::kTabSize; idx++) {
-    atomic_uintptr_t *p = &theDepot.tab[idx];
-    uptr v = atomic_load(p, memory_order_consume);
-    StackDepotNode *s = (StackDepotNode*)(v & ~1);
-    for (; s; s = s->link) {
-      IdDescPair pair = {s->id, s};
-      map_.push_back(pair);
-    }
-  }
-  InternalSort(&map_, map_.size(), IdDescPair::IdComparator);
-}
-
-StackTrace StackDepotReverseMap::Get(u32 id) {
-  if (!map_.size())
-    return StackTrace();
-  IdDescPair pair = {id, nullptr};
-  uptr idx = InternalBinarySearch(map_, 0, map_.size(), pair,
-                                  IdDescPair::IdComparator);
-  if (idx > map_.size())
-    return StackTrace();
-  return map_[idx].desc->load();
+  if (common_flags()->compact_stack_depot)
+    theCompactDepot.UnlockAll();
+  else
+    theDepot.UnlockAll();
 }
 
 } // namespace __sanitizer
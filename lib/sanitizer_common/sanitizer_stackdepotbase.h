@@ -40,6 +40,8 @@ class StackDepotBase {
   static Node *find(Node *s, args_type args, u32 hash);
   static Node *lock(atomic_uintptr_t *p);
   static void unlock(atomic_uintptr_t *p, Node *s);
+  atomic_uintptr_t *id_map_child(atomic_uintptr_t *p, uptr size, bool create);
+  atomic_uintptr_t *id_map_leaf(u32 id, bool create);
 
   static const int kTabSize = 1 << kTabSizeLog;  // Hash table size.
   static const int kPartBits = 8;
@@ -48,13 +50,24 @@ class StackDepotBase {
       1 << kPartBits;  // Number of subparts in the table.
   static const int kPartSize = kTabSize / kPartCount;
   static const int kMaxId = 1 << kPartShift;
+  // Ids are indexed by a three-level map: the top level is a small array
+  // covering the whole id space, the nodes below it and the leaves are
+  // allocated on demand. Since each part hands out ids sequentially, the
+  // nodes and leaves are densely populated.
+  static const int kIdMapLeafSizeLog = 10;
+  static const int kIdMapLeafSize = 1 << kIdMapLeafSizeLog;
+  static const int kIdMapNodeSizeLog = 9;
+  static const int kIdMapNodeSize = 1 << kIdMapNodeSizeLog;
+  static const int kIdMapSize =
+      1 << (sizeof(u32) * 8 - kReservedBits - kIdMapNodeSizeLog -
+            kIdMapLeafSizeLog);
 
   atomic_uintptr_t tab[kTabSize];   // Hash table of Node's.
   atomic_uint32_t seq[kPartCount];  // Unique id generators.
+  atomic_uintptr_t id_map[kIdMapSize];  // Id -> Node map, see above.
+  StaticSpinMutex id_map_mu;
 
   StackDepotStats stats;
-
-  friend class StackDepotReverseMap;
 };
 
 template <class Node, int kReservedBits, int kTabSizeLog>
@@ -93,6 +106,38 @@ void StackDepotBase<Node, kReservedBits, kTabSizeLog>::unlock(
   atomic_store(p, (uptr)s, memory_order_release);
 }
 
+template <class Node, int kReservedBits, int kTabSizeLog>
+atomic_uintptr_t *
+StackDepotBase<Node, kReservedBits, kTabSizeLog>::id_map_child(
+    atomic_uintptr_t *p, uptr size, bool create) {
+  uptr child = atomic_load(p, memory_order_acquire);
+  if (!child && create) {
+    SpinMutexLock l(&id_map_mu);
+    child = atomic_load(p, memory_order_relaxed);
+    if (!child) {
+      // PersistentAlloc returns fresh zeroed memory.
+      uptr memsz = size * sizeof(atomic_uintptr_t);
+      child = (uptr)PersistentAlloc(memsz);
+      stats.allocated += memsz;
+      atomic_store(p, child, memory_order_release);
+    }
+  }
+  return (atomic_uintptr_t *)child;
+}
+
+template <class Node, int kReservedBits, int kTabSizeLog>
+atomic_uintptr_t *
+StackDepotBase<Node, kReservedBits, kTabSizeLog>::id_map_leaf(u32 id,
+                                                              bool create) {
+  atomic_uintptr_t *node = id_map_child(
+      &id_map[id >> (kIdMapNodeSizeLog + kIdMapLeafSizeLog)], kIdMapNodeSize,
+      create);
+  if (!node)
+    return nullptr;
+  return id_map_child(&node[(id >> kIdMapLeafSizeLog) % kIdMapNodeSize],
+                      kIdMapLeafSize, create);
+}
+
 template <class Node, int kReservedBits, int kTabSizeLog>
 typename StackDepotBase<Node, kReservedBits, kTabSizeLog>::handle_type
 StackDepotBase<Node, kReservedBits, kTabSizeLog>::Put(args_type args,
@@ -128,6 +173,8 @@ StackDepotBase<Node, kReservedBits, kTabSizeLog>::Put(args_type args,
   s->id = id;
   s->store(args, h);
   s->link = s2;
+  atomic_store(&id_map_leaf(id, true)[id % kIdMapLeafSize], (uptr)s,
+               memory_order_release);
   unlock(p, s);
   if (inserted) *inserted = true;
   return s->get_handle();
@@ -140,21 +187,14 @@ StackDepotBase<Node, kReservedBits, kTabSizeLog>::Get(u32 id) {
     return args_type();
   }
   CHECK_EQ(id & (((u32)-1) >> kReservedBits), id);
-  // High kPartBits contain part id, so we need to scan at most kPartSize lists.
-  uptr part = id >> kPartShift;
-  for (int i = 0; i != kPartSize; i++) {
-    uptr idx = part * kPartSize + i;
-    CHECK_LT(idx, kTabSize);
-    atomic_uintptr_t *p = &tab[idx];
-    uptr v = atomic_load(p, memory_order_consume);
-    Node *s = (Node *)(v & ~1);
-    for (; s; s = s->link) {
-      if (s->id == id) {
-        return s->load();
-      }
-    }
-  }
-  return args_type();
+  atomic_uintptr_t *leaf = id_map_leaf(id, false);
+  if (!leaf)
+    return args_type();
+  Node *s = (Node *)atomic_load(&leaf[id % kIdMapLeafSize],
+                                memory_order_acquire);
+  if (!s)
+    return args_type();
+  return s->load();
 }
 
 template <class Node, int kReservedBits, int kTabSizeLog>
@@ -110,6 +110,23 @@ struct BufferedStackTrace : public StackTrace {
   void operator=(const BufferedStackTrace &);
 };
 
+#if (SANITIZER_FREEBSD || SANITIZER_LINUX) && !SANITIZER_ANDROID && \
+    defined(__x86_64__)
+# define SANITIZER_CAN_UNWIND_WITH_TABLE_CACHE 1
+#else
+# define SANITIZER_CAN_UNWIND_WITH_TABLE_CACHE 0
+#endif
+
+// Slow unwinders. Both store up to max_depth PCs into buffer, starting from a
+// PC in the function itself, and return the number of stored PCs.
+// UnwindWithTableCache() uses the runtime's own cache of the unwind tables of
+// the loaded modules, and returns 0 if some frame needs the generic unwinder.
+uptr UnwindWithTableCache(uptr *buffer, uptr max_depth);
+uptr UnwindWithLibgcc(uptr *buffer, uptr max_depth);
+// Tells UnwindWithTableCache() that shared libraries were loaded or unloaded.
+// It also checks the dl_iterate_phdr() load and unload counters by itself.
+void InvalidateUnwindTableCache();
+
 }  // namespace __sanitizer
 
 // Use this macro if you want to print stack trace with the caller
@@ -26,20 +26,30 @@ void StackTrace::Print() const {
   }
   InternalScopedString frame_desc(GetPageSizeCached() * 2);
   uptr frame_num = 0;
-  for (uptr i = 0; i < size && trace[i]; i++) {
-    // PCs in stack traces are actually the return addresses, that is,
-    // addresses of the next instructions after the call.
-    uptr pc = GetPreviousInstructionPc(trace[i]);
-    SymbolizedStack *frames = Symbolizer::GetOrInit()->SymbolizePC(pc);
-    CHECK(frames);
-    for (SymbolizedStack *cur = frames; cur; cur = cur->next) {
-      frame_desc.clear();
-      RenderFrame(&frame_desc, common_flags()->stack_trace_format, frame_num++,
-                  cur->info, common_flags()->symbolize_vs_style,
-                  common_flags()->strip_path_prefix);
-      Printf("%s\n", frame_desc.data());
+  // Symbolize the frames in batches. This may run on a signal stack, so keep
+  // the batches off the stack.
+  const uptr kBatchSize = 64;
+  InternalScopedBuffer<uptr> pcs(kBatchSize);
+  InternalScopedBuffer<SymbolizedStack *> symbolized(kBatchSize);
+  for (uptr first = 0, n = 0; first < size && trace[first]; first += n) {
+    for (n = 0; n < kBatchSize && first + n < size && trace[first + n]; n++) {
+      // PCs in stack traces are actually the return addresses, that is,
+      // addresses of the next instructions after the call.
+      pcs[n] = GetPreviousInstructionPc(trace[first + n]);
+    }
+    Symbolizer::GetOrInit()->SymbolizePCs(pcs.data(), n, symbolized.data());
+    for (uptr i = 0; i < n; i++) {
+      SymbolizedStack *frames = symbolized[i];
+      CHECK(frames);
+      for (SymbolizedStack *cur = frames; cur; cur = cur->next) {
+        frame_desc.clear();
+        RenderFrame(&frame_desc, common_flags()->stack_trace_format,
+                    frame_num++, cur->info, common_flags()->symbolize_vs_style,
+                    common_flags()->strip_path_prefix);
+        Printf("%s\n", frame_desc.data());
+      }
+      frames->ClearAll();
     }
-    frames->ClearAll();
   }
   // Always print a trailing empty line after stack trace.
   Printf("\n");
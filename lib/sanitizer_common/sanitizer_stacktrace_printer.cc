@@ -13,6 +13,8 @@
 
 #include "sanitizer_stacktrace_printer.h"
 
+#include "sanitizer_flags.h"
+
 namespace __sanitizer {
 
 static const char *StripFunctionName(const char *function, const char *prefix) {
@@ -25,12 +27,15 @@ static const char *StripFunctionName(const char *function, const char *prefix) {
 }
 
 static const char kDefaultFormat[] = "    #%n %p %F %L";
+// Module+offset records for symbolize_offline=1.
+static const char kOfflineFormat[] = "    #%n %p %L %B";
 
 void RenderFrame(InternalScopedString *buffer, const char *format, int frame_no,
                  const AddressInfo &info, bool vs_style,
                  const char *strip_path_prefix, const char *strip_func_prefix) {
   if (0 == internal_strcmp(format, "DEFAULT"))
-    format = kDefaultFormat;
+    format = common_flags()->symbolize_offline ? kOfflineFormat
+                                               : kDefaultFormat;
   for (const char *p = format; *p != '\0'; p++) {
     if (*p != '%') {
       buffer->append("%c", *p);
@@ -54,6 +59,10 @@ void RenderFrame(InternalScopedString *buffer, const char *format, int frame_no,
     case 'o':
       buffer->append("0x%zx", info.module_offset);
       break;
+    case 'b':
+      if (info.module_build_id)
+        buffer->append("%s", info.module_build_id);
+      break;
     case 'f':
       buffer->append("%s", StripFunctionName(info.function, strip_func_prefix));
       break;
@@ -108,6 +117,11 @@ void RenderFrame(InternalScopedString *buffer, const char *format, int frame_no,
       else
         buffer->append("(%p)", (void *)info.address);
       break;
+    case 'B':
+      // Module build ID, if it is known.
+      if (info.module_build_id)
+        buffer->append("(BuildId: %s)", info.module_build_id);
+      break;
     default:
       Report("Unsupported specifier in stack frame format: %c (0x%zx)!\n", *p,
              *p);
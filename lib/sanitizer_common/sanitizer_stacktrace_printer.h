@@ -35,6 +35,7 @@ namespace __sanitizer {
 //   %p - PC in hex format;
 //   %m - path to module (binary or shared object);
 //   %o - offset in the module in hex format;
+//   %b - build ID of the module in hex format (*if available*);
 //   %f - function name;
 //   %q - offset in the function in hex format (*if available*);
 //   %s - path to source file;
@@ -47,6 +48,7 @@ namespace __sanitizer {
 //   %L - prints location information: file/line/column, if it is known, or
 //        module+offset if it is known, or (<unknown module>) string.
 //   %M - prints module basename and offset, if it is known, or PC.
+//   %B - prints "(BuildId: <build ID>)", if the build ID is known.
 void RenderFrame(InternalScopedString *buffer, const char *format, int frame_no,
                  const AddressInfo &info, bool vs_style,
                  const char *strip_path_prefix = "",
@@ -91,12 +91,19 @@ struct TracerThreadArgument {
   uptr parent_pid;
 };
 
+// These may be missing from older system headers.
+static const int kPtraceSeize = 0x4206;
+static const int kPtraceInterrupt = 0x4207;
+static const int kPtraceEventStop = 128;
+
 // This class handles thread suspending/unsuspending in the tracer thread.
 class ThreadSuspender {
  public:
   explicit ThreadSuspender(pid_t pid, TracerThreadArgument *arg)
     : arg(arg)
-    , pid_(pid) {
+    , pid_(pid)
+    , use_seize_(true)
+    , attached_(kMaxThreadID / 8) {
       CHECK_GE(pid, 0);
     }
   bool SuspendAllThreads();
@@ -109,54 +116,100 @@ class ThreadSuspender {
  private:
   SuspendedThreadsList suspended_threads_list_;
   pid_t pid_;
-  bool SuspendThread(SuspendedThreadID thread_id);
+  // Whether the kernel supports PTRACE_SEIZE (Linux 3.4+).
+  bool use_seize_;
+  // Thread IDs we have attached to, as a bitmap indexed by thread ID. Thread
+  // IDs are bounded by pid_max, which can't exceed kMaxThreadID on Linux.
+  // Freshly mmapped memory is zeroed, and we only touch the pages we need.
+  static const uptr kMaxThreadID = 1 << 22;
+  InternalScopedBuffer<u8> attached_;
+  bool IsAttached(SuspendedThreadID tid);
+  void SetAttached(SuspendedThreadID tid);
+  bool AttachToThread(SuspendedThreadID tid);
+  bool WaitForThreadToStop(SuspendedThreadID tid);
 };
 
-bool ThreadSuspender::SuspendThread(SuspendedThreadID tid) {
-  // Are we already attached to this thread?
-  // Currently this check takes linear time, however the number of threads is
-  // usually small.
-  if (suspended_threads_list_.Contains(tid))
-    return false;
+// Checking the bitmap instead of suspended_threads_list_.Contains() keeps
+// SuspendAllThreads() linear in the number of threads.
+bool ThreadSuspender::IsAttached(SuspendedThreadID tid) {
+  if ((uptr)tid >= kMaxThreadID)
+    return suspended_threads_list_.Contains(tid);
+  return attached_[tid / 8] & (1 << (tid % 8));
+}
+
+void ThreadSuspender::SetAttached(SuspendedThreadID tid) {
+  if ((uptr)tid < kMaxThreadID)
+    attached_[tid / 8] |= 1 << (tid % 8);
+}
+
+// PTRACE_ATTACH stops the thread by sending it SIGSTOP, which the kernel
+// delivers with group-stop bookkeeping over the whole thread group, so
+// attaching to N threads this way takes O(N^2) time. PTRACE_SEIZE followed by
+// PTRACE_INTERRUPT stops just the target thread and doesn't send any signals.
+bool ThreadSuspender::AttachToThread(SuspendedThreadID tid) {
   int pterrno;
+  if (use_seize_) {
+    if (!internal_iserror(
+            internal_ptrace(kPtraceSeize, tid, nullptr, nullptr), &pterrno)) {
+      if (!internal_iserror(
+              internal_ptrace(kPtraceInterrupt, tid, nullptr, nullptr),
+              &pterrno)) {
+        VReport(2, "Attached to thread %d.\n", tid);
+        return true;
+      }
+      VReport(1, "Could not interrupt thread %d (errno %d).\n", tid, pterrno);
+      internal_ptrace(PTRACE_DETACH, tid, nullptr, nullptr);
+      return false;
+    }
+    // Older kernels reject unknown requests with EIO.
+    if (pterrno != EIO) {
+      VReport(1, "Could not attach to thread %d (errno %d).\n", tid, pterrno);
+      return false;
+    }
+    use_seize_ = false;
+  }
   if (internal_iserror(internal_ptrace(PTRACE_ATTACH, tid, nullptr, nullptr),
                        &pterrno)) {
     // Either the thread is dead, or something prevented us from attaching.
     // Log this event and move on.
     VReport(1, "Could not attach to thread %d (errno %d).\n", tid, pterrno);
     return false;
-  } else {
-    VReport(2, "Attached to thread %d.\n", tid);
-    // The thread is not guaranteed to stop before ptrace returns, so we must
-    // wait on it. Note: if the thread receives a signal concurrently,
-    // we can get notification about the signal before notification about stop.
-    // In such case we need to forward the signal to the thread, otherwise
-    // the signal will be missed (as we do PTRACE_DETACH with arg=0) and
-    // any logic relying on signals will break. After forwarding we need to
-    // continue to wait for stopping, because the thread is not stopped yet.
-    // We do ignore delivery of SIGSTOP, because we want to make stop-the-world
-    // as invisible as possible.
-    for (;;) {
-      int status;
-      uptr waitpid_status;
-      HANDLE_EINTR(waitpid_status, internal_waitpid(tid, &status, __WALL));
-      int wperrno;
-      if (internal_iserror(waitpid_status, &wperrno)) {
-        // Got a ECHILD error. I don't think this situation is possible, but it
-        // doesn't hurt to report it.
-        VReport(1, "Waiting on thread %d failed, detaching (errno %d).\n",
-                tid, wperrno);
-        internal_ptrace(PTRACE_DETACH, tid, nullptr, nullptr);
-        return false;
-      }
-      if (WIFSTOPPED(status) && WSTOPSIG(status) != SIGSTOP) {
-        internal_ptrace(PTRACE_CONT, tid, nullptr,
-                        (void*)(uptr)WSTOPSIG(status));
-        continue;
-      }
-      break;
+  }
+  VReport(2, "Attached to thread %d.\n", tid);
+  return true;
+}
+
+bool ThreadSuspender::WaitForThreadToStop(SuspendedThreadID tid) {
+  // The thread is not guaranteed to stop before ptrace returns, so we must
+  // wait on it. Note: if the thread receives a signal concurrently,
+  // we can get notification about the signal before notification about stop.
+  // In such case we need to forward the signal to the thread, otherwise
+  // the signal will be missed (as we do PTRACE_DETACH with arg=0) and
+  // any logic relying on signals will break. After forwarding we need to
+  // continue to wait for stopping, because the thread is not stopped yet.
+  // We do ignore delivery of SIGSTOP, because we want to make stop-the-world
+  // as invisible as possible. Threads attached with PTRACE_SEIZE don't get
+  // a SIGSTOP and report PTRACE_EVENT_STOP instead.
+  for (;;) {
+    int status;
+    uptr waitpid_status;
+    HANDLE_EINTR(waitpid_status, internal_waitpid(tid, &status, __WALL));
+    int wperrno;
+    if (internal_iserror(waitpid_status, &wperrno)) {
+      // Got a ECHILD error. I don't think this situation is possible, but it
+      // doesn't hurt to report it.
+      VReport(1, "Waiting on thread %d failed, detaching (errno %d).\n",
+              tid, wperrno);
+      internal_ptrace(PTRACE_DETACH, tid, nullptr, nullptr);
+      return false;
+    }
+    bool stopped_by_us = use_seize_ ? (status >> 16) == kPtraceEventStop
+                                    : WSTOPSIG(status) == SIGSTOP;
+    if (WIFSTOPPED(status) && !stopped_by_us) {
+      internal_ptrace(PTRACE_CONT, tid, nullptr,
+                      (void*)(uptr)WSTOPSIG(status));
+      continue;
     }
-    suspended_threads_list_.Append(tid);
     return true;
   }
 }
@@ -183,18 +236,31 @@ void ThreadSuspender::KillAllThreads() {
                     nullptr, nullptr);
 }
 
+// Attaching to a thread only requests a stop, so in each pass over the thread
+// list we first attach to all new threads and then wait for them. This way the
+// threads stop in parallel, and a pass takes roughly as long as the slowest
+// thread takes to stop, rather than the sum of all of them.
 bool ThreadSuspender::SuspendAllThreads() {
   ThreadLister thread_lister(pid_);
+  InternalMmapVector<pid_t> pending(1);
   bool added_threads;
   do {
     // Run through the directory entries once.
     added_threads = false;
+    pending.clear();
     pid_t tid = thread_lister.GetNextTID();
     while (tid >= 0) {
-      if (SuspendThread(tid))
-        added_threads = true;
+      if (!IsAttached(tid) && AttachToThread(tid))
+        pending.push_back(tid);
       tid = thread_lister.GetNextTID();
     }
+    for (uptr i = 0; i < pending.size(); i++) {
+      if (WaitForThreadToStop(pending[i])) {
+        suspended_threads_list_.Append(pending[i]);
+        SetAttached(pending[i]);
+        added_threads = true;
+      }
+    }
     if (thread_lister.error()) {
       // Detach threads and fail.
       ResumeAllThreads();
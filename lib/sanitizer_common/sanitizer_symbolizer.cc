@@ -12,6 +12,7 @@
 //===----------------------------------------------------------------------===//
 
 #include "sanitizer_allocator_internal.h"
+#include "sanitizer_flags.h"
 #include "sanitizer_platform.h"
 #include "sanitizer_internal_defs.h"
 #include "sanitizer_libc.h"
@@ -27,15 +28,19 @@ AddressInfo::AddressInfo() {
 
 void AddressInfo::Clear() {
   InternalFree(module);
+  InternalFree(module_build_id);
   InternalFree(function);
   InternalFree(file);
   internal_memset(this, 0, sizeof(AddressInfo));
   function_offset = kUnknown;
 }
 
-void AddressInfo::FillModuleInfo(const char *mod_name, uptr mod_offset) {
+void AddressInfo::FillModuleInfo(const char *mod_name, uptr mod_offset,
+                                 const char *mod_build_id) {
   module = internal_strdup(mod_name);
   module_offset = mod_offset;
+  if (mod_build_id)
+    module_build_id = internal_strdup(mod_build_id);
 }
 
 SymbolizedStack::SymbolizedStack() : next(nullptr), info() {}
@@ -67,6 +72,11 @@ void DataInfo::Clear() {
 Symbolizer *Symbolizer::symbolizer_;
 StaticSpinMutex Symbolizer::init_mu_;
 LowLevelAllocator Symbolizer::symbolizer_allocator_;
+atomic_uint32_t Symbolizer::modules_generation_;
+
+void Symbolizer::InvalidateModuleList() {
+  atomic_fetch_add(&modules_generation_, 1, memory_order_relaxed);
+}
 
 void Symbolizer::AddHooks(Symbolizer::StartSymbolizationHook start_hook,
                           Symbolizer::EndSymbolizationHook end_hook) {
@@ -95,8 +105,207 @@ const char *Symbolizer::ModuleNameOwner::GetOwnedCopy(const char *str) {
   return last_match_;
 }
 
+static char *DupOrNull(const char *str) {
+  return str ? internal_strdup(str) : nullptr;
+}
+
+static void CopyAddressInfo(const AddressInfo &src, AddressInfo *dst) {
+  *dst = src;
+  dst->module = DupOrNull(src.module);
+  dst->module_build_id = DupOrNull(src.module_build_id);
+  dst->function = DupOrNull(src.function);
+  dst->file = DupOrNull(src.file);
+}
+
+static SymbolizedStack *CopySymbolizedStack(const SymbolizedStack *stack) {
+  SymbolizedStack *res = nullptr;
+  SymbolizedStack *last = nullptr;
+  for (; stack; stack = stack->next) {
+    SymbolizedStack *cur = SymbolizedStack::New(stack->info.address);
+    CopyAddressInfo(stack->info, &cur->info);
+    if (last)
+      last->next = cur;
+    else
+      res = cur;
+    last = cur;
+  }
+  return res;
+}
+
+static void CopyDataInfo(const DataInfo &src, DataInfo *dst) {
+  *dst = src;
+  dst->module = DupOrNull(src.module);
+  dst->name = DupOrNull(src.name);
+}
+
+bool Symbolizer::ResultCache::Init() {
+  if (entries_)
+    return true;
+  int capacity = common_flags()->symbolize_cache_size;
+  if (capacity <= 0)
+    return false;
+  capacity_ = capacity;
+  n_buckets_ = RoundUpToPowerOfTwo(capacity_);
+  entries_ = (Entry *)MmapOrDie(capacity_ * sizeof(Entry), "SymbolizerCache");
+  buckets_ = (u32 *)MmapOrDie(n_buckets_ * sizeof(u32), "SymbolizerCache");
+  for (u32 i = 0; i < n_buckets_; i++)
+    buckets_[i] = kNone;
+  // Initially all entries are free.
+  for (u32 i = 0; i < capacity_; i++)
+    entries_[i].hash_next = i + 1 < capacity_ ? i + 1 : kNone;
+  free_list_ = 0;
+  return true;
+}
+
+u32 Symbolizer::ResultCache::Bucket(const LoadedModule *module, uptr offset,
+                                    bool is_data) const {
+  u64 h = ((u64)(uptr)module ^ (u64)offset * 0x9e3779b97f4a7c15ULL) + is_data;
+  h ^= h >> 29;
+  return (u32)h & (n_buckets_ - 1);
+}
+
+u32 Symbolizer::ResultCache::Lookup(const LoadedModule *module, uptr offset,
+                                    bool is_data) const {
+  for (u32 i = buckets_[Bucket(module, offset, is_data)]; i != kNone;
+       i = entries_[i].hash_next) {
+    const Entry *e = &entries_[i];
+    if (e->module == module && e->offset == offset && e->is_data == is_data)
+      return i;
+  }
+  return kNone;
+}
+
+Symbolizer::ResultCache::Entry *Symbolizer::ResultCache::Find(
+    const LoadedModule *module, uptr offset, bool is_data) {
+  mu_->CheckLocked();
+  if (!Init())
+    return nullptr;
+  u32 idx = Lookup(module, offset, is_data);
+  if (idx == kNone) {
+    misses_++;
+    return nullptr;
+  }
+  hits_++;
+  LruUnlink(idx);
+  LruPushFront(idx);
+  return &entries_[idx];
+}
+
+void Symbolizer::ResultCache::LruUnlink(u32 idx) {
+  Entry *e = &entries_[idx];
+  if (e->lru_prev != kNone)
+    entries_[e->lru_prev].lru_next = e->lru_next;
+  else
+    lru_head_ = e->lru_next;
+  if (e->lru_next != kNone)
+    entries_[e->lru_next].lru_prev = e->lru_prev;
+  else
+    lru_tail_ = e->lru_prev;
+}
+
+void Symbolizer::ResultCache::LruPushFront(u32 idx) {
+  Entry *e = &entries_[idx];
+  e->lru_prev = kNone;
+  e->lru_next = lru_head_;
+  if (lru_head_ != kNone)
+    entries_[lru_head_].lru_prev = idx;
+  else
+    lru_tail_ = idx;
+  lru_head_ = idx;
+}
+
+// Removes the entry from the hash table and the LRU list, and frees it.
+void Symbolizer::ResultCache::Evict(u32 idx) {
+  Entry *e = &entries_[idx];
+  u32 *link = &buckets_[Bucket(e->module, e->offset, e->is_data)];
+  while (*link != idx)
+    link = &entries_[*link].hash_next;
+  *link = e->hash_next;
+  LruUnlink(idx);
+  if (e->is_data)
+    e->data.Clear();
+  else
+    e->stack->ClearAll();
+  e->hash_next = free_list_;
+  free_list_ = idx;
+  size_--;
+}
+
+Symbolizer::ResultCache::Entry *Symbolizer::ResultCache::Insert(
+    const LoadedModule *module, uptr offset, bool is_data) {
+  mu_->CheckLocked();
+  if (!Init())
+    return nullptr;
+  // The same address may be symbolized twice in one SymbolizePCs() batch.
+  u32 existing = Lookup(module, offset, is_data);
+  if (existing != kNone)
+    Evict(existing);
+  if (free_list_ == kNone) {
+    Evict(lru_tail_);
+    evictions_++;
+  }
+  u32 idx = free_list_;
+  Entry *e = &entries_[idx];
+  free_list_ = e->hash_next;
+  e->module = module;
+  e->offset = offset;
+  e->is_data = is_data;
+  e->stack = nullptr;
+  internal_memset(&e->data, 0, sizeof(e->data));
+  u32 *bucket = &buckets_[Bucket(module, offset, is_data)];
+  e->hash_next = *bucket;
+  *bucket = idx;
+  LruPushFront(idx);
+  size_++;
+  return e;
+}
+
+SymbolizedStack *Symbolizer::ResultCache::GetPC(const LoadedModule *module,
+                                                uptr offset) {
+  Entry *e = Find(module, offset, /*is_data*/ false);
+  return e ? CopySymbolizedStack(e->stack) : nullptr;
+}
+
+bool Symbolizer::ResultCache::GetData(const LoadedModule *module, uptr offset,
+                                      DataInfo *info) {
+  Entry *e = Find(module, offset, /*is_data*/ true);
+  if (!e)
+    return false;
+  info->Clear();
+  CopyDataInfo(e->data, info);
+  return true;
+}
+
+void Symbolizer::ResultCache::AddPC(const LoadedModule *module, uptr offset,
+                                    const SymbolizedStack *stack) {
+  if (Entry *e = Insert(module, offset, /*is_data*/ false))
+    e->stack = CopySymbolizedStack(stack);
+}
+
+void Symbolizer::ResultCache::AddData(const LoadedModule *module, uptr offset,
+                                      const DataInfo &info) {
+  if (Entry *e = Insert(module, offset, /*is_data*/ true))
+    CopyDataInfo(info, &e->data);
+}
+
+void Symbolizer::ResultCache::Clear() {
+  mu_->CheckLocked();
+  while (lru_head_ != kNone)
+    Evict(lru_head_);
+}
+
+void Symbolizer::ResultCache::GetStats(SymbolizerCacheStats *stats) const {
+  mu_->CheckLocked();
+  stats->hits = hits_;
+  stats->misses = misses_;
+  stats->evictions = evictions_;
+  stats->size = size_;
+}
+
 Symbolizer::Symbolizer(IntrusiveList<SymbolizerTool> tools)
-    : module_names_(&mu_), n_modules_(0), modules_fresh_(false), tools_(tools),
+    : module_names_(&mu_), cache_(&mu_), modules_(kInitialModulesCapacity),
+      module_ranges_(kInitialModulesCapacity), modules_loaded_generation_(0),
+      modules_loaded_stamp_(0), modules_loaded_(false), tools_(tools),
       start_hook_(0), end_hook_(0) {}
 
 Symbolizer::SymbolizerScope::SymbolizerScope(const Symbolizer *sym)
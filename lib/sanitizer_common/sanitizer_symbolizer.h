@@ -19,6 +19,7 @@
 #ifndef SANITIZER_SYMBOLIZER_H
 #define SANITIZER_SYMBOLIZER_H
 
+#include "sanitizer_atomic.h"
 #include "sanitizer_common.h"
 #include "sanitizer_mutex.h"
 
@@ -31,6 +32,7 @@ struct AddressInfo {
 
   char *module;
   uptr module_offset;
+  char *module_build_id;  // In hex, may be nullptr.
 
   static const uptr kUnknown = ~(uptr)0;
   char *function;
@@ -43,7 +45,8 @@ struct AddressInfo {
   AddressInfo();
   // Deletes all strings and resets all fields.
   void Clear();
-  void FillModuleInfo(const char *mod_name, uptr mod_offset);
+  void FillModuleInfo(const char *mod_name, uptr mod_offset,
+                      const char *mod_build_id = nullptr);
 };
 
 // Linked list of symbolized frames (each frame is described by AddressInfo).
@@ -73,6 +76,14 @@ struct DataInfo {
   void Clear();
 };
 
+struct SymbolizerCacheStats {
+  uptr hits;
+  uptr misses;
+  uptr evictions;
+  // Number of results currently cached.
+  uptr size;
+};
+
 class SymbolizerTool;
 
 class Symbolizer final {
@@ -83,6 +94,10 @@ class Symbolizer final {
   // Returns a list of symbolized frames for a given address (containing
   // all inlined functions, if necessary).
   SymbolizedStack *SymbolizePC(uptr address);
+  // Same as SymbolizePC() for |count| addresses, but sends them to the
+  // symbolizer tools in batches. Fills results[i] for addresses[i].
+  void SymbolizePCs(const uptr *addresses, uptr count,
+                    SymbolizedStack **results);
   bool SymbolizeData(uptr address, DataInfo *info);
 
   // The module names Symbolizer returns are stable and unique for every given
@@ -99,6 +114,7 @@ class Symbolizer final {
 
   // Release internal caches (if any).
   void Flush();
+  void GetCacheStats(SymbolizerCacheStats *stats);
   // Attempts to demangle the provided C++ mangled name.
   const char *Demangle(const char *name);
   void PrepareForSandboxing();
@@ -114,6 +130,10 @@ class Symbolizer final {
                 EndSymbolizationHook end_hook);
 
   LoadedModule *FindModuleForAddress(uptr address);
+  // Marks the list of loaded modules as stale, so that it is refreshed before
+  // the next address lookup. Called from the dlopen()/dlclose() interceptors,
+  // doesn't lock and doesn't require the symbolizer to be initialized.
+  static void InvalidateModuleList();
 
  private:
   // GetModuleNameAndOffsetForPC has to return a string to the caller.
@@ -136,15 +156,106 @@ class Symbolizer final {
     BlockingMutex *mu_;
   } module_names_;
 
+  // Bounded LRU cache of the results of SymbolizePC() and SymbolizeData(),
+  // keyed by module and module offset. Only the addresses which some tool
+  // managed to symbolize are cached, so that a failure (e.g. a crashed
+  // external symbolizer) is retried next time. The cache owns deep copies of
+  // the results and hands out copies, which the callers own as usual. It is
+  // cleared when a module is unloaded. ResultCache does not
+  // provide any synchronization, calls to its methods should be protected by
+  // |mu_|.
+  class ResultCache {
+   public:
+    explicit ResultCache(BlockingMutex *synchronized_by)
+        : entries_(nullptr), buckets_(nullptr), capacity_(0), n_buckets_(0),
+          size_(0),
+          lru_head_(kNone), lru_tail_(kNone), free_list_(kNone), hits_(0),
+          misses_(0), evictions_(0), mu_(synchronized_by) {}
+    // Return a copy of the cached result or nullptr/false on a miss.
+    SymbolizedStack *GetPC(const LoadedModule *module, uptr offset);
+    bool GetData(const LoadedModule *module, uptr offset, DataInfo *info);
+    void AddPC(const LoadedModule *module, uptr offset,
+               const SymbolizedStack *stack);
+    void AddData(const LoadedModule *module, uptr offset,
+                 const DataInfo &info);
+    void Clear();
+    void GetStats(SymbolizerCacheStats *stats) const;
+
+   private:
+    static const u32 kNone = ~(u32)0;
+    struct Entry {
+      const LoadedModule *module;
+      uptr offset;
+      bool is_data;
+      SymbolizedStack *stack;
+      DataInfo data;
+      u32 hash_next;
+      u32 lru_prev;
+      u32 lru_next;
+    };
+
+    bool Init();
+    u32 Bucket(const LoadedModule *module, uptr offset, bool is_data) const;
+    u32 Lookup(const LoadedModule *module, uptr offset, bool is_data) const;
+    Entry *Find(const LoadedModule *module, uptr offset, bool is_data);
+    Entry *Insert(const LoadedModule *module, uptr offset, bool is_data);
+    void LruUnlink(u32 idx);
+    void LruPushFront(u32 idx);
+    void Evict(u32 idx);
+
+    Entry *entries_;
+    u32 *buckets_;
+    u32 capacity_;
+    u32 n_buckets_;
+    u32 size_;
+    u32 lru_head_;  // Most recently used.
+    u32 lru_tail_;
+    u32 free_list_;
+    uptr hits_;
+    uptr misses_;
+    uptr evictions_;
+
+    BlockingMutex *mu_;
+  } cache_;
+
   /// Platform-specific function for creating a Symbolizer object.
   static Symbolizer *PlatformInit();
 
+  // SymbolizePCs() hands this many addresses at a time to the tools.
+  static const uptr kMaxBatchSize = 64;
+  void SymbolizePCsLocked(const uptr *addresses, uptr count,
+                          SymbolizedStack **results);
+  // Stacks of the current batch which are not in the cache, and their
+  // modules. Used by SymbolizePCsLocked(), and kept here rather than on the
+  // stack, which may be a small signal stack.
+  SymbolizedStack *pending_[kMaxBatchSize];
+  LoadedModule *pending_modules_[kMaxBatchSize];
+  bool pending_symbolized_[kMaxBatchSize];
+
   bool FindModuleNameAndOffsetForAddress(uptr address, const char **module_name,
                                          uptr *module_offset);
-  LoadedModule modules_[kMaxNumberOfModules];
-  uptr n_modules_;
-  // If stale, need to reload the modules before looking up addresses.
-  bool modules_fresh_;
+  static const uptr kInitialModulesCapacity = 128;
+  void RefreshModules();
+  LoadedModule *LookupModule(uptr address) const;
+
+  // Loaded modules, sorted by base address. A module that stays loaded keeps
+  // its LoadedModule object across refreshes, so that the cached results for
+  // it remain valid.
+  InternalMmapVector<LoadedModule *> modules_;
+  struct ModuleRange {
+    uptr beg;
+    uptr end;
+    LoadedModule *module;
+  };
+  // Address ranges of all modules, sorted by start address.
+  InternalMmapVector<ModuleRange> module_ranges_;
+  // Value of modules_generation_ and of GetLoadedModulesStamp() at the last
+  // refresh.
+  u32 modules_loaded_generation_;
+  u64 modules_loaded_stamp_;
+  bool modules_loaded_;
+  // Incremented by InvalidateModuleList().
+  static atomic_uint32_t modules_generation_;
 
   // Platform-specific default demangler, must not return nullptr.
   const char *PlatformDemangle(const char *name);
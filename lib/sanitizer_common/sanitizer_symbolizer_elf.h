@@ -0,0 +1,70 @@
+//===-- sanitizer_symbolizer_elf.h ------------------------------*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file is shared between various sanitizers' runtime libraries.
+//
+// Header for the in-process symbolizer that reads ELF symbol tables.
+//===----------------------------------------------------------------------===//
+
+#ifndef SANITIZER_SYMBOLIZER_ELF_H
+#define SANITIZER_SYMBOLIZER_ELF_H
+
+#include "sanitizer_platform.h"
+#if SANITIZER_LINUX || SANITIZER_FREEBSD
+
+#include "sanitizer_symbolizer_internal.h"
+
+namespace __sanitizer {
+
+// Symbolizes addresses using the .symtab (or, for stripped modules, the
+// .dynsym) section of the module file. Only function and global names are
+// provided, without file/line information, but no external process is
+// involved. The symbol table of a module is read and indexed when the module
+// is first seen.
+class ElfSymbolizer : public SymbolizerTool {
+ public:
+  ElfSymbolizer() : modules_(kInitialCapacity), last_module_(nullptr) {}
+
+  bool SymbolizePC(uptr addr, SymbolizedStack *stack) override;
+  bool SymbolizeData(uptr addr, DataInfo *info) override;
+  void Flush() override;
+
+ private:
+  struct Symbol {
+    uptr addr;
+    uptr size;
+    const char *name;       // Points into the mapped file.
+    const char *demangled;  // Lazily computed, leaked.
+  };
+
+  struct ModuleSymbols {
+    char *module_name;  // Owned.
+    void *file;         // The mapped file, nullptr if it couldn't be read.
+    uptr file_size;
+    InternalMmapVectorNoCtor<Symbol> functions;  // Sorted by address.
+    InternalMmapVectorNoCtor<Symbol> objects;    // Sorted by address.
+  };
+
+  static const uptr kInitialCapacity = 64;
+
+  ModuleSymbols *GetModuleSymbols(const char *module_name);
+  static void LoadSymbols(ModuleSymbols *module);
+  static Symbol *FindSymbol(InternalMmapVectorNoCtor<Symbol> *symbols,
+                            uptr offset);
+  static const char *GetDemangledName(Symbol *symbol);
+
+  InternalMmapVector<ModuleSymbols *> modules_;
+  ModuleSymbols *last_module_;
+};
+
+}  // namespace __sanitizer
+
+#endif  // SANITIZER_LINUX || SANITIZER_FREEBSD
+
+#endif  // SANITIZER_SYMBOLIZER_ELF_H
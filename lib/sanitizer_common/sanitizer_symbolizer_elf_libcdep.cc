@@ -0,0 +1,222 @@
+//===-- sanitizer_symbolizer_elf_libcdep.cc -------------------------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file is shared between various sanitizers' runtime libraries.
+//
+// In-process symbolizer that looks addresses up in the ELF symbol tables of
+// the module files.
+//===----------------------------------------------------------------------===//
+
+#include "sanitizer_platform.h"
+#if SANITIZER_LINUX || SANITIZER_FREEBSD
+
+#include "sanitizer_symbolizer_elf.h"
+
+#include "sanitizer_allocator_internal.h"
+#include "sanitizer_common.h"
+#include "sanitizer_placement_new.h"
+#include "sanitizer_posix.h"
+
+#include <link.h>
+#include <sys/mman.h>
+
+namespace __sanitizer {
+
+template <class SymbolT>
+static bool CompareSymbols(const SymbolT &a, const SymbolT &b) {
+  if (a.addr != b.addr)
+    return a.addr < b.addr;
+  // Of the symbols at the same address prefer the largest one, e.g. the
+  // function over a label inside it.
+  if (a.size != b.size)
+    return a.size > b.size;
+  return a.name < b.name;
+}
+
+// Sorts the symbols by address and keeps only one symbol per address.
+template <class SymbolT>
+static void SortAndUniqueSymbols(InternalMmapVectorNoCtor<SymbolT> *symbols) {
+  uptr size = symbols->size();
+  if (size == 0)
+    return;
+  InternalSort(symbols, size, CompareSymbols<SymbolT>);
+  uptr n = 1;
+  for (uptr i = 1; i < size; i++) {
+    if ((*symbols)[i].addr != (*symbols)[n - 1].addr)
+      (*symbols)[n++] = (*symbols)[i];
+  }
+  while (symbols->size() > n)
+    symbols->pop_back();
+}
+
+void ElfSymbolizer::LoadSymbols(ModuleSymbols *module) {
+  fd_t fd = OpenFile(module->module_name, RdOnly);
+  if (fd == kInvalidFd)
+    return;
+  uptr file_size = internal_filesize(fd);
+  uptr map = 0;
+  if (file_size != (uptr)-1 && file_size >= sizeof(ElfW(Ehdr)))
+    map = internal_mmap(nullptr, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  CloseFile(fd);
+  if (!map || internal_iserror(map))
+    return;
+  module->file = (void *)map;
+  module->file_size = file_size;
+
+  const u8 *file = (const u8 *)map;
+  const ElfW(Ehdr) *ehdr = (const ElfW(Ehdr) *)file;
+  if (internal_memcmp(ehdr->e_ident, ELFMAG, SELFMAG) ||
+      ehdr->e_ident[EI_CLASS] !=
+          (SANITIZER_WORDSIZE == 64 ? ELFCLASS64 : ELFCLASS32) ||
+      ehdr->e_shentsize != sizeof(ElfW(Shdr)) || ehdr->e_shoff == 0 ||
+      ehdr->e_shoff > file_size ||
+      ehdr->e_shnum > (file_size - ehdr->e_shoff) / sizeof(ElfW(Shdr)))
+    return;
+  const ElfW(Shdr) *sections = (const ElfW(Shdr) *)(file + ehdr->e_shoff);
+
+  // Stripped modules only have .dynsym, use .symtab if it's there.
+  const ElfW(Shdr) *symtab = nullptr;
+  for (uptr i = 0; i < ehdr->e_shnum; i++) {
+    if (sections[i].sh_type == SHT_SYMTAB) {
+      symtab = &sections[i];
+      break;
+    }
+    if (sections[i].sh_type == SHT_DYNSYM)
+      symtab = &sections[i];
+  }
+  if (!symtab || symtab->sh_link >= ehdr->e_shnum)
+    return;
+  const ElfW(Shdr) *strtab = &sections[symtab->sh_link];
+  if (symtab->sh_offset > file_size ||
+      symtab->sh_size > file_size - symtab->sh_offset ||
+      strtab->sh_offset > file_size ||
+      strtab->sh_size > file_size - strtab->sh_offset ||
+      strtab->sh_size == 0)
+    return;
+  const ElfW(Sym) *syms = (const ElfW(Sym) *)(file + symtab->sh_offset);
+  uptr n_syms = symtab->sh_size / sizeof(ElfW(Sym));
+  const char *strings = (const char *)(file + strtab->sh_offset);
+  // The names are only NUL-terminated if the table is.
+  if (strings[strtab->sh_size - 1] != '\0')
+    return;
+
+  for (uptr i = 0; i < n_syms; i++) {
+    const ElfW(Sym) &sym = syms[i];
+    if (sym.st_shndx == SHN_UNDEF || sym.st_value == 0 || sym.st_name == 0 ||
+        sym.st_name >= strtab->sh_size)
+      continue;
+    Symbol symbol = {(uptr)sym.st_value, (uptr)sym.st_size,
+                     strings + sym.st_name, nullptr};
+    switch (sym.st_info & 0xf) {  // ELF*_ST_TYPE
+      case STT_FUNC:
+      case STT_GNU_IFUNC:
+        module->functions.push_back(symbol);
+        break;
+      case STT_OBJECT:
+        module->objects.push_back(symbol);
+        break;
+    }
+  }
+  SortAndUniqueSymbols(&module->functions);
+  SortAndUniqueSymbols(&module->objects);
+  VReport(2, "ElfSymbolizer: %zu functions and %zu objects in %s\n",
+          module->functions.size(), module->objects.size(),
+          module->module_name);
+}
+
+ElfSymbolizer::ModuleSymbols *ElfSymbolizer::GetModuleSymbols(
+    const char *module_name) {
+  if (!module_name)
+    return nullptr;
+  if (last_module_ && !internal_strcmp(last_module_->module_name, module_name))
+    return last_module_;
+  for (uptr i = 0; i < modules_.size(); i++) {
+    if (!internal_strcmp(modules_[i]->module_name, module_name)) {
+      last_module_ = modules_[i];
+      return last_module_;
+    }
+  }
+  ModuleSymbols *module =
+      new(InternalAlloc(sizeof(ModuleSymbols))) ModuleSymbols;
+  module->module_name = internal_strdup(module_name);
+  module->file = nullptr;
+  module->file_size = 0;
+  module->functions.Initialize(kInitialCapacity);
+  module->objects.Initialize(kInitialCapacity);
+  LoadSymbols(module);
+  modules_.push_back(module);
+  last_module_ = module;
+  return module;
+}
+
+// Returns the last symbol that starts at or below |offset|.
+ElfSymbolizer::Symbol *ElfSymbolizer::FindSymbol(
+    InternalMmapVectorNoCtor<Symbol> *symbols, uptr offset) {
+  uptr lo = 0, hi = symbols->size();
+  while (lo < hi) {
+    uptr mid = lo + (hi - lo) / 2;
+    if ((*symbols)[mid].addr <= offset)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return lo ? &(*symbols)[lo - 1] : nullptr;
+}
+
+const char *ElfSymbolizer::GetDemangledName(Symbol *symbol) {
+  if (!symbol->demangled)
+    symbol->demangled = DemangleCXXABI(symbol->name);
+  return symbol->demangled;
+}
+
+bool ElfSymbolizer::SymbolizePC(uptr addr, SymbolizedStack *stack) {
+  ModuleSymbols *module = GetModuleSymbols(stack->info.module);
+  if (!module)
+    return false;
+  uptr offset = stack->info.module_offset;
+  Symbol *symbol = FindSymbol(&module->functions, offset);
+  // Hand-written assembly often has no size, take the closest symbol then.
+  if (!symbol || (symbol->size && offset >= symbol->addr + symbol->size))
+    return false;
+  stack->info.function = internal_strdup(GetDemangledName(symbol));
+  stack->info.function_offset = offset - symbol->addr;
+  return true;
+}
+
+bool ElfSymbolizer::SymbolizeData(uptr addr, DataInfo *info) {
+  ModuleSymbols *module = GetModuleSymbols(info->module);
+  if (!module)
+    return false;
+  uptr offset = info->module_offset;
+  Symbol *symbol = FindSymbol(&module->objects, offset);
+  if (!symbol || offset >= symbol->addr + Max(symbol->size, (uptr)1))
+    return false;
+  info->name = internal_strdup(GetDemangledName(symbol));
+  info->start = addr - offset + symbol->addr;
+  info->size = symbol->size;
+  return true;
+}
+
+void ElfSymbolizer::Flush() {
+  for (uptr i = 0; i < modules_.size(); i++) {
+    ModuleSymbols *module = modules_[i];
+    if (module->file)
+      internal_munmap(module->file, module->file_size);
+    module->functions.Destroy();
+    module->objects.Destroy();
+    InternalFree(module->module_name);
+    InternalFree(module);
+  }
+  modules_.clear();
+  last_module_ = nullptr;
+}
+
+}  // namespace __sanitizer
+
+#endif  // SANITIZER_LINUX || SANITIZER_FREEBSD
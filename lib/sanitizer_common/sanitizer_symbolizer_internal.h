@@ -58,6 +58,19 @@ class SymbolizerTool {
     UNIMPLEMENTED();
   }
 
+  // Symbolizes several addresses at once. |stacks| are pre-filled as for
+  // SymbolizePC(). The tool skips the stacks for which symbolized[i] is set
+  // (by the previous tools in the chain), and sets it for the ones it
+  // handles. Tools talking to a subprocess override this to avoid a round
+  // trip for every address.
+  virtual void SymbolizePCs(SymbolizedStack *const *stacks, uptr count,
+                            bool *symbolized) {
+    for (uptr i = 0; i < count; i++) {
+      if (!symbolized[i])
+        symbolized[i] = SymbolizePC(stacks[i]->info.address, stacks[i]);
+    }
+  }
+
   virtual void Flush() {}
 
   // Return nullptr to fallback to the default platform-specific demangler.
@@ -73,6 +86,12 @@ class SymbolizerProcess {
  public:
   explicit SymbolizerProcess(const char *path, bool use_forkpty = false);
   const char *SendCommand(const char *command);
+  // Sends |count| commands without waiting for a response before sending the
+  // next one. The commands are stored one after another in |commands|, each
+  // one terminated by '\0'. On success, |responses| gets the responses in
+  // the same format.
+  bool SendCommands(const char *commands, uptr count,
+                    InternalMmapVector<char> *responses);
 
  protected:
   virtual bool ReachedEndOfOutput(const char *buffer, uptr length) const {
@@ -90,9 +109,15 @@ class SymbolizerProcess {
 
   virtual bool ReadFromSymbolizer(char *buffer, uptr max_length);
 
+  // Strips whatever the tool appends to the meaningful part of a
+  // null-terminated response.
+  virtual void TrimOutput(char *buffer) const {}
+
  private:
   bool Restart();
   const char *SendCommandImpl(const char *command);
+  bool SendCommandsImpl(const char *commands, uptr count,
+                        InternalMmapVector<char> *responses);
   bool WriteToSymbolizer(const char *buffer, uptr length);
   bool StartSymbolizerSubprocess();
 
@@ -103,6 +128,11 @@ class SymbolizerProcess {
   static const uptr kBufferSize = 16 * 1024;
   char buffer_[kBufferSize];
 
+  // The number of commands SendCommands() writes ahead of the responses. This
+  // keeps the symbolizer busy, and bounds the amount of output it produces
+  // while we are writing, so that it never blocks on a full pipe.
+  static const uptr kMaxCommandsInFlight = 16;
+
   static const uptr kMaxTimesRestarted = 5;
   static const int kSymbolizerStartupTimeMillis = 10;
   uptr times_restarted_;
@@ -123,13 +153,21 @@ class LLVMSymbolizer : public SymbolizerTool {
 
   bool SymbolizeData(uptr addr, DataInfo *info) override;
 
+  void SymbolizePCs(SymbolizedStack *const *stacks, uptr count,
+                    bool *symbolized) override;
+
  private:
+  const char *FormatCommand(bool is_data, const char *module_name,
+                            uptr module_offset, char *buffer, uptr max_length);
   const char *SendCommand(bool is_data, const char *module_name,
                           uptr module_offset);
 
   LLVMSymbolizerProcess *symbolizer_process_;
   static const uptr kBufferSize = 16 * 1024;
   char buffer_[kBufferSize];
+  // Reused by SymbolizePCs().
+  InternalMmapVector<char> commands_;
+  InternalMmapVector<char> responses_;
 };
 
 // Parses one or more two-line strings in the following format:
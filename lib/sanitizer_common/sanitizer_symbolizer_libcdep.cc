@@ -13,6 +13,7 @@
 
 #include "sanitizer_allocator_internal.h"
 #include "sanitizer_internal_defs.h"
+#include "sanitizer_placement_new.h"
 #include "sanitizer_symbolizer_internal.h"
 
 namespace __sanitizer {
@@ -62,35 +63,91 @@ const char *ExtractTokenUpToDelimiter(const char *str, const char *delimiter,
 
 SymbolizedStack *Symbolizer::SymbolizePC(uptr addr) {
   BlockingMutexLock l(&mu_);
-  const char *module_name;
-  uptr module_offset;
+  LoadedModule *module = FindModuleForAddress(addr);
+  if (!module)
+    return SymbolizedStack::New(addr);
+  uptr module_offset = addr - module->base_address();
+  if (SymbolizedStack *cached = cache_.GetPC(module, module_offset))
+    return cached;
   SymbolizedStack *res = SymbolizedStack::New(addr);
-  if (!FindModuleNameAndOffsetForAddress(addr, &module_name, &module_offset))
-    return res;
   // Always fill data about module name and offset.
-  res->info.FillModuleInfo(module_name, module_offset);
+  res->info.FillModuleInfo(module->full_name(), module_offset,
+                           module->build_id());
   for (auto &tool : tools_) {
     SymbolizerScope sym_scope(this);
     if (tool.SymbolizePC(addr, res)) {
-      return res;
+      cache_.AddPC(module, module_offset, res);
+      break;
     }
   }
   return res;
 }
 
+void Symbolizer::SymbolizePCs(const uptr *addresses, uptr count,
+                              SymbolizedStack **results) {
+  BlockingMutexLock l(&mu_);
+  for (uptr first = 0; first < count; first += kMaxBatchSize) {
+    uptr n = Min(count - first, kMaxBatchSize);
+    SymbolizePCsLocked(addresses + first, n, results + first);
+  }
+}
+
+void Symbolizer::SymbolizePCsLocked(const uptr *addresses, uptr count,
+                                    SymbolizedStack **results) {
+  mu_.CheckLocked();
+  CHECK_LE(count, kMaxBatchSize);
+  SymbolizedStack **pending = pending_;
+  LoadedModule **pending_modules = pending_modules_;
+  bool *symbolized = pending_symbolized_;
+  uptr n_pending = 0;
+  for (uptr i = 0; i < count; i++) {
+    uptr addr = addresses[i];
+    LoadedModule *module = FindModuleForAddress(addr);
+    if (!module) {
+      results[i] = SymbolizedStack::New(addr);
+      continue;
+    }
+    uptr module_offset = addr - module->base_address();
+    results[i] = cache_.GetPC(module, module_offset);
+    if (results[i])
+      continue;
+    results[i] = SymbolizedStack::New(addr);
+    results[i]->info.FillModuleInfo(module->full_name(), module_offset,
+                                    module->build_id());
+    pending[n_pending] = results[i];
+    pending_modules[n_pending] = module;
+    symbolized[n_pending] = false;
+    n_pending++;
+  }
+  if (n_pending == 0)
+    return;
+  for (auto &tool : tools_) {
+    SymbolizerScope sym_scope(this);
+    tool.SymbolizePCs(pending, n_pending, symbolized);
+  }
+  for (uptr i = 0; i < n_pending; i++) {
+    if (symbolized[i])
+      cache_.AddPC(pending_modules[i], pending[i]->info.module_offset,
+                   pending[i]);
+  }
+}
+
 bool Symbolizer::SymbolizeData(uptr addr, DataInfo *info) {
   BlockingMutexLock l(&mu_);
-  const char *module_name;
-  uptr module_offset;
-  if (!FindModuleNameAndOffsetForAddress(addr, &module_name, &module_offset))
+  LoadedModule *module = FindModuleForAddress(addr);
+  if (!module)
     return false;
+  uptr module_offset = addr - module->base_address();
+  if (cache_.GetData(module, module_offset, info))
+    return true;
   info->Clear();
-  info->module = internal_strdup(module_name);
+  info->module = internal_strdup(module->full_name());
   info->module_offset = module_offset;
   for (auto &tool : tools_) {
     SymbolizerScope sym_scope(this);
     if (tool.SymbolizeData(addr, info)) {
-      return true;
+      cache_.AddData(module, module_offset, *info);
+      break;
     }
   }
   return true;
@@ -111,12 +168,18 @@ bool Symbolizer::GetModuleNameAndOffsetForPC(uptr pc, const char **module_name,
 
 void Symbolizer::Flush() {
   BlockingMutexLock l(&mu_);
+  cache_.Clear();
   for (auto &tool : tools_) {
     SymbolizerScope sym_scope(this);
     tool.Flush();
   }
 }
 
+void Symbolizer::GetCacheStats(SymbolizerCacheStats *stats) {
+  BlockingMutexLock l(&mu_);
+  cache_.GetStats(stats);
+}
+
 const char *Symbolizer::Demangle(const char *name) {
   BlockingMutexLock l(&mu_);
   for (auto &tool : tools_) {
@@ -143,32 +206,121 @@ bool Symbolizer::FindModuleNameAndOffsetForAddress(uptr address,
   return true;
 }
 
-LoadedModule *Symbolizer::FindModuleForAddress(uptr address) {
-  bool modules_were_reloaded = false;
-  if (!modules_fresh_) {
-    for (uptr i = 0; i < n_modules_; i++)
-      modules_[i].clear();
-    n_modules_ =
-        GetListOfModules(modules_, kMaxNumberOfModules, /* filter */ nullptr);
-    CHECK_GT(n_modules_, 0);
-    CHECK_LT(n_modules_, kMaxNumberOfModules);
-    modules_fresh_ = true;
-    modules_were_reloaded = true;
+static bool CompareModulePtrs(LoadedModule *a, LoadedModule *b) {
+  return a->base_address() < b->base_address();
+}
+
+static bool CompareModules(const LoadedModule &a, const LoadedModule &b) {
+  return a.base_address() < b.base_address();
+}
+
+template <class RangeT>
+static bool CompareRangesByBeg(const RangeT &a, const RangeT &b) {
+  return a.beg < b.beg;
+}
+
+static bool IsSameModule(const LoadedModule &a, const LoadedModule &b) {
+  return a.full_name() && b.full_name() &&
+         a.base_address() == b.base_address() &&
+         !internal_strcmp(a.full_name(), b.full_name());
+}
+
+// Updates modules_ from the current list of loaded modules. The modules that
+// are still loaded keep their LoadedModule objects, so the result cache only
+// has to be dropped when some module has been unloaded.
+void Symbolizer::RefreshModules() {
+  modules_loaded_generation_ =
+      atomic_load(&modules_generation_, memory_order_relaxed);
+  modules_loaded_stamp_ = GetLoadedModulesStamp();
+  InternalMmapVector<LoadedModule> loaded(modules_.size() + 1);
+  GetListOfModules(&loaded, /* filter */ nullptr);
+  CHECK_GT(loaded.size(), 0);
+  InternalSort(&loaded, loaded.size(), CompareModules);
+
+  // Both lists are sorted by base address, merge them.
+  InternalMmapVector<LoadedModule *> old_modules(modules_.size() + 1);
+  for (uptr i = 0; i < modules_.size(); i++)
+    old_modules.push_back(modules_[i]);
+  modules_.clear();
+  bool removed_modules = false;
+  uptr j = 0;
+  for (uptr i = 0; i < old_modules.size(); i++) {
+    LoadedModule *module = old_modules[i];
+    while (j < loaded.size() &&
+           loaded[j].base_address() < module->base_address())
+      j++;
+    uptr k = j;
+    while (k < loaded.size() &&
+           loaded[k].base_address() == module->base_address() &&
+           !IsSameModule(loaded[k], *module))
+      k++;
+    if (k < loaded.size() && IsSameModule(loaded[k], *module)) {
+      loaded[k].clear();
+      modules_.push_back(module);
+    } else {
+      module->clear();
+      InternalFree(module);
+      removed_modules = true;
+    }
+  }
+  // The cache is keyed by the LoadedModule pointers, which may be reused.
+  if (removed_modules)
+    cache_.Clear();
+  for (uptr i = 0; i < loaded.size(); i++) {
+    // Modules that are already known have been cleared above.
+    if (!loaded[i].full_name())
+      continue;
+    // The new object takes over the name and the address ranges.
+    LoadedModule *module =
+        new(InternalAlloc(sizeof(LoadedModule))) LoadedModule(loaded[i]);
+    modules_.push_back(module);
   }
-  for (uptr i = 0; i < n_modules_; i++) {
-    if (modules_[i].containsAddress(address)) {
-      return &modules_[i];
+  InternalSort(&modules_, modules_.size(), CompareModulePtrs);
+
+  module_ranges_.clear();
+  for (uptr i = 0; i < modules_.size(); i++) {
+    for (const auto &range : modules_[i]->ranges()) {
+      ModuleRange module_range = {range.beg, range.end, modules_[i]};
+      module_ranges_.push_back(module_range);
     }
   }
-  // Reload the modules and look up again, if we haven't tried it yet.
-  if (!modules_were_reloaded) {
-    // FIXME: set modules_fresh_ from dlopen()/dlclose() interceptors.
-    // It's too aggressive to reload the list of modules each time we fail
-    // to find a module for a given address.
-    modules_fresh_ = false;
-    return FindModuleForAddress(address);
+  InternalSort(&module_ranges_, module_ranges_.size(),
+               CompareRangesByBeg<ModuleRange>);
+  modules_loaded_ = true;
+}
+
+LoadedModule *Symbolizer::LookupModule(uptr address) const {
+  // Find the last range that starts at or below the address.
+  uptr lo = 0, hi = module_ranges_.size();
+  while (lo < hi) {
+    uptr mid = lo + (hi - lo) / 2;
+    if (module_ranges_[mid].beg <= address)
+      lo = mid + 1;
+    else
+      hi = mid;
   }
-  return 0;
+  if (lo == 0)
+    return nullptr;
+  const ModuleRange &range = module_ranges_[lo - 1];
+  if (address >= range.end)
+    return nullptr;
+  return range.module;
+}
+
+LoadedModule *Symbolizer::FindModuleForAddress(uptr address) {
+  if (!modules_loaded_ ||
+      modules_loaded_generation_ !=
+          atomic_load(&modules_generation_, memory_order_relaxed))
+    RefreshModules();
+  if (LoadedModule *module = LookupModule(address))
+    return module;
+  // Tools that don't intercept dlopen()/dlclose() can't tell us about new
+  // modules, so refresh the list on a miss, but only if it has changed.
+  u64 stamp = GetLoadedModulesStamp();
+  if (stamp != 0 && stamp == modules_loaded_stamp_)
+    return nullptr;
+  RefreshModules();
+  return LookupModule(address);
 }
 
 Symbolizer *Symbolizer::GetOrInit() {
@@ -233,7 +385,8 @@ class LLVMSymbolizerProcess : public SymbolizerProcess {
 };
 
 LLVMSymbolizer::LLVMSymbolizer(const char *path, LowLevelAllocator *allocator)
-    : symbolizer_process_(new(*allocator) LLVMSymbolizerProcess(path)) {}
+    : symbolizer_process_(new(*allocator) LLVMSymbolizerProcess(path)),
+      commands_(kBufferSize), responses_(kBufferSize) {}
 
 // Parse a <file>:<line>[:<column>] buffer. The file path may contain colons on
 // Windows, so extract tokens from the right hand side first. The column info is
@@ -288,7 +441,8 @@ void ParseSymbolizePCOutput(const char *str, SymbolizedStack *res) {
       top_frame = false;
     } else {
       cur = SymbolizedStack::New(res->info.address);
-      cur->info.FillModuleInfo(res->info.module, res->info.module_offset);
+      cur->info.FillModuleInfo(res->info.module, res->info.module_offset,
+                               res->info.module_build_id);
       last->next = cur;
       last = cur;
     }
@@ -339,12 +493,48 @@ bool LLVMSymbolizer::SymbolizeData(uptr addr, DataInfo *info) {
   return false;
 }
 
-const char *LLVMSymbolizer::SendCommand(bool is_data, const char *module_name,
-                                        uptr module_offset) {
+void LLVMSymbolizer::SymbolizePCs(SymbolizedStack *const *stacks, uptr count,
+                                  bool *symbolized) {
+  commands_.clear();
+  uptr n_commands = 0;
+  for (uptr i = 0; i < count; i++) {
+    if (symbolized[i])
+      continue;
+    FormatCommand(/*is_data*/ false, stacks[i]->info.module,
+                  stacks[i]->info.module_offset, buffer_, kBufferSize);
+    for (const char *c = buffer_; *c; c++)
+      commands_.push_back(*c);
+    commands_.push_back('\0');
+    n_commands++;
+  }
+  if (n_commands == 0 ||
+      !symbolizer_process_->SendCommands(commands_.data(), n_commands,
+                                         &responses_))
+    return;
+  const char *response = responses_.data();
+  for (uptr i = 0; i < count; i++) {
+    if (symbolized[i])
+      continue;
+    ParseSymbolizePCOutput(response, stacks[i]);
+    symbolized[i] = true;
+    response += internal_strlen(response) + 1;
+  }
+}
+
+const char *LLVMSymbolizer::FormatCommand(bool is_data,
+                                          const char *module_name,
+                                          uptr module_offset, char *buffer,
+                                          uptr max_length) {
   CHECK(module_name);
-  internal_snprintf(buffer_, kBufferSize, "%s\"%s\" 0x%zx\n",
+  internal_snprintf(buffer, max_length, "%s\"%s\" 0x%zx\n",
                     is_data ? "DATA " : "", module_name, module_offset);
-  return symbolizer_process_->SendCommand(buffer_);
+  return buffer;
+}
+
+const char *LLVMSymbolizer::SendCommand(bool is_data, const char *module_name,
+                                        uptr module_offset) {
+  return symbolizer_process_->SendCommand(FormatCommand(
+      is_data, module_name, module_offset, buffer_, kBufferSize));
 }
 
 SymbolizerProcess::SymbolizerProcess(const char *path, bool use_forkpty)
@@ -373,6 +563,75 @@ const char *SymbolizerProcess::SendCommand(const char *command) {
   return 0;
 }
 
+bool SymbolizerProcess::SendCommands(const char *commands, uptr count,
+                                     InternalMmapVector<char> *responses) {
+  for (; times_restarted_ < kMaxTimesRestarted; times_restarted_++) {
+    // Start or restart symbolizer if we failed to send commands to it. The
+    // responses we got so far may be out of sync, so start from scratch.
+    responses->clear();
+    if (SendCommandsImpl(commands, count, responses))
+      return true;
+    Restart();
+  }
+  if (!failed_to_start_) {
+    Report("WARNING: Failed to use and restart external symbolizer!\n");
+    failed_to_start_ = true;
+  }
+  return false;
+}
+
+bool SymbolizerProcess::SendCommandsImpl(const char *commands, uptr count,
+                                         InternalMmapVector<char> *responses) {
+  if (input_fd_ == kInvalidFd || output_fd_ == kInvalidFd)
+    return false;
+  uptr sent = 0;
+  uptr received = 0;
+  // buffer_[0, read_len) holds the output we haven't split into responses
+  // yet, of which the first scanned bytes contain no end of response.
+  uptr read_len = 0;
+  uptr scanned = 0;
+  while (received < count) {
+    for (; sent < count && sent - received < kMaxCommandsInFlight; sent++) {
+      uptr length = internal_strlen(commands);
+      if (!WriteToSymbolizer(commands, length))
+        return false;
+      commands += length + 1;
+    }
+    if (read_len + 1 >= kBufferSize) {
+      Report("WARNING: Symbolizer response is too long\n");
+      return false;
+    }
+    uptr just_read = 0;
+    bool success = ReadFromFile(input_fd_, buffer_ + read_len,
+                                kBufferSize - read_len - 1, &just_read);
+    if (!success || just_read == 0) {
+      Report("WARNING: Can't read from symbolizer at fd %d\n", input_fd_);
+      return false;
+    }
+    read_len += just_read;
+    while (scanned < read_len) {
+      scanned++;
+      if (!ReachedEndOfOutput(buffer_, scanned))
+        continue;
+      // buffer_[0, scanned) is a complete response.
+      char next = buffer_[scanned];
+      buffer_[scanned] = '\0';
+      TrimOutput(buffer_);
+      for (const char *c = buffer_; *c; c++)
+        responses->push_back(*c);
+      responses->push_back('\0');
+      buffer_[scanned] = next;
+      internal_memmove(buffer_, buffer_ + scanned, read_len - scanned);
+      read_len -= scanned;
+      scanned = 0;
+      if (++received == count)
+        break;
+    }
+  }
+  // The symbolizer doesn't print anything we didn't ask for.
+  return read_len == 0;
+}
+
 const char *SymbolizerProcess::SendCommandImpl(const char *command) {
   if (input_fd_ == kInvalidFd || output_fd_ == kInvalidFd)
       return 0;
@@ -410,6 +669,7 @@ bool SymbolizerProcess::ReadFromSymbolizer(char *buffer, uptr max_length) {
       break;
   }
   buffer[read_len] = '\0';
+  TrimOutput(buffer);
   return true;
 }
 
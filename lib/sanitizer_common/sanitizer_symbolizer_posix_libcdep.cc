@@ -22,6 +22,7 @@
 #include "sanitizer_placement_new.h"
 #include "sanitizer_posix.h"
 #include "sanitizer_procmaps.h"
+#include "sanitizer_symbolizer_elf.h"
 #include "sanitizer_symbolizer_internal.h"
 #include "sanitizer_symbolizer_libbacktrace.h"
 #include "sanitizer_symbolizer_mac.h"
@@ -181,9 +182,7 @@ class Addr2LineProcess : public SymbolizerProcess {
 
   bool ReachedEndOfOutput(const char *buffer, uptr length) const override;
 
-  bool ReadFromSymbolizer(char *buffer, uptr max_length) override {
-    if (!SymbolizerProcess::ReadFromSymbolizer(buffer, max_length))
-      return false;
+  void TrimOutput(char *buffer) const override {
     // We should cut out output_terminator_ at the end of given buffer,
     // appended by addr2line to mark the end of its meaningful output.
     // We cannot scan buffer from it's beginning, because it is legal for it
@@ -195,7 +194,6 @@ class Addr2LineProcess : public SymbolizerProcess {
     CHECK(garbage);
     // Trim the buffer.
     garbage[0] = '\0';
-    return true;
   }
 
   const char *module_name_;  // Owned, leaked.
@@ -223,7 +221,8 @@ class Addr2LinePool : public SymbolizerTool {
   explicit Addr2LinePool(const char *addr2line_path,
                          LowLevelAllocator *allocator)
       : addr2line_path_(addr2line_path), allocator_(allocator),
-        addr2line_pool_(16) {}
+        addr2line_pool_(16), commands_(1024), responses_(1024), indices_(64),
+        handled_(64) {}
 
   bool SymbolizePC(uptr addr, SymbolizedStack *stack) override {
     if (const char *buf =
@@ -238,8 +237,57 @@ class Addr2LinePool : public SymbolizerTool {
     return false;
   }
 
+  void SymbolizePCs(SymbolizedStack *const *stacks, uptr count,
+                    bool *symbolized) override {
+    // Every module has its own addr2line process, so send one batch per
+    // module. |handled| marks the stacks we have tried already.
+    handled_.clear();
+    for (uptr i = 0; i < count; i++)
+      handled_.push_back(symbolized[i]);
+    for (uptr first = 0; first < count; first++) {
+      if (handled_[first])
+        continue;
+      const char *module_name = stacks[first]->info.module;
+      commands_.clear();
+      indices_.clear();
+      for (uptr i = first; i < count; i++) {
+        if (handled_[i] ||
+            internal_strcmp(stacks[i]->info.module, module_name))
+          continue;
+        char command[kBufferSize];
+        FormatCommand(stacks[i]->info.module_offset, command);
+        for (const char *c = command; *c; c++)
+          commands_.push_back(*c);
+        commands_.push_back('\0');
+        indices_.push_back(i);
+        handled_[i] = true;
+      }
+      // If this fails, the stacks are left to the next tool.
+      if (!GetProcess(module_name)->SendCommands(
+              commands_.data(), indices_.size(), &responses_))
+        continue;
+      const char *response = responses_.data();
+      for (uptr j = 0; j < indices_.size(); j++) {
+        ParseSymbolizePCOutput(response, stacks[indices_[j]]);
+        symbolized[indices_[j]] = true;
+        response += internal_strlen(response) + 1;
+      }
+    }
+  }
+
  private:
+  void FormatCommand(uptr module_offset, char *buffer) {
+    internal_snprintf(buffer, kBufferSize, "0x%zx\n0x%zx\n",
+                      module_offset, dummy_address_);
+  }
+
   const char *SendCommand(const char *module_name, uptr module_offset) {
+    char buffer[kBufferSize];
+    FormatCommand(module_offset, buffer);
+    return GetProcess(module_name)->SendCommand(buffer);
+  }
+
+  Addr2LineProcess *GetProcess(const char *module_name) {
     Addr2LineProcess *addr2line = 0;
     for (uptr i = 0; i < addr2line_pool_.size(); ++i) {
       if (0 ==
@@ -254,16 +302,18 @@ class Addr2LinePool : public SymbolizerTool {
       addr2line_pool_.push_back(addr2line);
     }
     CHECK_EQ(0, internal_strcmp(module_name, addr2line->module_name()));
-    char buffer[kBufferSize];
-    internal_snprintf(buffer, kBufferSize, "0x%zx\n0x%zx\n",
-                      module_offset, dummy_address_);
-    return addr2line->SendCommand(buffer);
+    return addr2line;
   }
 
   static const uptr kBufferSize = 64;
   const char *addr2line_path_;
   LowLevelAllocator *allocator_;
   InternalMmapVector<Addr2LineProcess*> addr2line_pool_;
+  // Reused by SymbolizePCs().
+  InternalMmapVector<char> commands_;
+  InternalMmapVector<char> responses_;
+  InternalMmapVector<uptr> indices_;
+  InternalMmapVector<bool> handled_;
   static const uptr dummy_address_ =
       FIRST_32_SECOND_64(UINT32_MAX, UINT64_MAX);
 };
@@ -409,6 +459,10 @@ static void ChooseSymbolizerTools(IntrusiveList<SymbolizerTool> *list,
     VReport(2, "Symbolizer is disabled.\n");
     return;
   }
+  if (common_flags()->symbolize_offline) {
+    VReport(2, "Symbolization is left to offline tools.\n");
+    return;
+  }
   if (SymbolizerTool *tool = InternalSymbolizer::get(allocator)) {
     VReport(2, "Using internal symbolizer.\n");
     list->push_back(tool);
@@ -420,10 +474,27 @@ static void ChooseSymbolizerTools(IntrusiveList<SymbolizerTool> *list,
     return;
   }
 
+#if SANITIZER_LINUX || SANITIZER_FREEBSD
+  // The symbol tables are used either instead of the external symbolizer,
+  // where they know the address, or as the last resort.
+  ElfSymbolizer *elf_symbolizer = new(*allocator) ElfSymbolizer();
+  if (common_flags()->symbolize_with_symtab) {
+    VReport(2, "Using ELF symbol tables.\n");
+    list->push_back(elf_symbolizer);
+  }
+#endif
+
   if (SymbolizerTool *tool = ChooseExternalSymbolizer(allocator)) {
     list->push_back(tool);
   }
 
+#if SANITIZER_LINUX || SANITIZER_FREEBSD
+  if (!common_flags()->symbolize_with_symtab) {
+    VReport(2, "Using ELF symbol tables as a fallback.\n");
+    list->push_back(elf_symbolizer);
+  }
+#endif
+
 #if SANITIZER_MAC
   VReport(2, "Using dladdr symbolizer.\n");
   list->push_back(new(*allocator) DlAddrSymbolizer());
@@ -250,6 +250,10 @@ static void ChooseSymbolizerTools(IntrusiveList<SymbolizerTool> *list,
     VReport(2, "Symbolizer is disabled.\n");
     return;
   }
+  if (common_flags()->symbolize_offline) {
+    VReport(2, "Symbolization is left to offline tools.\n");
+    return;
+  }
 
   // Add llvm-symbolizer in case the binary has dwarf.
   const char *user_path = common_flags()->external_symbolizer_path;
@@ -14,6 +14,7 @@
 #include "sanitizer_platform.h"
 #if SANITIZER_FREEBSD || SANITIZER_LINUX
 #include "sanitizer_common.h"
+#include "sanitizer_flags.h"
 #include "sanitizer_stacktrace.h"
 
 #if SANITIZER_ANDROID
@@ -95,34 +96,50 @@ uptr Unwind_GetIP(struct _Unwind_Context *ctx) {
 }
 
 struct UnwindTraceArg {
-  BufferedStackTrace *stack;
-  u32 max_depth;
+  uptr *buffer;
+  uptr size;
+  uptr max_depth;
 };
 
 _Unwind_Reason_Code Unwind_Trace(struct _Unwind_Context *ctx, void *param) {
   UnwindTraceArg *arg = (UnwindTraceArg*)param;
-  CHECK_LT(arg->stack->size, arg->max_depth);
+  CHECK_LT(arg->size, arg->max_depth);
   uptr pc = Unwind_GetIP(ctx);
-  arg->stack->trace_buffer[arg->stack->size++] = pc;
-  if (arg->stack->size == arg->max_depth) return UNWIND_STOP;
+  arg->buffer[arg->size++] = pc;
+  if (arg->size == arg->max_depth) return UNWIND_STOP;
   return UNWIND_CONTINUE;
 }
 
+NOINLINE
+uptr UnwindWithLibgcc(uptr *buffer, uptr max_depth) {
+  UnwindTraceArg arg = {buffer, 0, max_depth};
+  _Unwind_Backtrace(Unwind_Trace, &arg);
+  return arg.size;
+}
+
+#if !SANITIZER_CAN_UNWIND_WITH_TABLE_CACHE
+uptr UnwindWithTableCache(uptr *buffer, uptr max_depth) { return 0; }
+void InvalidateUnwindTableCache() {}
+#endif
+
 void BufferedStackTrace::SlowUnwindStack(uptr pc, u32 max_depth) {
   CHECK_GE(max_depth, 2);
+  uptr depth = Min(max_depth + 2, kStackTraceMax);
   size = 0;
-  UnwindTraceArg arg = {this, Min(max_depth + 1, kStackTraceMax)};
-  _Unwind_Backtrace(Unwind_Trace, &arg);
+  if (common_flags()->unwind_with_table_cache)
+    size = UnwindWithTableCache(trace_buffer, depth);
+  if (!size)
+    size = UnwindWithLibgcc(trace_buffer, depth);
   // We need to pop a few frames so that pc is on top.
   uptr to_pop = LocatePcInTrace(pc);
-  // trace_buffer[0] belongs to the current function so we always pop it,
-  // unless there is only 1 frame in the stack trace (1 frame is always better
-  // than 0!).
-  // 1-frame stacks don't normally happen, but this depends on the actual
+  // trace_buffer[0] and trace_buffer[1] belong to the unwinder and the current
+  // function so we always pop them, unless there are too few frames in the
+  // stack trace (1 frame is always better than 0!).
+  // Such stacks don't normally happen, but this depends on the actual
   // unwinder implementation (libgcc, libunwind, etc) which is outside of our
   // control.
   if (to_pop == 0 && size > 1)
-    to_pop = 1;
+    to_pop = Min<uptr>(2, size - 1);
   PopStackFrames(to_pop);
   trace_buffer[0] = pc;
 }
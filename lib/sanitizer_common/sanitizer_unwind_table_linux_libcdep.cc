@@ -0,0 +1,804 @@
+//===-- sanitizer_unwind_table_linux_libcdep.cc ---------------------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file contains a DWARF CFI stack unwinder which keeps its own cache of
+// the modules' .eh_frame_hdr lookup tables.
+//
+// _Unwind_Backtrace() calls dl_iterate_phdr() and binary searches the FDE
+// table of the module for every frame, and interprets the CFA program from
+// scratch every time. When the tools need slow unwinding on every malloc, this
+// dominates the cost of malloc. Here, the list of modules and their lookup
+// tables is built once and refreshed when a library is loaded or unloaded,
+// which is detected with the dlpi_adds/dlpi_subs counters of
+// dl_iterate_phdr(), so that libraries loaded behind the interceptors' back
+// (e.g. by glibc's internal __libc_dlopen()) are noticed as well.
+// On top of that, the unwind rules computed for a PC are cached, so unwinding
+// through a frame which has been seen before takes a few memory accesses.
+// The counters are only looked at when a PC misses the rule cache. The
+// intercepted dlopen()/dlclose() invalidate the cache directly, so a stale
+// hit needs a library unloaded behind our back and another one mapped at
+// the same address.
+//
+// Only the rules produced by compilers for ordinary functions are supported.
+// If a frame needs anything else (e.g. a signal frame, or a CFA defined by
+// a DWARF expression), UnwindWithTableCache() fails and the caller falls back
+// to _Unwind_Backtrace().
+//===----------------------------------------------------------------------===//
+
+#include "sanitizer_platform.h"
+#if (SANITIZER_FREEBSD || SANITIZER_LINUX) && !SANITIZER_ANDROID && \
+    defined(__x86_64__)
+#include "sanitizer_atomic.h"
+#include "sanitizer_common.h"
+#include "sanitizer_stacktrace.h"
+
+#include <link.h>
+#include <stddef.h>
+
+namespace __sanitizer {
+
+// DWARF register numbers on x86_64.
+static const u32 kRegBP = 6;
+static const u32 kRegSP = 7;
+static const u32 kRegRA = 16;
+
+// Pointer encodings used in .eh_frame and .eh_frame_hdr.
+enum {
+  DW_EH_PE_absptr = 0x00,
+  DW_EH_PE_uleb128 = 0x01,
+  DW_EH_PE_udata2 = 0x02,
+  DW_EH_PE_udata4 = 0x03,
+  DW_EH_PE_udata8 = 0x04,
+  DW_EH_PE_sleb128 = 0x09,
+  DW_EH_PE_sdata2 = 0x0a,
+  DW_EH_PE_sdata4 = 0x0b,
+  DW_EH_PE_sdata8 = 0x0c,
+  DW_EH_PE_pcrel = 0x10,
+  DW_EH_PE_datarel = 0x30,
+  DW_EH_PE_indirect = 0x80,
+  DW_EH_PE_omit = 0xff
+};
+
+// Call frame instructions.
+enum {
+  DW_CFA_nop = 0x00,
+  DW_CFA_set_loc = 0x01,
+  DW_CFA_advance_loc1 = 0x02,
+  DW_CFA_advance_loc2 = 0x03,
+  DW_CFA_advance_loc4 = 0x04,
+  DW_CFA_offset_extended = 0x05,
+  DW_CFA_restore_extended = 0x06,
+  DW_CFA_undefined = 0x07,
+  DW_CFA_same_value = 0x08,
+  DW_CFA_register = 0x09,
+  DW_CFA_remember_state = 0x0a,
+  DW_CFA_restore_state = 0x0b,
+  DW_CFA_def_cfa = 0x0c,
+  DW_CFA_def_cfa_register = 0x0d,
+  DW_CFA_def_cfa_offset = 0x0e,
+  DW_CFA_def_cfa_expression = 0x0f,
+  DW_CFA_expression = 0x10,
+  DW_CFA_offset_extended_sf = 0x11,
+  DW_CFA_def_cfa_sf = 0x12,
+  DW_CFA_def_cfa_offset_sf = 0x13,
+  DW_CFA_val_offset = 0x14,
+  DW_CFA_val_offset_sf = 0x15,
+  DW_CFA_val_expression = 0x16,
+  DW_CFA_GNU_args_size = 0x2e,
+  DW_CFA_GNU_negative_offset_extended = 0x2f,
+  // The high 2 bits of these contain the opcode, the low 6 bits the operand.
+  DW_CFA_advance_loc = 0x40,
+  DW_CFA_offset = 0x80,
+  DW_CFA_restore = 0xc0
+};
+
+//------------------------- Reading DWARF data --------------------------------
+
+class DwarfReader {
+ public:
+  DwarfReader(const u8 *p, const u8 *end) : p_(p), end_(end), ok_(true) {}
+
+  const u8 *pos() const { return p_; }
+  const u8 *end() const { return end_; }
+  bool ok() const { return ok_; }
+  bool AtEnd() const { return !ok_ || p_ >= end_; }
+  void Fail() { ok_ = false; }
+
+  template <typename T>
+  T Read() {
+    if (!Check(sizeof(T))) return 0;
+    struct __attribute__((packed)) Unaligned { T v; };
+    T res = ((const Unaligned *)p_)->v;
+    p_ += sizeof(T);
+    return res;
+  }
+
+  u64 ReadULEB128() {
+    u64 res = 0;
+    for (uptr shift = 0; Check(1); shift += 7) {
+      u8 b = *p_++;
+      if (shift < 64) res |= (u64)(b & 0x7f) << shift;
+      if (!(b & 0x80)) return res;
+    }
+    return 0;
+  }
+
+  s64 ReadSLEB128() {
+    u64 res = 0;
+    uptr shift = 0;
+    for (; Check(1); ) {
+      u8 b = *p_++;
+      if (shift < 64) res |= (u64)(b & 0x7f) << shift;
+      shift += 7;
+      if (!(b & 0x80)) {
+        if (shift < 64 && (b & 0x40)) res |= ~(u64)0 << shift;
+        return (s64)res;
+      }
+    }
+    return 0;
+  }
+
+  // Reads a pointer in the given encoding. DW_EH_PE_datarel is relative to
+  // data_base. Indirect pointers are not dereferenced.
+  uptr ReadEncodedPointer(u8 encoding, uptr data_base) {
+    const u8 *field = p_;
+    uptr res;
+    switch (encoding & 0x0f) {
+      case DW_EH_PE_absptr: res = Read<uptr>(); break;
+      case DW_EH_PE_uleb128: res = ReadULEB128(); break;
+      case DW_EH_PE_udata2: res = Read<u16>(); break;
+      case DW_EH_PE_udata4: res = Read<u32>(); break;
+      case DW_EH_PE_udata8: res = Read<u64>(); break;
+      case DW_EH_PE_sleb128: res = ReadSLEB128(); break;
+      case DW_EH_PE_sdata2: res = Read<s16>(); break;
+      case DW_EH_PE_sdata4: res = Read<s32>(); break;
+      case DW_EH_PE_sdata8: res = Read<s64>(); break;
+      default: Fail(); return 0;
+    }
+    switch (encoding & 0x70) {
+      case DW_EH_PE_absptr: break;
+      case DW_EH_PE_pcrel: res += (uptr)field; break;
+      case DW_EH_PE_datarel: res += data_base; break;
+      default: Fail(); return 0;
+    }
+    return res;
+  }
+
+  void Skip(uptr size) {
+    if (Check(size)) p_ += size;
+  }
+
+ private:
+  bool Check(uptr size) {
+    if (ok_ && (uptr)(end_ - p_) >= size) return true;
+    ok_ = false;
+    return false;
+  }
+
+  const u8 *p_;
+  const u8 *end_;
+  bool ok_;
+};
+
+//------------------------- CFA programs --------------------------------------
+
+// How to recover the caller's value of a register.
+enum RegRuleKind {
+  kRuleSameValue,  // Unchanged (also used when there is no rule).
+  kRuleOffset,     // Saved at CFA + offset.
+  kRuleUndefined   // Not recoverable. For the return address: end of stack.
+};
+
+struct UnwindRule {
+  u8 cfa_reg;  // kRegSP or kRegBP.
+  u8 ra_kind;
+  u8 bp_kind;
+  s32 cfa_offset;
+  s32 ra_offset;
+  s32 bp_offset;
+};
+
+struct CieInfo {
+  u64 code_align;
+  s64 data_align;
+  u64 ra_reg;
+  u8 fde_encoding;
+  bool has_augmentation_data;
+  bool signal_frame;
+  const u8 *insns;
+  const u8 *insns_end;
+};
+
+// Returns the end of the CIE or FDE starting at p, and sets *body to the
+// start of its contents, i.e. the CIE id or the CIE pointer.
+static const u8 *ParseEntryHeader(const u8 *p, const u8 **body) {
+  u32 length = *(const u32 *)p;
+  p += sizeof(u32);
+  if (length == 0xffffffff) {
+    u64 length64 = *(const u64 *)p;
+    p += sizeof(u64);
+    *body = p;
+    return p + length64;
+  }
+  *body = p;
+  return p + length;
+}
+
+static bool ParseCie(const u8 *cie, CieInfo *info) {
+  const u8 *body;
+  const u8 *end = ParseEntryHeader(cie, &body);
+  DwarfReader r(body, end);
+  if (r.Read<u32>() != 0) return false;  // Not a CIE.
+  u8 version = r.Read<u8>();
+  if (version != 1 && version != 3) return false;
+  const char *augmentation = (const char *)r.pos();
+  while (!r.AtEnd() && r.Read<u8>() != 0) {}
+  info->code_align = r.ReadULEB128();
+  info->data_align = r.ReadSLEB128();
+  info->ra_reg = version == 1 ? r.Read<u8>() : r.ReadULEB128();
+  info->fde_encoding = DW_EH_PE_absptr;
+  info->has_augmentation_data = false;
+  info->signal_frame = false;
+  if (augmentation[0] == 'z') {
+    info->has_augmentation_data = true;
+    u64 length = r.ReadULEB128();
+    const u8 *data_end = r.pos() + length;
+    // Unknown augmentations stop the parsing, their data is skipped below.
+    bool known = true;
+    for (const char *a = augmentation + 1; *a && known && r.ok(); a++) {
+      switch (*a) {
+        case 'L': r.Read<u8>(); break;
+        case 'R': info->fde_encoding = r.Read<u8>(); break;
+        case 'P': {
+          u8 encoding = r.Read<u8>();
+          r.ReadEncodedPointer(encoding & ~DW_EH_PE_indirect, 0);
+          break;
+        }
+        case 'S': info->signal_frame = true; break;
+        default: known = false; break;
+      }
+    }
+    if (!r.ok() || data_end > end) return false;
+    r = DwarfReader(data_end, end);
+  } else if (augmentation[0] != '\0') {
+    return false;
+  }
+  info->insns = r.pos();
+  info->insns_end = end;
+  return r.ok() && info->ra_reg == kRegRA;
+}
+
+struct RegRule {
+  u8 kind;
+  s32 offset;
+};
+
+struct CfaState {
+  u32 cfa_reg;
+  s64 cfa_offset;
+  RegRule bp;
+  RegRule ra;
+};
+
+static const int kMaxRememberedStates = 8;
+
+// Sets the rule for reg. Rules for registers we don't track are ignored,
+// but we fail on kinds of rules we can't follow for the registers we do.
+static bool SetRegRule(CfaState *state, u64 reg, u8 kind, s64 offset) {
+  RegRule *rule;
+  if (reg == kRegBP)
+    rule = &state->bp;
+  else if (reg == kRegRA)
+    rule = &state->ra;
+  else
+    return true;
+  rule->kind = kind;
+  rule->offset = (s32)offset;
+  return (s64)rule->offset == offset;
+}
+
+// Runs the CFA program in [insns, insns_end) until the location passes pc.
+// initial is the state after the CIE instructions, used by DW_CFA_restore.
+static bool RunCfaProgram(const u8 *insns, const u8 *insns_end,
+                          const CieInfo &cie, uptr loc, uptr pc,
+                          const CfaState &initial, CfaState *state) {
+  CfaState remembered[kMaxRememberedStates];
+  int num_remembered = 0;
+  DwarfReader r(insns, insns_end);
+  while (!r.AtEnd()) {
+    u8 op = r.Read<u8>();
+    u8 operand = op & 0x3f;
+    switch (op & 0xc0) {
+      case DW_CFA_advance_loc:
+        loc += operand * cie.code_align;
+        if (loc > pc) return true;
+        continue;
+      case DW_CFA_offset:
+        if (!SetRegRule(state, operand, kRuleOffset,
+                        (s64)r.ReadULEB128() * cie.data_align))
+          return false;
+        continue;
+      case DW_CFA_restore:
+        if (operand == kRegBP) state->bp = initial.bp;
+        if (operand == kRegRA) state->ra = initial.ra;
+        continue;
+    }
+    switch (op) {
+      case DW_CFA_nop:
+        break;
+      case DW_CFA_GNU_args_size:
+        r.ReadULEB128();
+        break;
+      case DW_CFA_set_loc:
+        loc = r.ReadEncodedPointer(cie.fde_encoding, 0);
+        if (loc > pc) return r.ok();
+        break;
+      case DW_CFA_advance_loc1:
+      case DW_CFA_advance_loc2:
+      case DW_CFA_advance_loc4: {
+        u64 delta = op == DW_CFA_advance_loc1   ? r.Read<u8>()
+                    : op == DW_CFA_advance_loc2 ? r.Read<u16>()
+                                                : r.Read<u32>();
+        loc += delta * cie.code_align;
+        if (loc > pc) return r.ok();
+        break;
+      }
+      case DW_CFA_offset_extended: {
+        u64 reg = r.ReadULEB128();
+        if (!SetRegRule(state, reg, kRuleOffset,
+                        (s64)r.ReadULEB128() * cie.data_align))
+          return false;
+        break;
+      }
+      case DW_CFA_offset_extended_sf: {
+        u64 reg = r.ReadULEB128();
+        if (!SetRegRule(state, reg, kRuleOffset,
+                        r.ReadSLEB128() * cie.data_align))
+          return false;
+        break;
+      }
+      case DW_CFA_GNU_negative_offset_extended: {
+        u64 reg = r.ReadULEB128();
+        if (!SetRegRule(state, reg, kRuleOffset,
+                        -(s64)r.ReadULEB128() * cie.data_align))
+          return false;
+        break;
+      }
+      case DW_CFA_restore_extended: {
+        u64 reg = r.ReadULEB128();
+        if (reg == kRegBP) state->bp = initial.bp;
+        if (reg == kRegRA) state->ra = initial.ra;
+        break;
+      }
+      case DW_CFA_undefined:
+        SetRegRule(state, r.ReadULEB128(), kRuleUndefined, 0);
+        break;
+      case DW_CFA_same_value:
+        SetRegRule(state, r.ReadULEB128(), kRuleSameValue, 0);
+        break;
+      case DW_CFA_register: {
+        u64 reg = r.ReadULEB128();
+        r.ReadULEB128();
+        if (reg == kRegBP || reg == kRegRA) return false;
+        break;
+      }
+      case DW_CFA_val_offset:
+      case DW_CFA_val_offset_sf: {
+        u64 reg = r.ReadULEB128();
+        if (op == DW_CFA_val_offset)
+          r.ReadULEB128();
+        else
+          r.ReadSLEB128();
+        if (reg == kRegBP || reg == kRegRA) return false;
+        break;
+      }
+      case DW_CFA_expression:
+      case DW_CFA_val_expression: {
+        u64 reg = r.ReadULEB128();
+        r.Skip(r.ReadULEB128());
+        if (reg == kRegBP || reg == kRegRA) return false;
+        break;
+      }
+      case DW_CFA_remember_state:
+        if (num_remembered == kMaxRememberedStates) return false;
+        remembered[num_remembered++] = *state;
+        break;
+      case DW_CFA_restore_state:
+        if (num_remembered == 0) return false;
+        *state = remembered[--num_remembered];
+        break;
+      case DW_CFA_def_cfa:
+        state->cfa_reg = r.ReadULEB128();
+        state->cfa_offset = r.ReadULEB128();
+        break;
+      case DW_CFA_def_cfa_sf:
+        state->cfa_reg = r.ReadULEB128();
+        state->cfa_offset = r.ReadSLEB128() * cie.data_align;
+        break;
+      case DW_CFA_def_cfa_register:
+        state->cfa_reg = r.ReadULEB128();
+        break;
+      case DW_CFA_def_cfa_offset:
+        state->cfa_offset = r.ReadULEB128();
+        break;
+      case DW_CFA_def_cfa_offset_sf:
+        state->cfa_offset = r.ReadSLEB128() * cie.data_align;
+        break;
+      default:
+        // DW_CFA_def_cfa_expression and vendor extensions.
+        return false;
+    }
+  }
+  return r.ok();
+}
+
+enum FindRuleResult { kRuleFound, kNoRule, kUnsupportedRule };
+
+// Computes the unwind rule for pc from the FDE at fde. Returns kNoRule if
+// the FDE doesn't cover pc.
+static FindRuleResult ComputeUnwindRule(const u8 *fde, uptr pc,
+                                        UnwindRule *rule) {
+  const u8 *body;
+  const u8 *end = ParseEntryHeader(fde, &body);
+  DwarfReader r(body, end);
+  u32 cie_offset = r.Read<u32>();
+  if (!r.ok() || cie_offset == 0) return kUnsupportedRule;
+  CieInfo cie;
+  if (!ParseCie(body - cie_offset, &cie) || cie.signal_frame)
+    return kUnsupportedRule;
+  uptr pc_begin = r.ReadEncodedPointer(cie.fde_encoding, 0);
+  uptr pc_range = r.ReadEncodedPointer(cie.fde_encoding & 0x0f, 0);
+  if (!r.ok()) return kUnsupportedRule;
+  if (pc < pc_begin || pc >= pc_begin + pc_range) return kNoRule;
+  if (cie.has_augmentation_data) r.Skip(r.ReadULEB128());
+  if (!r.ok()) return kUnsupportedRule;
+
+  CfaState state;
+  internal_memset(&state, 0, sizeof(state));
+  state.bp.kind = kRuleSameValue;
+  state.ra.kind = kRuleSameValue;
+  if (!RunCfaProgram(cie.insns, cie.insns_end, cie, 0, 0, state, &state))
+    return kUnsupportedRule;
+  CfaState initial = state;
+  if (!RunCfaProgram(r.pos(), end, cie, pc_begin, pc, initial, &state))
+    return kUnsupportedRule;
+
+  if (state.cfa_reg != kRegSP && state.cfa_reg != kRegBP)
+    return kUnsupportedRule;
+  if (state.ra.kind == kRuleSameValue) return kUnsupportedRule;
+  rule->cfa_reg = state.cfa_reg;
+  rule->cfa_offset = (s32)state.cfa_offset;
+  if ((s64)rule->cfa_offset != state.cfa_offset) return kUnsupportedRule;
+  rule->ra_kind = state.ra.kind;
+  rule->ra_offset = state.ra.offset;
+  rule->bp_kind = state.bp.kind;
+  rule->bp_offset = state.bp.offset;
+  return kRuleFound;
+}
+
+//------------------------- Module table --------------------------------------
+
+struct UnwindTableModule {
+  uptr beg, end;         // Range of executable segments.
+  const u8 *hdr;         // .eh_frame_hdr
+  const s32 *table;      // Binary search table, pairs of (pc, fde) - hdr.
+  uptr fde_count;
+};
+
+struct UnwindTableModules {
+  u32 generation;
+  u64 modules_stamp;  // GetLoadedModulesStamp() when the table was built.
+  uptr mapped_size;
+  UnwindTableModules *next_retired;
+  uptr count;
+  UnwindTableModule modules[1];  // [count], sorted by beg.
+};
+
+// Incremented by InvalidateUnwindTableCache(), and when the set of loaded
+// modules has changed.
+static atomic_uint32_t unwind_table_generation;
+// Current UnwindTableModules.
+static atomic_uintptr_t unwind_table_modules;
+// Tables replaced by a newer one. Another thread may still be unwinding with
+// them, so they are only unmapped by ReclaimUnwindTables() once no thread is
+// inside UnwindWithTableCache().
+static atomic_uintptr_t retired_unwind_tables;
+
+// Number of threads inside UnwindWithTableCache(). The counter is spread over
+// a few cache lines, picked by the stack address, to keep the threads from
+// contending on it.
+struct ActiveUnwinders {
+  atomic_uintptr_t count;
+  char padding[kCacheLineSize - sizeof(atomic_uintptr_t)];
+};
+static const uptr kActiveUnwindersStripes = 16;
+static ActiveUnwinders active_unwinders[kActiveUnwindersStripes];
+
+static atomic_uintptr_t *GetActiveUnwindersCount(uptr sp) {
+  u64 h = (u64)(sp >> 12) * 0x9E3779B97F4A7C15ULL;
+  return &active_unwinders[h >> 60].count;
+}
+
+static bool ParseEhFrameHdr(const u8 *hdr, UnwindTableModule *module) {
+  // version, eh_frame_ptr_enc, fde_count_enc, table_enc.
+  if (hdr[0] != 1) return false;
+  // We only support the table encoding used by all modern linkers.
+  if (hdr[3] != (DW_EH_PE_datarel | DW_EH_PE_sdata4)) return false;
+  DwarfReader r(hdr + 4, hdr + 4 + 2 * sizeof(u64));
+  r.ReadEncodedPointer(hdr[1], (uptr)hdr);
+  uptr fde_count = r.ReadEncodedPointer(hdr[2], (uptr)hdr);
+  if (!r.ok() || hdr[1] == DW_EH_PE_omit || hdr[2] == DW_EH_PE_omit)
+    return false;
+  module->hdr = hdr;
+  module->table = (const s32 *)r.pos();
+  module->fde_count = fde_count;
+  return true;
+}
+
+static int CollectModulesCb(dl_phdr_info *info, size_t size, void *arg) {
+  InternalMmapVector<UnwindTableModule> *modules =
+      (InternalMmapVector<UnwindTableModule> *)arg;
+  UnwindTableModule module;
+  internal_memset(&module, 0, sizeof(module));
+  module.beg = (uptr)-1;
+  const u8 *hdr = nullptr;
+  for (int i = 0; i < info->dlpi_phnum; i++) {
+    const ElfW(Phdr) *phdr = &info->dlpi_phdr[i];
+    uptr beg = info->dlpi_addr + phdr->p_vaddr;
+    if (phdr->p_type == PT_LOAD && (phdr->p_flags & PF_X)) {
+      module.beg = Min(module.beg, beg);
+      module.end = Max(module.end, beg + (uptr)phdr->p_memsz);
+    } else if (phdr->p_type == PT_GNU_EH_FRAME) {
+      hdr = (const u8 *)beg;
+    }
+  }
+  if (hdr && module.beg < module.end && ParseEhFrameHdr(hdr, &module))
+    modules->push_back(module);
+  return 0;
+}
+
+static bool CompareModules(const UnwindTableModule &a,
+                           const UnwindTableModule &b) {
+  return a.beg < b.beg;
+}
+
+// Pushes the list of tables [first, last] onto retired_unwind_tables.
+static void RetireModules(UnwindTableModules *first,
+                          UnwindTableModules *last) {
+  uptr head = atomic_load(&retired_unwind_tables, memory_order_relaxed);
+  do {
+    last->next_retired = (UnwindTableModules *)head;
+  } while (!atomic_compare_exchange_weak(&retired_unwind_tables, &head,
+                                         (uptr)first, memory_order_release));
+}
+
+// We can't hold a lock of our own while calling dl_iterate_phdr(): a thread
+// inside dlopen() holds the loader lock and may be unwinding from malloc().
+// So threads build the table independently and the first one to finish wins.
+static UnwindTableModules *RebuildModules(UnwindTableModules *old) {
+  u32 generation = atomic_load(&unwind_table_generation, memory_order_acquire);
+  InternalMmapVector<UnwindTableModule> modules(64);
+  u64 modules_stamp = GetLoadedModulesStamp();
+  dl_iterate_phdr(CollectModulesCb, &modules);
+  InternalSort(&modules, modules.size(), CompareModules);
+  uptr size = RoundUpTo(sizeof(UnwindTableModules) +
+                            modules.size() * sizeof(UnwindTableModule),
+                        GetPageSizeCached());
+  UnwindTableModules *res =
+      (UnwindTableModules *)MmapOrDie(size, "UnwindTableModules");
+  res->generation = generation;
+  res->modules_stamp = modules_stamp;
+  res->mapped_size = size;
+  res->count = modules.size();
+  for (uptr i = 0; i < modules.size(); i++)
+    res->modules[i] = modules[i];
+  uptr cmp = (uptr)old;
+  if (!atomic_compare_exchange_strong(&unwind_table_modules, &cmp, (uptr)res,
+                                      memory_order_acq_rel)) {
+    UnmapOrDie(res, size);
+    return (UnwindTableModules *)cmp;
+  }
+  if (old)
+    RetireModules(old, old);
+  return res;
+}
+
+static UnwindTableModules *GetModules() {
+  UnwindTableModules *modules =
+      (UnwindTableModules *)atomic_load(&unwind_table_modules,
+                                        memory_order_acquire);
+  if (!modules ||
+      modules->generation !=
+          atomic_load(&unwind_table_generation, memory_order_acquire))
+    modules = RebuildModules(modules);
+  return modules;
+}
+
+// Checks with dl_iterate_phdr() whether a module was loaded or unloaded since
+// *modules was built, and rebuilds it if so. This walks all the modules under
+// the loader lock, so it is only done when a rule is not in the cache: the
+// cached rules are for code which was executing, and thus loaded, then.
+static void ValidateModules(UnwindTableModules **modules) {
+  if ((*modules)->modules_stamp == GetLoadedModulesStamp()) return;
+  // Only one of the threads noticing it needs to bump the generation.
+  u32 generation = (*modules)->generation;
+  atomic_compare_exchange_strong(&unwind_table_generation, &generation,
+                                 generation + 1, memory_order_acq_rel);
+  *modules = GetModules();
+}
+
+static const UnwindTableModule *FindModule(UnwindTableModules *modules,
+                                           uptr pc) {
+  uptr lo = 0, hi = modules->count;
+  while (lo < hi) {
+    uptr mid = (lo + hi) / 2;
+    if (modules->modules[mid].beg <= pc)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  if (lo == 0) return nullptr;
+  const UnwindTableModule *module = &modules->modules[lo - 1];
+  return pc < module->end ? module : nullptr;
+}
+
+static const u8 *FindFde(const UnwindTableModule *module, uptr pc) {
+  sptr rel_pc = pc - (uptr)module->hdr;
+  uptr lo = 0, hi = module->fde_count;
+  while (lo < hi) {
+    uptr mid = (lo + hi) / 2;
+    if (module->table[2 * mid] <= rel_pc)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  if (lo == 0) return nullptr;
+  return module->hdr + module->table[2 * (lo - 1) + 1];
+}
+
+//------------------------- Unwind rule cache ---------------------------------
+
+struct UnwindRuleCacheEntry {
+  atomic_uint32_t seq;  // Odd while the entry is being written.
+  u32 generation;
+  uptr pc;
+  UnwindRule rule;
+};
+
+static const uptr kUnwindRuleCacheSize = 1 << 12;
+static UnwindRuleCacheEntry unwind_rule_cache[kUnwindRuleCacheSize];
+
+static UnwindRuleCacheEntry *GetCacheEntry(uptr pc) {
+  return &unwind_rule_cache[(pc ^ (pc >> 12)) % kUnwindRuleCacheSize];
+}
+
+static bool LookupCachedRule(uptr pc, u32 generation, UnwindRule *rule) {
+  UnwindRuleCacheEntry *e = GetCacheEntry(pc);
+  u32 seq = atomic_load(&e->seq, memory_order_acquire);
+  if (seq & 1) return false;
+  bool found = e->pc == pc && e->generation == generation;
+  if (found) *rule = e->rule;
+  atomic_thread_fence(memory_order_acquire);
+  return found && atomic_load(&e->seq, memory_order_relaxed) == seq;
+}
+
+static void CacheRule(uptr pc, u32 generation, const UnwindRule &rule) {
+  UnwindRuleCacheEntry *e = GetCacheEntry(pc);
+  u32 seq = atomic_load(&e->seq, memory_order_relaxed);
+  // If another thread is writing the entry, just skip caching.
+  if ((seq & 1) ||
+      !atomic_compare_exchange_strong(&e->seq, &seq, seq + 1,
+                                      memory_order_acquire))
+    return;
+  e->pc = pc;
+  e->generation = generation;
+  e->rule = rule;
+  atomic_store(&e->seq, seq + 2, memory_order_release);
+}
+
+// Finds the rule for pc in the cache, or in *modules, which is validated
+// first unless *validated is set.
+static FindRuleResult FindUnwindRule(UnwindTableModules **modules,
+                                     bool *validated, uptr pc,
+                                     UnwindRule *rule) {
+  if (LookupCachedRule(pc, (*modules)->generation, rule)) return kRuleFound;
+  if (!*validated) {
+    ValidateModules(modules);
+    *validated = true;
+  }
+  u32 generation = (*modules)->generation;
+  const UnwindTableModule *module = FindModule(*modules, pc);
+  if (!module) return kNoRule;
+  const u8 *fde = FindFde(module, pc);
+  if (!fde) return kNoRule;
+  FindRuleResult res = ComputeUnwindRule(fde, pc, rule);
+  if (res == kRuleFound) CacheRule(pc, generation, *rule);
+  return res;
+}
+
+//------------------------- Unwinding -----------------------------------------
+
+void InvalidateUnwindTableCache() {
+  atomic_fetch_add(&unwind_table_generation, 1, memory_order_acq_rel);
+}
+
+// Unmaps the retired tables if no thread is inside UnwindWithTableCache().
+static void ReclaimUnwindTables() {
+  if (!atomic_load(&retired_unwind_tables, memory_order_relaxed)) return;
+  // Take the tables first: a thread could only have loaded them before they
+  // were retired, so if it still uses them, it is counted below.
+  UnwindTableModules *table = (UnwindTableModules *)atomic_exchange(
+      &retired_unwind_tables, 0, memory_order_seq_cst);
+  if (!table) return;
+  for (uptr i = 0; i < kActiveUnwindersStripes; i++) {
+    if (atomic_load(&active_unwinders[i].count, memory_order_seq_cst)) {
+      UnwindTableModules *last = table;
+      while (last->next_retired) last = last->next_retired;
+      RetireModules(table, last);
+      return;
+    }
+  }
+  while (table) {
+    UnwindTableModules *next = table->next_retired;
+    UnmapOrDie(table, table->mapped_size);
+    table = next;
+  }
+}
+
+NOINLINE
+uptr UnwindWithTableCache(uptr *buffer, uptr max_depth) {
+  uptr pc, sp, bp;
+  __asm__ __volatile__("leaq 0(%%rip), %0\n\t"
+                       "movq %%rsp, %1\n\t"
+                       "movq %%rbp, %2"
+                       : "=r"(pc), "=r"(sp), "=r"(bp));
+  atomic_uintptr_t *active_unwinders_count = GetActiveUnwindersCount(sp);
+  atomic_fetch_add(active_unwinders_count, 1, memory_order_seq_cst);
+  UnwindTableModules *modules = GetModules();
+  bool validated = false;
+  uptr size = 0;
+  // The first pc is exact, the others are return addresses, which may point
+  // past the end of the function if the call was the last instruction.
+  for (uptr lookup_pc = pc; size < max_depth; lookup_pc = pc - 1) {
+    buffer[size++] = pc;
+    UnwindRule rule;
+    FindRuleResult res =
+        FindUnwindRule(&modules, &validated, lookup_pc, &rule);
+    if (res == kNoRule) break;
+    if (res == kUnsupportedRule) {
+      size = 0;
+      break;
+    }
+    if (rule.ra_kind == kRuleUndefined) {
+      // The outermost frame. _Unwind_Backtrace() reports a zero return
+      // address for it, do the same so that both unwinders agree.
+      if (size < max_depth) buffer[size++] = 0;
+      break;
+    }
+    uptr cfa = (rule.cfa_reg == kRegSP ? sp : bp) + rule.cfa_offset;
+    // The stack grows down, so each caller's frame must be above the callee.
+    if (cfa <= sp) break;
+    pc = *(uptr *)(cfa + rule.ra_offset);
+    if (rule.bp_kind == kRuleOffset)
+      bp = *(uptr *)(cfa + rule.bp_offset);
+    else if (rule.bp_kind == kRuleUndefined)
+      bp = 0;
+    sp = cfa;
+    if (pc == 0) break;
+  }
+  atomic_fetch_sub(active_unwinders_count, 1, memory_order_release);
+  // The last thread to leave frees the tables replaced in the meantime.
+  ReclaimUnwindTables();
+  return size;
+}
+
+}  // namespace __sanitizer
+
+#endif  // (SANITIZER_FREEBSD || SANITIZER_LINUX) && !SANITIZER_ANDROID &&
+        // defined(__x86_64__)
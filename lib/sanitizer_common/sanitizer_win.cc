@@ -234,9 +234,9 @@ int CompareModulesBase(const void *pl, const void *pr) {
 #ifndef SANITIZER_GO
 void DumpProcessMap() {
   Report("Dumping process modules:\n");
-  InternalScopedBuffer<LoadedModule> modules(kMaxNumberOfModules);
-  uptr num_modules =
-      GetListOfModules(modules.data(), kMaxNumberOfModules, nullptr);
+  InternalMmapVector<LoadedModule> modules(/* initial_capacity */ 64);
+  GetListOfModules(&modules, nullptr);
+  uptr num_modules = modules.size();
 
   InternalScopedBuffer<ModuleInfo> module_infos(num_modules);
   for (size_t i = 0; i < num_modules; ++i) {
@@ -438,6 +438,10 @@ uptr GetListOfModules(LoadedModule *modules, uptr max_modules,
   return count;
 };
 
+u64 GetLoadedModulesStamp() {
+  return 0;
+}
+
 // We can't use atexit() directly at __asan_init time as the CRT is not fully
 // initialized at this point.  Place the functions into a vector and use
 // atexit() as soon as it is ready for use (i.e. after .CRT$XIC initializers).
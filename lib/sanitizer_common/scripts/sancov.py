@@ -19,6 +19,7 @@ def Usage():
       " " + prog_name + " print FILE [FILE...]\n" \
       " " + prog_name + " unpack FILE [FILE...]\n" \
       " " + prog_name + " rawunpack FILE [FILE ...]\n" \
+      " " + prog_name + " live FILE [FILE ...]\n" \
       " " + prog_name + " missing BINARY < LIST_OF_PCS\n"
   exit(1)
 
@@ -32,6 +33,7 @@ def TypeCodeForBits(bits):
 
 kMagic32SecondHalf = 0xFFFFFF32;
 kMagic64SecondHalf = 0xFFFFFF64;
+kMagicCompactSecondHalf = 0xFFFFFFC8;
 kMagicFirstHalf    = 0xC0BFFFFF;
 
 def MagicForBits(bits):
@@ -41,20 +43,41 @@ def MagicForBits(bits):
   else:
     return [kMagicFirstHalf, kMagic64SecondHalf if bits == 64 else kMagic32SecondHalf]
 
+# Returns the bitness of the offsets, or 0 for the compact format.
 def ReadMagicAndReturnBitness(f, path):
   magic_bytes = f.read(8)
   magic_words = struct.unpack('II', magic_bytes);
-  bits = 0
+  bits = -1
   idx = 1 if sys.byteorder == 'little' else 0
   if magic_words[idx] == kMagicFirstHalf:
     if magic_words[1-idx] == kMagic64SecondHalf:
       bits = 64
     elif magic_words[1-idx] == kMagic32SecondHalf:
       bits = 32
-  if bits == 0:
+    elif magic_words[1-idx] == kMagicCompactSecondHalf:
+      bits = 0
+  if bits == -1:
     raise Exception('Bad magic word in %s' % path)
   return bits
 
+# Decodes the ULEB128 deltas of the compact format.
+def ReadCompactOffsets(data, path):
+  s = []
+  offset = 0
+  delta = 0
+  shift = 0
+  for byte in bytearray(data):
+    delta |= (byte & 0x7f) << shift
+    shift += 7
+    if not byte & 0x80:
+      offset += delta
+      s.append(offset)
+      delta = 0
+      shift = 0
+  if shift:
+    raise Exception('Truncated offset in %s' % path)
+  return s
+
 def ReadOneFile(path):
   with open(path, mode="rb") as f:
     f.seek(0, 2)
@@ -64,6 +87,10 @@ def ReadOneFile(path):
       raise Exception('File %s is short (< 8 bytes)' % path)
     bits = ReadMagicAndReturnBitness(f, path)
     size -= 8
+    if bits == 0:
+      s = ReadCompactOffsets(f.read(size), path)
+      print >>sys.stderr, "%s: read %d compact PCs from %s" % (prog_name, len(s), path)
+      return s
     s = array.array(TypeCodeForBits(bits), f.read(size))
   print >>sys.stderr, "%s: read %d %d-bit PCs from %s" % (prog_name, size * 8 / bits, bits, path)
   return s
@@ -179,6 +206,33 @@ def RawUnpack(files):
     f_map = f[:-3] + 'map'
     UnpackOneRawFile(f, f_map)
 
+kLiveMagic = 0xC0BFFFFFFFFF11FE
+kLiveHeader = 'QIIQQQ24x'
+
+def PrintLiveFile(path):
+  # The file is concurrently written by the running process, so num_blocks
+  # and num_covered may be slightly out of sync with the bitmap.
+  with open(path, mode="rb") as f:
+    header = f.read(struct.calcsize(kLiveHeader))
+    if len(header) < struct.calcsize(kLiveHeader):
+      raise Exception('File %s is short' % path)
+    magic, version, header_size, pid, num_blocks, num_covered = \
+        struct.unpack(kLiveHeader, header)
+    if magic != kLiveMagic:
+      raise Exception('Bad magic word in %s' % path)
+    if version != 1:
+      raise Exception('Unsupported version %d in %s' % (version, path))
+    f.seek(header_size)
+    bitmap = f.read(num_blocks)
+  print "%s: pid %d: %d of %d blocks covered" % (path, pid,
+                                                 bitmap.count('\x01'),
+                                                 num_blocks)
+  print ''.join('1' if b == '\x01' else '0' for b in bitmap)
+
+def PrintLive(files):
+  for f in files:
+    PrintLiveFile(f)
+
 def GetInstrumentedPCs(binary):
   # This looks scary, but all it does is extract all offsets where we call:
   # - __sanitizer_cov() or __sanitizer_cov_with_check(),
@@ -237,5 +291,7 @@ if __name__ == '__main__':
     Unpack(file_list)
   elif sys.argv[1] == "rawunpack":
     RawUnpack(file_list)
+  elif sys.argv[1] == "live":
+    PrintLive(file_list)
   else:
     Usage()
@@ -652,6 +652,19 @@ void IterationTestCallback(uptr chunk, void *arg) {
   reinterpret_cast<std::set<uptr> *>(arg)->insert(chunk);
 }
 
+typedef std::vector<std::pair<uptr, uptr> > UserRanges;
+
+void UserRangeTestCallback(uptr begin, uptr end, void *arg) {
+  reinterpret_cast<UserRanges *>(arg)->push_back(std::make_pair(begin, end));
+}
+
+bool IsInUserRanges(const UserRanges &ranges, uptr p) {
+  for (uptr i = 0; i < ranges.size(); i++)
+    if (ranges[i].first <= p && p < ranges[i].second)
+      return true;
+  return false;
+}
+
 template <class Allocator>
 void TestSizeClassAllocatorIteration() {
   Allocator *a = new Allocator;
@@ -680,14 +693,18 @@ void TestSizeClassAllocatorIteration() {
   }
 
   std::set<uptr> reported_chunks;
+  UserRanges user_ranges;
   a->ForceLock();
   a->ForEachChunk(IterationTestCallback, &reported_chunks);
+  a->ForEachUserRange(UserRangeTestCallback, &user_ranges);
   a->ForceUnlock();
 
   for (uptr i = 0; i < allocated.size(); i++) {
     // Don't use EXPECT_NE. Reporting the first mismatch is enough.
     ASSERT_NE(reported_chunks.find(reinterpret_cast<uptr>(allocated[i])),
               reported_chunks.end());
+    ASSERT_TRUE(
+        IsInUserRanges(user_ranges, reinterpret_cast<uptr>(allocated[i])));
   }
 
   a->TestOnlyUnmap();
@@ -718,14 +735,19 @@ TEST(SanitizerCommon, LargeMmapAllocatorIteration) {
     allocated[i] = (char *)a.Allocate(&stats, size, 1);
 
   std::set<uptr> reported_chunks;
+  UserRanges user_ranges;
   a.ForceLock();
   a.ForEachChunk(IterationTestCallback, &reported_chunks);
+  a.ForEachUserRange(UserRangeTestCallback, &user_ranges);
   a.ForceUnlock();
 
+  EXPECT_EQ(kNumAllocs, user_ranges.size());
   for (uptr i = 0; i < kNumAllocs; i++) {
     // Don't use EXPECT_NE. Reporting the first mismatch is enough.
     ASSERT_NE(reported_chunks.find(reinterpret_cast<uptr>(allocated[i])),
               reported_chunks.end());
+    ASSERT_TRUE(IsInUserRanges(user_ranges,
+                               reinterpret_cast<uptr>(allocated[i]) + size - 1));
   }
   for (uptr i = 0; i < kNumAllocs; i++)
     a.Deallocate(&stats, allocated[i]);
@@ -0,0 +1,219 @@
+//===-- sanitizer_coverage_test.cc ----------------------------------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Tests for the sanitizer coverage runtime.
+//
+//===----------------------------------------------------------------------===//
+#include "sanitizer_common/sanitizer_internal_defs.h"
+#include "sanitizer/coverage_interface.h"
+#include "sanitizer_pthread_wrappers.h"
+#include "gtest/gtest.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+extern "C" {
+void __sanitizer_cov_module_init(__sanitizer::s32 *guards, __sanitizer::uptr npcs,
+                                 __sanitizer::u8 *counters,
+                                 const char *comp_unit_name);
+void __sanitizer_cov_trace_cmp(__sanitizer::u64 SizeAndType,
+                               __sanitizer::u64 Arg1, __sanitizer::u64 Arg2);
+void __sanitizer_cov_trace_switch(__sanitizer::u64 Val,
+                                  __sanitizer::u64 *Cases);
+}
+
+namespace __sanitizer {
+
+#if SANITIZER_CAN_TRACE_CMP
+static const u64 kICmpEq = 32;  // llvm::CmpInst::ICMP_EQ
+static const u64 kICmpUlt = 36;  // llvm::CmpInst::ICMP_ULT
+
+static uptr GetCmpTrace(const __sanitizer_cmp_trace_entry **entries) {
+  return __sanitizer_get_cmp_trace(entries);
+}
+
+TEST(SanitizerCoverage, TraceCmp) {
+  const __sanitizer_cmp_trace_entry *entries;
+  __sanitizer_reset_cmp_trace();
+  EXPECT_EQ(0U, GetCmpTrace(&entries));
+
+  __sanitizer_cov_trace_cmp((32ULL << 32) | kICmpEq, 0x12345678, 0x87654321);
+  __sanitizer_cov_trace_cmp((8ULL << 32) | kICmpUlt, 1, 2);
+  ASSERT_EQ(2U, GetCmpTrace(&entries));
+  EXPECT_NE(0U, entries[0].pc);
+  EXPECT_EQ(0x12345678U, entries[0].arg1);
+  EXPECT_EQ(0x87654321U, entries[0].arg2);
+  EXPECT_EQ(32U, entries[0].size);
+  EXPECT_EQ(kICmpEq, entries[0].type);
+  EXPECT_EQ(1U, entries[1].arg1);
+  EXPECT_EQ(2U, entries[1].arg2);
+  EXPECT_EQ(8U, entries[1].size);
+  EXPECT_EQ(kICmpUlt, entries[1].type);
+
+  __sanitizer_reset_cmp_trace();
+  EXPECT_EQ(0U, GetCmpTrace(&entries));
+}
+
+TEST(SanitizerCoverage, TraceCmpWrapsAround) {
+  const __sanitizer_cmp_trace_entry *entries;
+  __sanitizer_reset_cmp_trace();
+  for (u64 i = 0; i < 1000; i++)
+    __sanitizer_cov_trace_cmp((64ULL << 32) | kICmpEq, i, 1000);
+  uptr n = GetCmpTrace(&entries);
+  EXPECT_EQ(128U, n);
+  // Only the most recent comparisons are kept.
+  for (uptr i = 0; i < n; i++)
+    EXPECT_GE(entries[i].arg1, 1000U - n);
+  __sanitizer_reset_cmp_trace();
+}
+
+TEST(SanitizerCoverage, TraceSwitch) {
+  const __sanitizer_cmp_trace_entry *entries;
+  __sanitizer_reset_cmp_trace();
+  u64 cases[] = {4, 32, 10, 1000, 95, 100};
+  __sanitizer_cov_trace_switch(90, cases);
+  __sanitizer_cov_trace_switch(1000, cases);
+  u64 no_cases[] = {0, 32};
+  __sanitizer_cov_trace_switch(1, no_cases);
+  ASSERT_EQ(2U, GetCmpTrace(&entries));
+  EXPECT_EQ(90U, entries[0].arg1);
+  EXPECT_EQ(95U, entries[0].arg2);
+  EXPECT_EQ(32U, entries[0].size);
+  EXPECT_EQ(0U, entries[0].type);
+  EXPECT_EQ(1000U, entries[1].arg1);
+  EXPECT_EQ(1000U, entries[1].arg2);
+  __sanitizer_reset_cmp_trace();
+}
+
+static void *TraceCmpThread(void *arg) {
+  const __sanitizer_cmp_trace_entry *entries;
+  EXPECT_EQ(0U, GetCmpTrace(&entries));
+  __sanitizer_cov_trace_cmp((32ULL << 32) | kICmpEq, 7, 8);
+  EXPECT_EQ(1U, GetCmpTrace(&entries));
+  return nullptr;
+}
+
+TEST(SanitizerCoverage, TraceCmpIsPerThread) {
+  const __sanitizer_cmp_trace_entry *entries;
+  __sanitizer_reset_cmp_trace();
+  __sanitizer_cov_trace_cmp((32ULL << 32) | kICmpEq, 1, 2);
+  __sanitizer_cov_trace_cmp((32ULL << 32) | kICmpEq, 3, 4);
+  pthread_t thread;
+  PTHREAD_CREATE(&thread, nullptr, TraceCmpThread, nullptr);
+  PTHREAD_JOIN(thread, nullptr);
+  ASSERT_EQ(2U, GetCmpTrace(&entries));
+  EXPECT_EQ(3U, entries[1].arg1);
+  __sanitizer_reset_cmp_trace();
+}
+
+#endif  // SANITIZER_CAN_TRACE_CMP
+
+static u8 *MapZeroed(uptr size) {
+  void *p = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  CHECK_NE(p, MAP_FAILED);
+  return (u8 *)p;
+}
+
+// The 8-bit counters of a fake module. Registered once, the runtime can't
+// forget about the counters.
+static const uptr kNumCounters = 1 << 22;
+
+static u8 *GetCounters() {
+  static u8 *counters;
+  if (!counters) {
+    counters = MapZeroed(kNumCounters);
+    s32 *guards = (s32 *)MapZeroed((kNumCounters + 1) * sizeof(s32));
+    __sanitizer_cov_module_init(guards, kNumCounters, counters, "counters");
+  }
+  EXPECT_EQ(kNumCounters, __sanitizer_get_number_of_counters());
+  return counters;
+}
+
+// The original scalar implementation of
+// __sanitizer_update_counter_bitset_and_clear_counters.
+static uptr ReferenceUpdateCounterBitset(u8 *counters, u8 *bitset, uptr n) {
+  uptr num_new_bits = 0;
+  for (uptr j = 0; j < n; j += 8) {
+    u64 *pc64 = reinterpret_cast<u64*>(counters + j);
+    u64 *pb64 = reinterpret_cast<u64*>(bitset + j);
+    u64 c64 = *pc64;
+    u64 new_bits_64 = *pb64;
+    if (c64) {
+      *pc64 = 0;
+      for (uptr k = 0; k < 8; k++) {
+        u64 x = (c64 >> (8 * k)) & 0xff;
+        if (x) {
+          u64 bit = 0;
+          /**/ if (x >= 128) bit = 128;
+          else if (x >= 32) bit = 64;
+          else if (x >= 16) bit = 32;
+          else if (x >= 8) bit = 16;
+          else if (x >= 4) bit = 8;
+          else if (x >= 3) bit = 4;
+          else if (x >= 2) bit = 2;
+          else if (x >= 1) bit = 1;
+          u64 mask = bit << (8 * k);
+          if (!(new_bits_64 & mask)) {
+            num_new_bits++;
+            new_bits_64 |= mask;
+          }
+        }
+      }
+      *pb64 = new_bits_64;
+    }
+  }
+  return num_new_bits;
+}
+
+// Sets every 1/density-th counter (on average) to a random value.
+static void FillCounters(u8 *counters, uptr density, unsigned *seed) {
+  for (uptr i = 0; i < kNumCounters / density; i++)
+    counters[rand_r(seed) % kNumCounters] = rand_r(seed) % 256;
+}
+
+TEST(SanitizerCoverage, UpdateCounterBitset) {
+  u8 *counters = GetCounters();
+  u8 *counters_copy = MapZeroed(kNumCounters);
+  u8 *bitset = MapZeroed(kNumCounters);
+  u8 *ref_bitset = MapZeroed(kNumCounters);
+  unsigned seed = 42;
+  EXPECT_EQ(0U, __sanitizer_update_counter_bitset_and_clear_counters(bitset));
+
+  uptr densities[] = {1, 3, 100, 10000, kNumCounters};
+  for (uptr round = 0; round < 20; round++) {
+    FillCounters(counters, densities[round % ARRAY_SIZE(densities)], &seed);
+    memcpy(counters_copy, counters, kNumCounters);
+    uptr ref_new_bits =
+        ReferenceUpdateCounterBitset(counters_copy, ref_bitset, kNumCounters);
+    EXPECT_EQ(ref_new_bits,
+              __sanitizer_update_counter_bitset_and_clear_counters(bitset));
+    EXPECT_EQ(0, memcmp(ref_bitset, bitset, kNumCounters));
+    EXPECT_EQ(0, memcmp(counters_copy, counters, kNumCounters));
+  }
+
+  // Every counter value maps to exactly one bit.
+  memset(bitset, 0, kNumCounters);
+  for (uptr i = 0; i < kNumCounters; i++)
+    counters[i] = i % 256;
+  __sanitizer_update_counter_bitset_and_clear_counters(bitset);
+  for (uptr i = 0; i < 256; i++) {
+    u64 counter = i, expected = 0;
+    ReferenceUpdateCounterBitset((u8 *)&counter, (u8 *)&expected, 8);
+    EXPECT_EQ(expected, bitset[i]) << i;
+  }
+
+  __sanitizer_update_counter_bitset_and_clear_counters(nullptr);
+  munmap(ref_bitset, kNumCounters);
+  munmap(bitset, kNumCounters);
+  munmap(counters_copy, kNumCounters);
+}
+
+}  // namespace __sanitizer
@@ -11,6 +11,7 @@
 //
 //===----------------------------------------------------------------------===//
 #include "sanitizer_common/sanitizer_stackdepot.h"
+#include "sanitizer_common/sanitizer_flags.h"
 #include "sanitizer_common/sanitizer_internal_defs.h"
 #include "sanitizer_common/sanitizer_libc.h"
 #include "gtest/gtest.h"
@@ -65,28 +66,87 @@ TEST(SanitizerCommon, StackDepotSeveral) {
   EXPECT_NE(i1, i2);
 }
 
-TEST(SanitizerCommon, StackDepotReverseMap) {
-  uptr array1[] = {1, 2, 3, 4, 5};
-  uptr array2[] = {7, 1, 3, 0};
-  uptr array3[] = {10, 2, 5, 3};
-  uptr array4[] = {1, 3, 2, 5};
-  u32 ids[4] = {0};
-  StackTrace s1(array1, ARRAY_SIZE(array1));
-  StackTrace s2(array2, ARRAY_SIZE(array2));
-  StackTrace s3(array3, ARRAY_SIZE(array3));
-  StackTrace s4(array4, ARRAY_SIZE(array4));
-  ids[0] = StackDepotPut(s1);
-  ids[1] = StackDepotPut(s2);
-  ids[2] = StackDepotPut(s3);
-  ids[3] = StackDepotPut(s4);
+TEST(SanitizerCommon, StackDepotGetMany) {
+  const uptr kNumStacks = 100000;
+  uptr array[] = {1, 2, 3, 4, 0};
+  InternalMmapVector<u32> ids(kNumStacks);
+  for (uptr i = 0; i < kNumStacks; i++) {
+    array[4] = i + 100;
+    ids.push_back(StackDepotPut(StackTrace(array, ARRAY_SIZE(array))));
+  }
+  for (uptr i = 0; i < kNumStacks; i++) {
+    StackTrace stack = StackDepotGet(ids[i]);
+    ASSERT_EQ(ARRAY_SIZE(array), stack.size);
+    EXPECT_EQ(1U, stack.trace[0]);
+    EXPECT_EQ(i + 100, stack.trace[4]);
+  }
+}
 
-  StackDepotReverseMap map;
+class ScopedStackDepotMode {
+ public:
+  explicit ScopedStackDepotMode(bool compact) {
+    old_compact_ = common_flags()->compact_stack_depot;
+    SetCompact(compact);
+  }
+  ~ScopedStackDepotMode() { SetCompact(old_compact_); }
 
-  for (uptr i = 0; i < 4; i++) {
-    StackTrace stack = StackDepotGet(ids[i]);
-    StackTrace from_map = map.Get(ids[i]);
-    EXPECT_EQ(stack.size, from_map.size);
-    EXPECT_EQ(stack.trace, from_map.trace);
+ private:
+  static void SetCompact(bool compact) {
+    CommonFlags cf;
+    cf.CopyFrom(*common_flags());
+    cf.compact_stack_depot = compact;
+    OverrideCommonFlags(cf);
+  }
+  bool old_compact_;
+};
+
+TEST(SanitizerCommon, CompactStackDepotBasic) {
+  ScopedStackDepotMode compact(true);
+  uptr array[] = {1, 2, 3, 4, 5};
+  u32 i1 = StackDepotPut(StackTrace(array, ARRAY_SIZE(array)));
+  EXPECT_NE(0U, i1);
+  EXPECT_EQ(i1, StackDepotPut(StackTrace(array, ARRAY_SIZE(array))));
+  StackTrace stack = StackDepotGet(i1);
+  EXPECT_EQ(ARRAY_SIZE(array), stack.size);
+  EXPECT_EQ(0, internal_memcmp(stack.trace, array, sizeof(array)));
+  EXPECT_EQ(0U, StackDepotPut(StackTrace()));
+  EXPECT_EQ((uptr*)0, StackDepotGet(0).trace);
+}
+
+TEST(SanitizerCommon, CompactStackDepotSharedFrames) {
+  ScopedStackDepotMode compact(true);
+  const uptr kSize = 50;
+  uptr array1[kSize], array2[kSize], array3[kSize];
+  for (uptr i = 0; i < kSize; i++)
+    array1[i] = array2[i] = array3[i] = 1000 + i;
+  // array2 differs in the innermost frame, array3 in an outer frame.
+  array2[0] = 1;
+  array3[40] = 1;
+  u32 ids[] = {StackDepotPut(StackTrace(array1, kSize)),
+               StackDepotPut(StackTrace(array2, kSize)),
+               StackDepotPut(StackTrace(array3, kSize)),
+               StackDepotPut(StackTrace(array1, kSize / 2)),
+               StackDepotPut(StackTrace(array1 + kSize / 2, kSize / 2)),
+               StackDepotPut(StackTrace(array1, kSize, 1))};
+  const uptr *traces[] = {array1, array2, array3, array1, array1 + kSize / 2,
+                          array1};
+  uptr sizes[] = {kSize, kSize, kSize, kSize / 2, kSize / 2, kSize};
+  u32 tags[] = {0, 0, 0, 0, 0, 1};
+  for (uptr i = 0; i < ARRAY_SIZE(ids); i++) {
+    for (uptr j = 0; j < i; j++)
+      EXPECT_NE(ids[i], ids[j]);
+    // Retrieve twice, the second time the trace is already materialized.
+    // Materialized traces are counted in the stats.
+    for (int k = 0; k < 2; k++) {
+      uptr allocated = StackDepotGetStats()->allocated;
+      StackTrace stack = StackDepotGet(ids[i]);
+      EXPECT_EQ(allocated + (k == 0 ? sizes[i] * sizeof(uptr) : 0),
+                StackDepotGetStats()->allocated);
+      ASSERT_EQ(sizes[i], stack.size);
+      EXPECT_EQ(tags[i], stack.tag);
+      EXPECT_EQ(0, internal_memcmp(stack.trace, traces[i],
+                                   sizes[i] * sizeof(uptr)));
+    }
   }
 }
 
@@ -107,6 +107,17 @@ TEST(SanitizerStacktracePrinter, RenderFrame) {
   EXPECT_STREQ("(/path/to/module+0x200)", str.data());
   str.clear();
 
+  RenderFrame(&str, "%b%B", frame_no, info, false);
+  EXPECT_STREQ("", str.data());
+  str.clear();
+
+  info.module_build_id = internal_strdup("0123456789abcdef");
+  RenderFrame(&str, "%b %L %B", frame_no, info, false);
+  EXPECT_STREQ("0123456789abcdef (/path/to/module+0x200) "
+               "(BuildId: 0123456789abcdef)",
+               str.data());
+  str.clear();
+
   info.function = internal_strdup("my_function");
   RenderFrame(&str, "%F", frame_no, info, false);
   EXPECT_STREQ("in my_function", str.data());
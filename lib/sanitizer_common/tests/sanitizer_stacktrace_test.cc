@@ -15,6 +15,8 @@
 #include "sanitizer_common/sanitizer_stacktrace.h"
 #include "gtest/gtest.h"
 
+#include <stdlib.h>
+
 namespace __sanitizer {
 
 class FastUnwindTest : public ::testing::Test {
@@ -151,4 +153,82 @@ TEST(SlowUnwindTest, ShortStackTrace) {
   EXPECT_EQ(bp, stack.top_frame_bp);
 }
 
+#if SANITIZER_CAN_UNWIND_WITH_TABLE_CACHE
+struct UnwindResults {
+  uptr cache[kStackTraceMax];
+  uptr cache_size;
+  uptr libgcc[kStackTraceMax];
+  uptr libgcc_size;
+};
+
+static NOINLINE void UnwindBoth(UnwindResults *res) {
+  res->cache_size = UnwindWithTableCache(res->cache, kStackTraceMax);
+  res->libgcc_size = UnwindWithLibgcc(res->libgcc, kStackTraceMax);
+}
+
+// The first two frames are in the unwinders and in UnwindBoth(), and differ.
+static void ExpectSameTraces(const UnwindResults &res) {
+  ASSERT_GT(res.cache_size, 2U);
+  ASSERT_EQ(res.libgcc_size, res.cache_size);
+  for (uptr i = 2; i < res.cache_size; i++)
+    EXPECT_EQ(res.libgcc[i], res.cache[i]) << "frame " << i;
+}
+
+static volatile int recursion_sink;
+
+static NOINLINE void Recurse(int depth, UnwindResults *res) {
+  if (depth == 0)
+    UnwindBoth(res);
+  else
+    Recurse(depth - 1, res);
+  recursion_sink = depth;  // Prevent tail call optimization.
+}
+
+TEST(UnwindTableCacheTest, SameAsLibgcc) {
+  UnwindResults res;
+  for (int depth = 0; depth < 50; depth += 7) {
+    Recurse(depth, &res);
+    ExpectSameTraces(res);
+  }
+  // Unwind once more, now with the cached rules.
+  Recurse(10, &res);
+  ExpectSameTraces(res);
+}
+
+static UnwindResults *qsort_results;
+
+static int CompareAndUnwind(const void *a, const void *b) {
+  if (qsort_results) {
+    UnwindBoth(qsort_results);
+    qsort_results = nullptr;
+  }
+  return *(const int *)a - *(const int *)b;
+}
+
+TEST(UnwindTableCacheTest, ThroughLibc) {
+  UnwindResults res;
+  int array[] = {5, 3, 1, 4, 2};
+  qsort_results = &res;
+  qsort(array, ARRAY_SIZE(array), sizeof(array[0]), CompareAndUnwind);
+  ASSERT_EQ(nullptr, qsort_results);
+  ExpectSameTraces(res);
+}
+
+TEST(UnwindTableCacheTest, Invalidate) {
+  UnwindResults res;
+  for (int i = 0; i < 3; i++) {
+    Recurse(5, &res);
+    ExpectSameTraces(res);
+    InvalidateUnwindTableCache();
+  }
+}
+
+TEST(UnwindTableCacheTest, MaxDepth) {
+  uptr buffer[kStackTraceMax];
+  EXPECT_EQ(3U, UnwindWithTableCache(buffer, 3));
+  EXPECT_EQ(1U, UnwindWithTableCache(buffer, 1));
+  EXPECT_EQ(0U, UnwindWithTableCache(buffer, 0));
+}
+#endif  // SANITIZER_CAN_UNWIND_WITH_TABLE_CACHE
+
 }  // namespace __sanitizer
@@ -189,6 +189,50 @@ TEST(StopTheWorld, SuspendThreadsAdvanced) {
   pthread_mutex_destroy(&advanced_incrementer_thread_exit_mutex);
 }
 
+// Spawn many sleeping threads and check that all of them get suspended.
+static pthread_mutex_t sleeper_thread_exit_mutex;
+
+void *SleeperThread(void *argument) {
+  pthread_mutex_lock(&sleeper_thread_exit_mutex);
+  pthread_mutex_unlock(&sleeper_thread_exit_mutex);
+  return NULL;
+}
+
+void CountThreadsCallback(const SuspendedThreadsList &suspended_threads_list,
+                          void *argument) {
+  *(uptr *)argument = suspended_threads_list.thread_count();
+}
+
+// Returns the number of suspended threads.
+static uptr StopTheWorldWithSleepers(uptr num_threads) {
+  pthread_mutex_init(&sleeper_thread_exit_mutex, NULL);
+  pthread_mutex_lock(&sleeper_thread_exit_mutex);
+  pthread_attr_t attr;
+  pthread_attr_init(&attr);
+  pthread_attr_setstacksize(&attr, 1 << 16);
+  pthread_t *thread_ids = new pthread_t[num_threads];
+  uptr num_created = 0;
+  for (; num_created < num_threads; num_created++)
+    if (pthread_create(&thread_ids[num_created], &attr, SleeperThread, NULL))
+      break;
+  EXPECT_EQ(num_threads, num_created);
+  uptr suspended_count = 0;
+  StopTheWorld(&CountThreadsCallback, &suspended_count);
+  pthread_mutex_unlock(&sleeper_thread_exit_mutex);
+  for (uptr i = 0; i < num_created; i++)
+    EXPECT_EQ(0, pthread_join(thread_ids[i], NULL));
+  delete[] thread_ids;
+  pthread_attr_destroy(&attr);
+  pthread_mutex_destroy(&sleeper_thread_exit_mutex);
+  return suspended_count;
+}
+
+TEST(StopTheWorld, SuspendManyThreads) {
+  const uptr kNumThreads = 500;
+  // The main thread is suspended as well.
+  EXPECT_EQ(kNumThreads + 1, StopTheWorldWithSleepers(kNumThreads));
+}
+
 static void SegvCallback(const SuspendedThreadsList &suspended_threads_list,
                          void *argument) {
   *(volatile int*)0x1234 = 0;
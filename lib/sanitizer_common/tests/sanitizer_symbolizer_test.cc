@@ -12,9 +12,15 @@
 //===----------------------------------------------------------------------===//
 
 #include "sanitizer_common/sanitizer_allocator_internal.h"
+#include "sanitizer_common/sanitizer_flags.h"
+#include "sanitizer_common/sanitizer_symbolizer_elf.h"
 #include "sanitizer_common/sanitizer_symbolizer_internal.h"
 #include "gtest/gtest.h"
 
+#if SANITIZER_LINUX && !SANITIZER_ANDROID
+#include <dlfcn.h>
+#endif
+
 namespace __sanitizer {
 
 TEST(Symbolizer, ExtractToken) {
@@ -55,4 +61,258 @@ TEST(Symbolizer, ExtractTokenUpToDelimiter) {
   InternalFree(token);
 }
 
+static NOINLINE void SymbolizerCacheTestFunction() {
+  // Make the function big enough to symbolize a lot of PCs inside of it.
+  volatile int x = 0;
+  for (int i = 0; i < 10; i++) x += i;
+}
+
+static void ExpectSameFrames(SymbolizedStack *a, SymbolizedStack *b) {
+  for (; a && b; a = a->next, b = b->next) {
+    EXPECT_EQ(a->info.address, b->info.address);
+    EXPECT_STREQ(a->info.module, b->info.module);
+    EXPECT_EQ(a->info.module_offset, b->info.module_offset);
+    if (a->info.function || b->info.function)
+      EXPECT_STREQ(a->info.function, b->info.function);
+    if (a->info.file || b->info.file)
+      EXPECT_STREQ(a->info.file, b->info.file);
+    EXPECT_EQ(a->info.line, b->info.line);
+  }
+  EXPECT_EQ(nullptr, a);
+  EXPECT_EQ(nullptr, b);
+}
+
+TEST(Symbolizer, ResultCache) {
+  Symbolizer *symbolizer = Symbolizer::GetOrInit();
+  uptr pc = (uptr)&SymbolizerCacheTestFunction + 1;
+  symbolizer->Flush();
+  SymbolizerCacheStats before, after;
+  symbolizer->GetCacheStats(&before);
+  EXPECT_EQ(0U, before.size);
+
+  SymbolizedStack *first = symbolizer->SymbolizePC(pc);
+  SymbolizedStack *second = symbolizer->SymbolizePC(pc);
+  symbolizer->GetCacheStats(&after);
+  EXPECT_EQ(before.misses + 1, after.misses);
+  EXPECT_EQ(before.hits + 1, after.hits);
+  EXPECT_EQ(1U, after.size);
+  // The caller owns the result, the cache has its own copy.
+  EXPECT_NE(first, second);
+  ExpectSameFrames(first, second);
+  first->ClearAll();
+  second->ClearAll();
+
+  symbolizer->Flush();
+  symbolizer->GetCacheStats(&after);
+  EXPECT_EQ(0U, after.size);
+  symbolizer->SymbolizePC(pc)->ClearAll();
+  symbolizer->GetCacheStats(&after);
+  EXPECT_EQ(before.misses + 2, after.misses);
+}
+
+static int symbolizer_cache_test_global;
+
+TEST(Symbolizer, ResultCacheData) {
+  Symbolizer *symbolizer = Symbolizer::GetOrInit();
+  uptr addr = (uptr)&symbolizer_cache_test_global;
+  DataInfo first, second;
+  ASSERT_TRUE(symbolizer->SymbolizeData(addr, &first));
+  SymbolizerCacheStats before, after;
+  symbolizer->GetCacheStats(&before);
+  ASSERT_TRUE(symbolizer->SymbolizeData(addr, &second));
+  symbolizer->GetCacheStats(&after);
+  EXPECT_EQ(before.hits + 1, after.hits);
+  EXPECT_STREQ(first.module, second.module);
+  EXPECT_EQ(first.module_offset, second.module_offset);
+  if (first.name || second.name)
+    EXPECT_STREQ(first.name, second.name);
+  EXPECT_EQ(first.start, second.start);
+  EXPECT_EQ(first.size, second.size);
+  first.Clear();
+  second.Clear();
+}
+
+TEST(Symbolizer, ResultCacheEviction) {
+  Symbolizer *symbolizer = Symbolizer::GetOrInit();
+  symbolizer->Flush();
+  uptr capacity = common_flags()->symbolize_cache_size;
+  uptr pc = (uptr)&SymbolizerCacheTestFunction;
+  for (uptr i = 0; i < capacity + 10; i++)
+    symbolizer->SymbolizePC(pc + i)->ClearAll();
+  SymbolizerCacheStats before, after;
+  symbolizer->GetCacheStats(&before);
+  EXPECT_EQ(capacity, before.size);
+  EXPECT_LE(10U, before.evictions);
+  // The least recently used PCs are gone, the most recent ones are cached.
+  symbolizer->SymbolizePC(pc + capacity + 9)->ClearAll();
+  symbolizer->GetCacheStats(&after);
+  EXPECT_EQ(before.hits + 1, after.hits);
+  symbolizer->SymbolizePC(pc)->ClearAll();
+  symbolizer->GetCacheStats(&after);
+  EXPECT_EQ(before.misses + 1, after.misses);
+  symbolizer->Flush();
+}
+
+#if SANITIZER_LINUX && !SANITIZER_ANDROID
+TEST(Symbolizer, BuildId) {
+  uptr pc = (uptr)&SymbolizerCacheTestFunction + 1;
+  LoadedModule *module = Symbolizer::GetOrInit()->FindModuleForAddress(pc);
+  ASSERT_NE(nullptr, module);
+  // The toolchains we support emit build IDs by default.
+  const char *build_id = module->build_id();
+  if (!build_id)
+    return;
+  EXPECT_EQ(0U, internal_strlen(build_id) % 2);
+  for (const char *p = build_id; *p; p++)
+    EXPECT_TRUE((*p >= '0' && *p <= '9') || (*p >= 'a' && *p <= 'f'));
+  SymbolizedStack *stack = Symbolizer::GetOrInit()->SymbolizePC(pc);
+  EXPECT_STREQ(build_id, stack->info.module_build_id);
+  stack->ClearAll();
+}
+#endif
+
+TEST(Symbolizer, ModuleListInvalidation) {
+  Symbolizer *symbolizer = Symbolizer::GetOrInit();
+  uptr pc = (uptr)&SymbolizerCacheTestFunction + 1;
+  symbolizer->Flush();
+  symbolizer->SymbolizePC(pc)->ClearAll();
+  LoadedModule *module = symbolizer->FindModuleForAddress(pc);
+  ASSERT_NE(nullptr, module);
+  EXPECT_LE(module->base_address(), pc);
+
+  // The module is still loaded, so it survives a refresh of the list along
+  // with the cached results for it.
+  Symbolizer::InvalidateModuleList();
+  SymbolizerCacheStats before, after;
+  symbolizer->GetCacheStats(&before);
+  symbolizer->SymbolizePC(pc)->ClearAll();
+  symbolizer->GetCacheStats(&after);
+  EXPECT_EQ(before.hits + 1, after.hits);
+  EXPECT_EQ(module, symbolizer->FindModuleForAddress(pc));
+  EXPECT_EQ(nullptr, symbolizer->FindModuleForAddress(0));
+}
+
+#if SANITIZER_LINUX && !SANITIZER_ANDROID
+TEST(Symbolizer, FindModuleAfterDlopen) {
+  Symbolizer *symbolizer = Symbolizer::GetOrInit();
+  uptr pc = (uptr)&SymbolizerCacheTestFunction + 1;
+  EXPECT_NE(nullptr, symbolizer->FindModuleForAddress(pc));
+  // No dlopen() interceptor here, the symbolizer has to notice the new module
+  // by itself.
+  void *lib = dlopen("libz.so.1", RTLD_NOW);
+  if (!lib)
+    return;
+  void *fn = dlsym(lib, "zlibVersion");
+  ASSERT_NE(nullptr, fn);
+  LoadedModule *module = symbolizer->FindModuleForAddress((uptr)fn);
+  ASSERT_NE(nullptr, module);
+  EXPECT_NE(nullptr, internal_strstr(module->full_name(), "libz"));
+  dlclose(lib);
+}
+#endif
+
+#if SANITIZER_LINUX && !SANITIZER_ANDROID
+TEST(ElfSymbolizer, SymbolizePC) {
+  uptr pc = (uptr)&SymbolizerCacheTestFunction + 1;
+  const char *module_name;
+  uptr module_offset;
+  ASSERT_TRUE(Symbolizer::GetOrInit()->GetModuleNameAndOffsetForPC(
+      pc, &module_name, &module_offset));
+  ElfSymbolizer symbolizer;
+  SymbolizedStack *stack = SymbolizedStack::New(pc);
+  stack->info.FillModuleInfo(module_name, module_offset);
+  ASSERT_TRUE(symbolizer.SymbolizePC(pc, stack));
+  ASSERT_NE(nullptr, stack->info.function);
+  EXPECT_NE(nullptr,
+            internal_strstr(stack->info.function, "SymbolizerCacheTestFunction"));
+  EXPECT_EQ(1U, stack->info.function_offset);
+  EXPECT_EQ(nullptr, stack->info.file);
+  stack->ClearAll();
+
+  // Unknown modules are left to the next tool.
+  stack = SymbolizedStack::New(pc);
+  stack->info.FillModuleInfo("/nonexistent/module", module_offset);
+  EXPECT_FALSE(symbolizer.SymbolizePC(pc, stack));
+  stack->ClearAll();
+  symbolizer.Flush();
+}
+
+TEST(ElfSymbolizer, SymbolizeData) {
+  uptr addr = (uptr)&symbolizer_cache_test_global;
+  const char *module_name;
+  uptr module_offset;
+  ASSERT_TRUE(Symbolizer::GetOrInit()->GetModuleNameAndOffsetForPC(
+      addr, &module_name, &module_offset));
+  ElfSymbolizer symbolizer;
+  DataInfo info;
+  info.module = internal_strdup(module_name);
+  info.module_offset = module_offset;
+  ASSERT_TRUE(symbolizer.SymbolizeData(addr, &info));
+  EXPECT_STREQ("__sanitizer::symbolizer_cache_test_global", info.name);
+  EXPECT_EQ(addr, info.start);
+  EXPECT_EQ(sizeof(symbolizer_cache_test_global), info.size);
+  info.Clear();
+  symbolizer.Flush();
+}
+#endif
+
+TEST(Symbolizer, SymbolizePCs) {
+  Symbolizer *symbolizer = Symbolizer::GetOrInit();
+  const uptr kCount = 100;
+  uptr pcs[kCount];
+  SymbolizedStack *batch[kCount];
+  for (uptr i = 0; i < kCount; i++)
+    pcs[i] = (uptr)&SymbolizerCacheTestFunction + i % 50;
+  symbolizer->Flush();
+  symbolizer->SymbolizePCs(pcs, kCount, batch);
+  symbolizer->Flush();
+  for (uptr i = 0; i < kCount; i++) {
+    SymbolizedStack *single = symbolizer->SymbolizePC(pcs[i]);
+    ExpectSameFrames(single, batch[i]);
+    single->ClearAll();
+    batch[i]->ClearAll();
+  }
+}
+
+#if SANITIZER_POSIX && !SANITIZER_MAC
+// Echoes the commands back, each command ends with an empty line just like
+// llvm-symbolizer responses.
+class EchoSymbolizerProcess : public SymbolizerProcess {
+ public:
+  EchoSymbolizerProcess() : SymbolizerProcess("/bin/cat") {}
+
+ private:
+  bool ReachedEndOfOutput(const char *buffer, uptr length) const override {
+    return length >= 2 && buffer[length - 1] == '\n' &&
+           buffer[length - 2] == '\n';
+  }
+  void GetArgV(const char *path_to_binary,
+               const char *(&argv)[kArgVMax]) const override {
+    argv[0] = path_to_binary;
+    argv[1] = nullptr;
+  }
+};
+
+TEST(Symbolizer, SendCommands) {
+  static EchoSymbolizerProcess process;
+  EXPECT_STREQ("hello\n\n", process.SendCommand("hello\n\n"));
+
+  // Many more commands than are sent ahead of the responses.
+  const uptr kCount = 1000;
+  InternalMmapVector<char> commands(1);
+  for (uptr i = 0; i < kCount; i++) {
+    char command[32];
+    internal_snprintf(command, sizeof(command), "command %zu\nline\n\n", i);
+    for (char *c = command; *c; c++)
+      commands.push_back(*c);
+    commands.push_back('\0');
+  }
+  InternalMmapVector<char> responses(1);
+  ASSERT_TRUE(process.SendCommands(commands.data(), kCount, &responses));
+  ASSERT_EQ(commands.size(), responses.size());
+  EXPECT_EQ(0, internal_memcmp(commands.data(), responses.data(),
+                               commands.size()));
+}
+#endif  // SANITIZER_POSIX && !SANITIZER_MAC
+
 }  // namespace __sanitizer
@@ -69,6 +69,12 @@ SymbolizedStack *SymbolizeCode(uptr addr) {
   return s;
 }
 
+void SymbolizeCodes(const uptr *addresses, uptr count,
+                    SymbolizedStack **results) {
+  for (uptr i = 0; i < count; i++)
+    results[i] = SymbolizeCode(addresses[i]);
+}
+
 extern "C" {
 
 static ThreadState *main_thr;
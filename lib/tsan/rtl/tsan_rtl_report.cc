@@ -108,15 +108,26 @@ ReportStack *SymbolizeStackId(u32 stack_id) {
 static ReportStack *SymbolizeStack(StackTrace trace) {
   if (trace.size == 0)
     return 0;
+  // Symbolize the frames in batches, kept off the (small) stack.
+  const uptr kBatchSize = 64;
+  InternalScopedBuffer<uptr> pcs(kBatchSize);
+  InternalScopedBuffer<SymbolizedStack *> ents(kBatchSize);
   SymbolizedStack *top = nullptr;
   for (uptr si = 0; si < trace.size; si++) {
     const uptr pc = trace.trace[si];
-    uptr pc1 = pc;
-    // We obtain the return address, but we're interested in the previous
-    // instruction.
-    if ((pc & kExternalPCBit) == 0)
-      pc1 = StackTrace::GetPreviousInstructionPc(pc);
-    SymbolizedStack *ent = SymbolizeCode(pc1);
+    if (si % kBatchSize == 0) {
+      uptr n = Min(trace.size - si, kBatchSize);
+      for (uptr i = 0; i < n; i++) {
+        uptr pc1 = trace.trace[si + i];
+        // We obtain the return address, but we're interested in the previous
+        // instruction.
+        if ((pc1 & kExternalPCBit) == 0)
+          pc1 = StackTrace::GetPreviousInstructionPc(pc1);
+        pcs[i] = pc1;
+      }
+      SymbolizeCodes(pcs.data(), n, ents.data());
+    }
+    SymbolizedStack *ent = ents[si % kBatchSize];
     CHECK_NE(ent, 0);
     SymbolizedStack *last = ent;
     while (last->next) {
@@ -66,6 +66,24 @@ SymbolizedStack *SymbolizeCode(uptr addr) {
   return Symbolizer::GetOrInit()->SymbolizePC(addr);
 }
 
+void SymbolizeCodes(const uptr *addresses, uptr count,
+                    SymbolizedStack **results) {
+  // Batch the runs of native PCs, external ones are symbolized one by one.
+  for (uptr i = 0; i < count;) {
+    if (addresses[i] & kExternalPCBit) {
+      results[i] = SymbolizeCode(addresses[i]);
+      i++;
+      continue;
+    }
+    uptr end = i + 1;
+    while (end < count && (addresses[end] & kExternalPCBit) == 0)
+      end++;
+    Symbolizer::GetOrInit()->SymbolizePCs(addresses + i, end - i,
+                                          results + i);
+    i = end;
+  }
+}
+
 ReportLocation *SymbolizeData(uptr addr) {
   DataInfo info;
   if (!Symbolizer::GetOrInit()->SymbolizeData(addr, &info))
@@ -21,6 +21,10 @@ namespace __tsan {
 void EnterSymbolizer();
 void ExitSymbolizer();
 SymbolizedStack *SymbolizeCode(uptr addr);
+// Symbolizes |count| addresses at once, results[i] is the same as
+// SymbolizeCode(addresses[i]).
+void SymbolizeCodes(const uptr *addresses, uptr count,
+                    SymbolizedStack **results);
 ReportLocation *SymbolizeData(uptr addr);
 void SymbolizeFlush();
 
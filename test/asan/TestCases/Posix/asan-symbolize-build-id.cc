@@ -0,0 +1,30 @@
+// Check that asan_symbolize.py symbolizes the records printed with
+// symbolize_offline=1, looking the binary up by its build ID.
+// REQUIRES: x86_64-target-arch
+// RUN: %clangxx_asan -O0 -Wl,--build-id %s -o %t
+// RUN: rm -rf %t-dir && mkdir -p %t-dir
+// RUN: %env_asan_opts=symbolize_offline=1 not %run %t 2>%t.log
+// RUN: FileCheck %s --check-prefix=CHECK-OFFLINE < %t.log
+// RUN: BUILD_ID=`sed -n 's/.*#0 .*(BuildId: \([0-9a-f]*\)).*/\1/p' %t.log | head -1`; \
+// RUN:   mkdir -p %t-dir/.build-id/`echo $BUILD_ID | cut -c1-2` && \
+// RUN:   cp %t %t-dir/.build-id/`echo $BUILD_ID | cut -c1-2`/`echo $BUILD_ID | cut -c3-`.debug
+// RUN: sed 's|(%t+|(/nonexistent/binary+|' %t.log | %asan_symbolize -b %t-dir | FileCheck %s
+
+#include <stdlib.h>
+
+__attribute__((noinline)) static void Crash(int *p) {
+  p[10] = 0;
+}
+
+int main() {
+  int *p = (int *)malloc(10 * sizeof(int));
+  Crash(p);
+  free(p);
+  return 0;
+}
+// CHECK-OFFLINE: #0 0x{{[0-9a-f]+}} ({{.*}}+0x{{[0-9a-f]+}}) (BuildId: {{[0-9a-f]+}})
+// CHECK-OFFLINE-NOT: in Crash
+
+// CHECK: heap-buffer-overflow
+// CHECK: #0 0x{{[0-9a-f]+}} in {{.*}}Crash
+// CHECK: #{{[0-9]+}} 0x{{[0-9a-f]+}} in main
@@ -0,0 +1,50 @@
+// Test the compact coverage format (coverage_compact=1) with and without
+// sandboxing.
+
+// RUN: %clangxx_asan -fsanitize-coverage=edge %s -o %t
+// RUN: rm -rf %T/coverage-compact
+
+// RUN: mkdir -p %T/coverage-compact/normal
+// RUN: %env_asan_opts=coverage=1:coverage_dir=%T/coverage-compact/normal %run %t
+// RUN: %sancov print %T/coverage-compact/normal/*.sancov > %T/coverage-compact/normal.txt
+
+// RUN: mkdir -p %T/coverage-compact/compact
+// RUN: %env_asan_opts=coverage=1:coverage_compact=1:coverage_dir=%T/coverage-compact/compact:verbosity=1 %run %t 2>&1 | FileCheck %s
+// RUN: %sancov print %T/coverage-compact/compact/*.sancov > %T/coverage-compact/compact.txt 2> %T/coverage-compact/compact.err
+// RUN: FileCheck %s --check-prefix=SANCOV < %T/coverage-compact/compact.err
+// RUN: diff %T/coverage-compact/normal.txt %T/coverage-compact/compact.txt
+
+// RUN: mkdir -p %T/coverage-compact/packed
+// RUN: cd %T/coverage-compact/packed
+// RUN: %env_asan_opts=coverage=1:coverage_compact=1:coverage_dir=%T/coverage-compact/packed %run %t sandbox
+// RUN: %sancov unpack *.sancov.packed
+// RUN: %sancov print *.sancov > %T/coverage-compact/packed.txt
+// RUN: diff %T/coverage-compact/normal.txt %T/coverage-compact/packed.txt
+//
+// UNSUPPORTED: android
+
+#include <sanitizer/common_interface_defs.h>
+#include <stdio.h>
+#include <string.h>
+
+__attribute__((noinline)) void foo(int i) {
+  if (i & 1)
+    printf("odd\n");
+  else
+    printf("even\n");
+}
+
+int main(int argc, char **argv) {
+  for (int i = 0; i < 3; i++)
+    foo(i);
+  if (argc > 1 && !strcmp(argv[1], "sandbox")) {
+    __sanitizer_sandbox_arguments args = {0};
+    args.coverage_sandboxed = 1;
+    args.coverage_fd = -1;
+    __sanitizer_sandbox_on_notify(&args);
+  }
+  return 0;
+}
+
+// CHECK: CovDump: {{.*}}.sancov: {{[0-9]+}} PCs written in {{[0-9]+}} bytes (compact)
+// SANCOV: read {{[0-9]+}} compact PCs from
@@ -0,0 +1,64 @@
+// Test the live coverage bitmap (coverage_live=1).
+
+// RUN: %clangxx_asan -fsanitize-coverage=func %s -o %t
+// RUN: rm -rf %T/coverage-live
+// RUN: mkdir -p %T/coverage-live && cd %T/coverage-live
+// RUN: %env_asan_opts=coverage=1:coverage_live=1:coverage_dir=%T/coverage-live %run %t 2>&1 | FileCheck %s
+// RUN: %sancov live *.sancov.live 2>&1 | FileCheck %s --check-prefix=SANCOV
+//
+// XFAIL: android
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+struct LiveHeader {
+  uint64_t magic;
+  uint32_t version;
+  uint32_t header_size;
+  uint64_t pid;
+  uint64_t num_blocks;
+  uint64_t num_covered;
+  uint64_t reserved[3];
+};
+
+__attribute__((noinline)) uint64_t Covered() {
+  char path[64];
+  snprintf(path, sizeof(path), "%d.sancov.live", getpid());
+  FILE *f = fopen(path, "rb");
+  assert(f);
+  LiveHeader header;
+  assert(fread(&header, sizeof(header), 1, f) == 1);
+  fclose(f);
+  assert(header.magic == 0xC0BFFFFFFFFF11FEULL);
+  assert(header.pid == (uint64_t)getpid());
+  return header.num_covered;
+}
+
+__attribute__((noinline)) void foo() { printf("foo\n"); }
+__attribute__((noinline)) void bar() { printf("bar\n"); }
+__attribute__((noinline)) void baz() { printf("baz\n"); }
+
+int main(int argc, char **argv) {
+  uint64_t before = Covered();
+  foo();
+  uint64_t after = Covered();
+  fprintf(stderr, "covered: %d\n", (int)(after - before));
+  pid_t child_pid = fork();
+  if (child_pid == 0) {
+    baz();
+    _exit(0);
+  }
+  waitpid(child_pid, nullptr, 0);
+  fprintf(stderr, "parent: %d\n", (int)(Covered() - after));
+  // The bitmap is kept up to date without a coverage dump.
+  _exit(0);
+}
+
+// CHECK: covered: 1
+// CHECK: parent: 0
+
+// SANCOV-DAG: pid {{[0-9]+}}: 3 of 5 blocks covered
+// SANCOV-DAG: pid {{[0-9]+}}: 1 of 5 blocks covered
@@ -0,0 +1,62 @@
+// RUN: %clang_dfsan %s -o %t && %run %t
+
+// Tests label set queries on deeply nested unions: dfsan_has_label,
+// dfsan_has_label_with_desc and dfsan_get_base_labels.
+
+#include <sanitizer/dfsan_interface.h>
+#include <assert.h>
+
+#define DEPTH 64
+#define NUM_MANY 200
+
+int main(void) {
+  dfsan_label bases[1 + 2 * DEPTH];
+  int num_bases = 0;
+  dfsan_label first = dfsan_create_label("first", 0);
+  dfsan_label other = dfsan_create_label("other", 0);
+  bases[num_bases++] = first;
+
+  // Every level is the union of two unions sharing the previous level, which
+  // used to take time exponential in the depth to query.
+  dfsan_label label = first;
+  for (int i = 0; i < DEPTH; i++) {
+    dfsan_label b = dfsan_create_label("b", 0);
+    dfsan_label c = dfsan_create_label("c", 0);
+    bases[num_bases++] = b;
+    bases[num_bases++] = c;
+    label = dfsan_union(dfsan_union(label, b), dfsan_union(label, c));
+  }
+
+  assert(dfsan_has_label(label, first));
+  assert(dfsan_has_label(label, bases[num_bases - 1]));
+  assert(!dfsan_has_label(label, other));
+  assert(!dfsan_has_label(first, label));
+  assert(dfsan_has_label_with_desc(label, "first") == first);
+  assert(dfsan_has_label_with_desc(label, "c") == bases[2]);
+  assert(!dfsan_has_label_with_desc(label, "other"));
+
+  dfsan_label labels[1 + 2 * DEPTH];
+  assert(dfsan_get_base_labels(label, labels, 1 + 2 * DEPTH) == num_bases);
+  for (int i = 0; i < num_bases; i++)
+    assert(labels[i] == bases[i]);
+  assert(dfsan_get_base_labels(label, labels, 1) == num_bases);
+  assert(labels[0] == first);
+  assert(dfsan_get_base_labels(first, labels, 1) == 1);
+  assert(labels[0] == first);
+  assert(dfsan_get_base_labels(0, labels, 1) == 0);
+
+  // More base labels than the cached bitsets track exactly.
+  dfsan_label many[NUM_MANY];
+  dfsan_label odd = 0;
+  for (int i = 0; i < NUM_MANY; i++) {
+    many[i] = dfsan_create_label("many", 0);
+    if (i % 2)
+      odd = dfsan_union(odd, many[i]);
+  }
+  for (int i = 0; i < NUM_MANY; i++)
+    assert(dfsan_has_label(odd, many[i]) == (i % 2));
+  assert(!dfsan_has_label(odd, first));
+  assert(dfsan_get_base_labels(odd, 0, 0) == NUM_MANY / 2);
+
+  return 0;
+}
@@ -1,5 +1,6 @@
 // RUN: %clang_dfsan %s -o %t && %run %t
 // RUN: %clang_dfsan -mllvm -dfsan-args-abi %s -o %t && %run %t
+// RUN: %clang_dfsan %s -o %t && DFSAN_OPTIONS=sparse_union_table=0 %run %t
 
 // Tests that labels are propagated through computation and that union labels
 // are properly created.
@@ -0,0 +1,63 @@
+// RUN: %clang_dfsan %s -o %t && %run %t
+
+// Tests the labels of multi-byte reads and writes of buffers whose shadow is
+// mostly uniform, at every offset and length around a vector of labels.
+
+#include <sanitizer/dfsan_interface.h>
+#include <assert.h>
+#include <string.h>
+
+#define SIZE 64
+
+static char buf[SIZE], copy[SIZE];
+
+int main(void) {
+  dfsan_label i_label = dfsan_create_label("i", 0);
+  dfsan_label j_label = dfsan_create_label("j", 0);
+  dfsan_label k_label = dfsan_create_label("k", 0);
+  dfsan_label ij_label = dfsan_union(i_label, j_label);
+  dfsan_label ijk_label = dfsan_union(ij_label, k_label);
+
+  for (int len = 1; len <= SIZE; ++len) {
+    memset(buf, 'a', SIZE);
+    buf[len - 1] = 0;
+    dfsan_set_label(0, buf, SIZE);
+    assert(dfsan_read_label(buf, len) == 0);
+    dfsan_set_label(i_label, buf, len);
+    assert(dfsan_read_label(buf, len) == i_label);
+    for (int pos = 0; pos < len; ++pos) {
+      // A single other label anywhere in the run.
+      dfsan_set_label(j_label, buf + pos, 1);
+      assert(dfsan_read_label(buf, len) == (len == 1 ? j_label : ij_label));
+      dfsan_set_label(i_label, buf + pos, 1);
+
+      // Unlabeled bytes do not change the label.
+      dfsan_set_label(0, buf + pos, 1);
+      assert(dfsan_read_label(buf, len) == (len == 1 ? 0 : i_label));
+      dfsan_set_label(i_label, buf + pos, 1);
+    }
+
+    // Runs of labels mixed with unlabeled bytes.
+    for (int pos = 0; pos < len; ++pos)
+      dfsan_set_label(pos % 3 ? 0 : j_label, buf + pos, 1);
+    dfsan_set_label(k_label, buf + len - 1, 1);
+    assert(dfsan_read_label(buf, len) ==
+           (len == 1 ? k_label : dfsan_union(j_label, k_label)));
+
+    // strcpy copies the labels of the string and its terminator.
+    dfsan_set_label(0, copy, SIZE);
+    strcpy(copy, buf);
+    for (int pos = 0; pos < len; ++pos)
+      assert(dfsan_read_label(copy + pos, 1) == dfsan_read_label(buf + pos, 1));
+    assert(dfsan_read_label(copy + len, SIZE - len) == 0);
+
+    dfsan_set_label(ij_label, buf, len);
+    dfsan_add_label(k_label, buf, len);
+    for (int pos = 0; pos < len; ++pos)
+      assert(dfsan_read_label(buf + pos, 1) == ijk_label);
+    if (len < SIZE)
+      assert(dfsan_read_label(buf + len, SIZE - len) == 0);
+  }
+
+  return 0;
+}
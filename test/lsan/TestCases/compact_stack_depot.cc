@@ -0,0 +1,32 @@
+// Test that leak reports are correct with the compact stack depot.
+// RUN: LSAN_BASE="use_stacks=0:use_registers=0:malloc_context_size=30:fast_unwind_on_malloc=1"
+// RUN: %clangxx_lsan %s -o %t
+// RUN: LSAN_OPTIONS=$LSAN_BASE:compact_stack_depot=1 not %run %t 2>&1 | FileCheck %s
+
+#include <stdio.h>
+#include <stdlib.h>
+
+void *sink;
+
+__attribute__((noinline))
+void *Recurse(int depth, size_t size) {
+  if (depth == 0)
+    return malloc(size);
+  void *res = Recurse(depth - 1, size);
+  sink = 0;  // Prevent tail call optimization.
+  return res;
+}
+
+int main() {
+  // The stacks of these allocations are stored as several depot segments.
+  free(Recurse(20, 1));
+  sink = Recurse(20, 1337);
+  sink = 0;
+  return 0;
+}
+// CHECK: Direct leak of 1337 byte(s) in 1 object(s) allocated from:
+// CHECK: #0 {{.*}}malloc
+// CHECK: #1 {{.*}}Recurse
+// CHECK: #2 {{.*}}Recurse
+// CHECK: main
+// CHECK: SUMMARY: {{(Leak|Address)}}Sanitizer: 1337 byte(s) leaked in 1 allocation(s)
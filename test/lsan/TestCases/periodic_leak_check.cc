@@ -0,0 +1,21 @@
+// Test for periodic leak checking from a background thread.
+// RUN: LSAN_BASE="use_stacks=0:use_registers=0:recoverable_leak_check_interval_ms=100"
+// RUN: %clangxx_lsan %s -o %t
+// RUN: LSAN_OPTIONS=$LSAN_BASE %run %t 2>&1 | FileCheck %s
+// RUN: LSAN_OPTIONS=$LSAN_BASE:use_fork_snapshot=1 %run %t 2>&1 | FileCheck %s
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+void *p;
+
+int main() {
+  p = malloc(1337);
+  p = 0;
+  sleep(1);
+  fprintf(stderr, "Done.\n");
+  _exit(0);
+}
+// CHECK: SUMMARY: {{(Leak|Address)}}Sanitizer: 1337 byte
+// CHECK: Done.
@@ -0,0 +1,36 @@
+// Test for on-demand leak checking in a fork snapshot.
+// RUN: LSAN_BASE="use_stacks=0:use_registers=0:use_fork_snapshot=1"
+// RUN: %clangxx_lsan %s -o %t
+// RUN: LSAN_OPTIONS=$LSAN_BASE %run %t 2>&1 | FileCheck %s
+// RUN: LSAN_OPTIONS=$LSAN_BASE:report_objects=1 %run %t 2>&1 | FileCheck %s --check-prefix=CHECK-OBJECTS
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sanitizer/lsan_interface.h>
+
+void *p;
+
+int main(int argc, char *argv[]) {
+  p = malloc(23);
+
+  assert(__lsan_do_recoverable_leak_check() == 0);
+
+  void *q = malloc(1337);
+  fprintf(stderr, "Test alloc: %p.\n", q);
+  q = 0;
+// CHECK: Test alloc:
+// CHECK-OBJECTS: Test alloc: [[ADDR:.*]].
+
+  assert(__lsan_do_recoverable_leak_check() == 1);
+// CHECK: SUMMARY: {{(Leak|Address)}}Sanitizer: 1337 byte
+// CHECK-OBJECTS: [[ADDR]] (1337 bytes)
+
+  // The snapshot must not modify chunk tags in the parent.
+  p = 0;
+  assert(__lsan_do_recoverable_leak_check() == 1);
+// CHECK: SUMMARY: {{(Leak|Address)}}Sanitizer: 1360 byte
+
+  _exit(0);
+}
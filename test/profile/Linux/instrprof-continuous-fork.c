@@ -0,0 +1,35 @@
+// RUN: %clang_profgen -o %t -O3 %s
+// RUN: rm -f %t.profraw
+// RUN: env LLVM_PROFILE_FILE=%t%c.profraw %run %t
+// RUN: llvm-profdata merge -o %t.profdata %t.profraw
+// RUN: %clang_profuse=%t.profdata -o - -S -emit-llvm %s | FileCheck %s
+
+// A forked child updates the counters in the profile file it shares with its
+// parent, but not the variables after the counters section.
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+static int Global;
+
+void foo(int);
+int main(void) {
+  int Status;
+  pid_t Pid = fork();
+  if (Pid == 0) {
+    foo(1);
+    Global = 1;
+    _exit(0);
+  }
+  if (Pid == -1 || waitpid(Pid, &Status, 0) != Pid || Status)
+    return 1;
+  foo(0);
+  foo(0);
+  return Global;
+}
+void foo(int N) {
+  // CHECK-LABEL: define void @foo(
+  // CHECK: br i1 %{{.*}}, label %{{.*}}, label %{{.*}}, !prof ![[FOO:[0-9]+]]
+  if (N) {}
+}
+// CHECK: ![[FOO]] = !{!"branch_weights", i32 2, i32 3}
@@ -0,0 +1,26 @@
+// RUN: %clang_profgen -o %t -O3 %s
+// RUN: rm -f %t.profraw %t-other.profraw
+// RUN: env LLVM_PROFILE_FILE=%t%c.profraw %run %t %t-other.profraw
+// RUN: llvm-profdata merge -o %t.profdata %t-other.profraw
+// RUN: %clang_profuse=%t.profdata -o - -S -emit-llvm %s | FileCheck %s
+// RUN: llvm-profdata merge -o %t.profdata %t.profraw
+
+// Setting another filename leaves the continuous mode, and the profile is
+// written to the new file at exit as usual.
+
+void __llvm_profile_set_filename(const char *);
+
+void foo(int);
+int main(int argc, char *argv[]) {
+  foo(1);
+  __llvm_profile_set_filename(argv[1]);
+  foo(0);
+  foo(0);
+  return 0;
+}
+void foo(int N) {
+  // CHECK-LABEL: define void @foo(
+  // CHECK: br i1 %{{.*}}, label %{{.*}}, label %{{.*}}, !prof ![[FOO:[0-9]+]]
+  if (N) {}
+}
+// CHECK: ![[FOO]] = !{!"branch_weights", i32 2, i32 3}
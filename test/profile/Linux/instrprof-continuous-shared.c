@@ -0,0 +1,40 @@
+// RUN: %clang_profgen -o %t -O3 %s
+// RUN: rm -f %t.profraw
+// RUN: env LLVM_PROFILE_FILE=%t%c.profraw %run %t
+// RUN: env LLVM_PROFILE_FILE=%t%c.profraw %run %t
+// RUN: llvm-profdata merge -o %t.profdata %t.profraw
+// RUN: %clang_profuse=%t.profdata -o - -S -emit-llvm %s | FileCheck %s
+
+// Without "%p" in the filename, the processes share the counters in the
+// profile file. A process starting while another one has the counters mapped
+// doesn't overwrite them.
+
+#include <stdlib.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+void foo(int);
+int main(int argc, char *argv[]) {
+  int Status;
+  pid_t Pid;
+  if (argc > 1) {
+    foo(1);
+    return 0;
+  }
+  Pid = fork();
+  if (Pid == 0) {
+    execl(argv[0], argv[0], "child", (char *)0);
+    _exit(1);
+  }
+  if (Pid == -1 || waitpid(Pid, &Status, 0) != Pid || Status)
+    return 1;
+  foo(0);
+  foo(0);
+  return 0;
+}
+void foo(int N) {
+  // CHECK-LABEL: define void @foo(
+  // CHECK: br i1 %{{.*}}, label %{{.*}}, label %{{.*}}, !prof ![[FOO:[0-9]+]]
+  if (N) {}
+}
+// CHECK: ![[FOO]] = !{!"branch_weights", i32 3, i32 5}
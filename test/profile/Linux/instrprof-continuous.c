@@ -0,0 +1,25 @@
+// RUN: %clang_profgen -o %t -O3 %s
+// RUN: rm -f %t.profraw
+// RUN: env LLVM_PROFILE_FILE=%t%c.profraw %expect_crash %run %t
+// RUN: llvm-profdata merge -o %t.profdata %t.profraw
+// RUN: %clang_profuse=%t.profdata -o - -S -emit-llvm %s | FileCheck %s
+
+// The counters are mapped onto the profile file and survive a SIGKILL.
+
+#include <signal.h>
+#include <unistd.h>
+
+void foo(int);
+int main(void) {
+  foo(1);
+  foo(1);
+  foo(0);
+  kill(getpid(), SIGKILL);
+  return 0;
+}
+void foo(int N) {
+  // CHECK-LABEL: define void @foo(
+  // CHECK: br i1 %{{.*}}, label %{{.*}}, label %{{.*}}, !prof ![[FOO:[0-9]+]]
+  if (N) {}
+}
+// CHECK: ![[FOO]] = !{!"branch_weights", i32 3, i32 2}
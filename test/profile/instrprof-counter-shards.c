@@ -0,0 +1,57 @@
+// RUN: %clang_profgen -o %t -O3 %s -lpthread
+// RUN: env LLVM_PROFILE_FILE=%t.profraw %run %t
+// RUN: llvm-profdata merge -o %t.profdata %t.profraw
+// RUN: llvm-profdata show --all-functions --counts %t.profdata | FileCheck %s
+// RUN: env LLVM_PROFILE_FILE=%t-off.profraw LLVM_PROFILE_COUNTER_SHARDS=0 %run %t
+// RUN: llvm-profdata merge -o %t-off.profdata %t-off.profraw
+// RUN: llvm-profdata show --all-functions --counts %t-off.profdata | FileCheck %s
+
+// Counts added through the counter shards of several threads end up in the
+// profile, whether sharding is on or off, including the ones added after the
+// profile was written to a buffer.
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+uint64_t *__llvm_profile_begin_counters(void);
+uint64_t *__llvm_profile_end_counters(void);
+uint64_t *__llvm_profile_get_counters_shard(void);
+uint64_t __llvm_profile_get_size_for_buffer(void);
+int __llvm_profile_write_buffer(char *Buffer);
+
+#define NUM_THREADS 4
+
+void never_called(void) {}
+
+static void *thread(void *Arg) {
+  uint64_t *Shard = __llvm_profile_get_counters_shard();
+  uint64_t *I;
+  for (I = __llvm_profile_begin_counters(); I != __llvm_profile_end_counters();
+       I++)
+    Shard[I - __llvm_profile_begin_counters()] += 1000;
+  return 0;
+}
+
+static void runThreads(void) {
+  pthread_t Threads[NUM_THREADS];
+  int I;
+  for (I = 0; I < NUM_THREADS; I++)
+    pthread_create(&Threads[I], 0, thread, 0);
+  for (I = 0; I < NUM_THREADS; I++)
+    pthread_join(Threads[I], 0);
+}
+
+int main(int argc, const char *argv[]) {
+  char *Buffer;
+  runThreads();
+  Buffer = malloc(__llvm_profile_get_size_for_buffer());
+  if (!Buffer || __llvm_profile_write_buffer(Buffer))
+    return 1;
+  free(Buffer);
+  runThreads();
+  return 0;
+}
+
+// CHECK-LABEL: never_called:
+// CHECK: Function count: 8000
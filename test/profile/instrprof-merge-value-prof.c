@@ -0,0 +1,49 @@
+// RUN: %clang_profgen -O2 -o %t %s
+// RUN: rm -rf %t.d && mkdir -p %t.d
+// RUN: env LLVM_PROFILE_FILE=%t.d/merge-%m.profraw %run %t
+// RUN: env LLVM_PROFILE_FILE=%t.d/merge-%m.profraw %run %t
+// RUN: env LLVM_PROFILE_FILE=%t.d/merge-%m.profraw %run %t
+// RUN: ls %t.d | count 1
+// RUN: llvm-profdata merge -o %t.profdata %t.d
+// RUN: llvm-profdata show --all-functions -ic-targets %t.profdata | FileCheck %s
+
+// With "%m", the processes add their counters to the same file. Value
+// profile data can't be merged in place, it is not written, and does not
+// prevent the counters from being merged.
+
+#include <stdint.h>
+typedef struct __llvm_profile_data __llvm_profile_data;
+const __llvm_profile_data *__llvm_profile_begin_data(void);
+const __llvm_profile_data *__llvm_profile_end_data(void);
+void __llvm_profile_set_num_value_sites(__llvm_profile_data *Data,
+                                        uint32_t ValueKind,
+                                        uint16_t NumValueSites);
+__llvm_profile_data *
+__llvm_profile_iterate_data(const __llvm_profile_data *Data);
+void *__llvm_get_function_addr(const __llvm_profile_data *Data);
+void __llvm_profile_instrument_target(uint64_t TargetValue, void *Data,
+                                      uint32_t CounterIndex);
+void callee() {}
+void caller_with_vp() {}
+
+int main(int argc, const char *argv[]) {
+  const __llvm_profile_data *Data, *DataEnd;
+  unsigned I;
+
+  Data = __llvm_profile_begin_data();
+  DataEnd = __llvm_profile_end_data();
+  for (; Data < DataEnd; Data = __llvm_profile_iterate_data(Data)) {
+    if (__llvm_get_function_addr(Data) != caller_with_vp)
+      continue;
+    __llvm_profile_set_num_value_sites((__llvm_profile_data *)Data,
+                                       0 /*IPVK_IndirectCallTarget */, 1);
+    for (I = 0; I < 100; I++)
+      __llvm_profile_instrument_target((uint64_t)&callee, (void *)Data, 0);
+  }
+  return 0;
+}
+
+// CHECK-NOT: callee, {{[0-9]+}} ]
+// CHECK-LABEL: main:
+// CHECK: Function count: 3
+// CHECK-NOT: callee, {{[0-9]+}} ]
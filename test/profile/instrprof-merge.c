@@ -0,0 +1,33 @@
+// RUN: %clang_profgen -o %t -O3 %s
+// RUN: rm -rf %t.d && mkdir -p %t.d
+// RUN: env LLVM_PROFILE_FILE=%t.d/merge-%m.profraw %run %t
+// RUN: env LLVM_PROFILE_FILE=%t.d/merge-%m.profraw %run %t
+// RUN: ls %t.d | count 1
+// RUN: llvm-profdata merge -o %t.profdata %t.d
+// RUN: %clang_profuse=%t.profdata -o - -S -emit-llvm %s | FileCheck %s
+// REQUIRES: shell
+
+#include <stdlib.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+void foo(int);
+int main(void) {
+  int I;
+  for (I = 0; I < 4; I++) {
+    pid_t Pid = fork();
+    if (Pid == 0) {
+      foo(1);
+      exit(0);
+    }
+    waitpid(Pid, 0, 0);
+  }
+  foo(0);
+  return 0;
+}
+void foo(int N) {
+  // CHECK-LABEL: define void @foo(
+  // CHECK: br i1 %{{.*}}, label %{{.*}}, label %{{.*}}, !prof ![[FOO:[0-9]+]]
+  if (N) {}
+}
+// CHECK: ![[FOO]] = !{!"branch_weights", i32 9, i32 3}
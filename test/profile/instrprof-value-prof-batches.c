@@ -0,0 +1,83 @@
+// RUN: %clang_profgen -O2 -o %t %s
+// RUN: env LLVM_PROFILE_FILE=%t.profraw %run %t
+// RUN: llvm-profdata merge -o %t.profdata %t.profraw
+// RUN: llvm-profdata show -function=caller_1_1_1_1_1_1_1_1_1 -ic-targets %t.profdata | FileCheck %s -check-prefix=FIRST
+// RUN: llvm-profdata show -function=caller_2_1_1_1_1_1_1_1 -ic-targets %t.profdata | FileCheck %s -check-prefix=MIDDLE
+// RUN: llvm-profdata show -function=caller_2_2_2_2_2_2_2_2 -ic-targets %t.profdata | FileCheck %s -check-prefix=LAST
+
+// The value profile records are written 256 at a time. Each of the 384
+// callers has one record, which must survive the batch boundary.
+
+#include <stdint.h>
+#include <stdlib.h>
+typedef struct __llvm_profile_data __llvm_profile_data;
+const __llvm_profile_data *__llvm_profile_begin_data(void);
+const __llvm_profile_data *__llvm_profile_end_data(void);
+void __llvm_profile_set_num_value_sites(__llvm_profile_data *Data,
+                                        uint32_t ValueKind,
+                                        uint16_t NumValueSites);
+__llvm_profile_data *
+__llvm_profile_iterate_data(const __llvm_profile_data *Data);
+void *__llvm_get_function_addr(const __llvm_profile_data *Data);
+void __llvm_profile_instrument_target(uint64_t TargetValue, void *Data,
+                                      uint32_t CounterIndex);
+
+#define DEF_FUNC(x)                                                            \
+  void x() {}
+#define DEF_2_FUNCS(x) DEF_FUNC(x##_1) DEF_FUNC(x##_2)
+#define DEF_4_FUNCS(x) DEF_2_FUNCS(x##_1) DEF_2_FUNCS(x##_2)
+#define DEF_8_FUNCS(x) DEF_4_FUNCS(x##_1) DEF_4_FUNCS(x##_2)
+#define DEF_16_FUNCS(x) DEF_8_FUNCS(x##_1) DEF_8_FUNCS(x##_2)
+#define DEF_32_FUNCS(x) DEF_16_FUNCS(x##_1) DEF_16_FUNCS(x##_2)
+#define DEF_64_FUNCS(x) DEF_32_FUNCS(x##_1) DEF_32_FUNCS(x##_2)
+#define DEF_128_FUNCS(x) DEF_64_FUNCS(x##_1) DEF_64_FUNCS(x##_2)
+#define DEF_256_FUNCS(x) DEF_128_FUNCS(x##_1) DEF_128_FUNCS(x##_2)
+
+#define FUNC_ADDR(x) &x,
+#define FUNC_2_ADDRS(x) FUNC_ADDR(x##_1) FUNC_ADDR(x##_2)
+#define FUNC_4_ADDRS(x) FUNC_2_ADDRS(x##_1) FUNC_2_ADDRS(x##_2)
+#define FUNC_8_ADDRS(x) FUNC_4_ADDRS(x##_1) FUNC_4_ADDRS(x##_2)
+#define FUNC_16_ADDRS(x) FUNC_8_ADDRS(x##_1) FUNC_8_ADDRS(x##_2)
+#define FUNC_32_ADDRS(x) FUNC_16_ADDRS(x##_1) FUNC_16_ADDRS(x##_2)
+#define FUNC_64_ADDRS(x) FUNC_32_ADDRS(x##_1) FUNC_32_ADDRS(x##_2)
+#define FUNC_128_ADDRS(x) FUNC_64_ADDRS(x##_1) FUNC_64_ADDRS(x##_2)
+#define FUNC_256_ADDRS(x) FUNC_128_ADDRS(x##_1) FUNC_128_ADDRS(x##_2)
+
+void callee() {}
+DEF_256_FUNCS(caller_1)
+DEF_128_FUNCS(caller_2)
+
+void *CallerAddrs[] = {FUNC_256_ADDRS(caller_1) FUNC_128_ADDRS(caller_2)};
+
+int main(int argc, const char *argv[]) {
+  const __llvm_profile_data *Data, *DataEnd;
+  unsigned I, C;
+
+  Data = __llvm_profile_begin_data();
+  DataEnd = __llvm_profile_end_data();
+
+  /* The I-th caller calls the callee I + 1 times. */
+  for (; Data < DataEnd; Data = __llvm_profile_iterate_data(Data)) {
+    void *Func = __llvm_get_function_addr(Data);
+    for (I = 0; I < 384; I++)
+      if (CallerAddrs[I] == Func)
+        break;
+    if (I == 384)
+      continue;
+    __llvm_profile_set_num_value_sites((__llvm_profile_data *)Data,
+                                       0 /*IPVK_IndirectCallTarget */, 1);
+    for (C = 0; C < I + 1; C++)
+      __llvm_profile_instrument_target((uint64_t)&callee, (void *)Data, 0);
+  }
+  return 0;
+}
+
+// FIRST: Indirect Call Site Count: 1
+// FIRST-NEXT: Indirect Target Results:
+// FIRST-NEXT: [ 0, callee, 1 ]
+// MIDDLE: Indirect Call Site Count: 1
+// MIDDLE-NEXT: Indirect Target Results:
+// MIDDLE-NEXT: [ 0, callee, 257 ]
+// LAST: Indirect Call Site Count: 1
+// LAST-NEXT: Indirect Target Results:
+// LAST-NEXT: [ 0, callee, 384 ]
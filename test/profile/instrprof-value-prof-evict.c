@@ -0,0 +1,58 @@
+// RUN: %clang_profgen -O2 -o %t %s
+// RUN: env LLVM_PROFILE_FILE=%t.profraw %run %t
+// RUN: llvm-profdata merge -o %t.profdata %t.profraw
+// RUN: llvm-profdata show --all-functions -ic-targets  %t.profdata | FileCheck  %s
+
+// A hot value showing up after a site is full of cold values displaces one of
+// them.
+
+#include <stdint.h>
+typedef struct __llvm_profile_data __llvm_profile_data;
+const __llvm_profile_data *__llvm_profile_begin_data(void);
+const __llvm_profile_data *__llvm_profile_end_data(void);
+void __llvm_profile_set_num_value_sites(__llvm_profile_data *Data,
+                                        uint32_t ValueKind,
+                                        uint16_t NumValueSites);
+__llvm_profile_data *
+__llvm_profile_iterate_data(const __llvm_profile_data *Data);
+void *__llvm_get_function_addr(const __llvm_profile_data *Data);
+void __llvm_profile_instrument_target(uint64_t TargetValue, void *Data,
+                                      uint32_t CounterIndex);
+void cold1() {}
+void cold2() {}
+void cold3() {}
+void cold4() {}
+void cold5() {}
+void cold6() {}
+void cold7() {}
+void cold8() {}
+void hot() {}
+void caller_with_vp() {}
+
+void *ColdTargets[] = {cold1, cold2, cold3, cold4,
+                       cold5, cold6, cold7, cold8};
+
+int main(int argc, const char *argv[]) {
+  const __llvm_profile_data *Data, *DataEnd;
+  unsigned I;
+
+  Data = __llvm_profile_begin_data();
+  DataEnd = __llvm_profile_end_data();
+  for (; Data < DataEnd; Data = __llvm_profile_iterate_data(Data)) {
+    if (__llvm_get_function_addr(Data) != caller_with_vp)
+      continue;
+    __llvm_profile_set_num_value_sites((__llvm_profile_data *)Data,
+                                       0 /*IPVK_IndirectCallTarget */, 1);
+    for (I = 0; I < 8; I++)
+      __llvm_profile_instrument_target((uint64_t)ColdTargets[I], (void *)Data,
+                                       0);
+    for (I = 0; I < 10000; I++)
+      __llvm_profile_instrument_target((uint64_t)&hot, (void *)Data, 0);
+  }
+  return 0;
+}
+
+// CHECK-LABEL:   caller_with_vp:
+// CHECK:         Indirect Call Site Count: 1
+// CHECK-NEXT:    Indirect Target Results:
+// CHECK:	[ 0, hot, {{[0-9]{4}[0-9]*}} ]
@@ -0,0 +1,72 @@
+// RUN: %clang_profgen -O2 -o %t %s -lpthread
+// RUN: env LLVM_PROFILE_FILE=%t.profraw %run %t
+// RUN: llvm-profdata merge -o %t.profdata %t.profraw
+// RUN: llvm-profdata show --all-functions -ic-targets  %t.profdata | FileCheck  %s
+
+// Threads recording the same targets at the same value sites don't lose
+// counts.
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+typedef struct __llvm_profile_data __llvm_profile_data;
+const __llvm_profile_data *__llvm_profile_begin_data(void);
+const __llvm_profile_data *__llvm_profile_end_data(void);
+void __llvm_profile_set_num_value_sites(__llvm_profile_data *Data,
+                                        uint32_t ValueKind,
+                                        uint16_t NumValueSites);
+__llvm_profile_data *
+__llvm_profile_iterate_data(const __llvm_profile_data *Data);
+void *__llvm_get_function_addr(const __llvm_profile_data *Data);
+void __llvm_profile_instrument_target(uint64_t TargetValue, void *Data,
+                                      uint32_t CounterIndex);
+void callee1() {}
+void callee2() {}
+void caller_with_vp() {}
+
+#define NUM_THREADS 8
+#define NUM_CALLS 100000
+
+static const __llvm_profile_data *CallerData;
+
+static void *thread(void *Arg) {
+  unsigned I;
+  for (I = 0; I < NUM_CALLS; I++) {
+    __llvm_profile_instrument_target((uint64_t)&callee1, (void *)CallerData,
+                                     I % 2);
+    if (I % 4 == 0)
+      __llvm_profile_instrument_target((uint64_t)&callee2, (void *)CallerData,
+                                       I % 2);
+  }
+  return 0;
+}
+
+int main(int argc, const char *argv[]) {
+  const __llvm_profile_data *Data, *DataEnd;
+  pthread_t Threads[NUM_THREADS];
+  unsigned I;
+
+  Data = __llvm_profile_begin_data();
+  DataEnd = __llvm_profile_end_data();
+  for (; Data < DataEnd; Data = __llvm_profile_iterate_data(Data))
+    if (__llvm_get_function_addr(Data) == caller_with_vp)
+      CallerData = Data;
+  if (!CallerData)
+    return 1;
+  __llvm_profile_set_num_value_sites((__llvm_profile_data *)CallerData,
+                                     0 /*IPVK_IndirectCallTarget */, 2);
+
+  for (I = 0; I < NUM_THREADS; I++)
+    pthread_create(&Threads[I], 0, thread, 0);
+  for (I = 0; I < NUM_THREADS; I++)
+    pthread_join(Threads[I], 0);
+  return 0;
+}
+
+// CHECK-LABEL:   caller_with_vp:
+// CHECK:         Indirect Call Site Count: 2
+// CHECK-NEXT:    Indirect Target Results:
+// CHECK-NEXT:	[ 0, callee1, 400000 ]
+// CHECK-NEXT:	[ 0, callee2, 200000 ]
+// CHECK-NEXT:	[ 1, callee1, 400000 ]
@@ -7,22 +7,6 @@
 // RUN: llvm-profdata show --all-functions -ic-targets  %t-2.profdata | FileCheck  %s -check-prefix=NO-VALUE
 // RUN: llvm-profdata show --all-functions -ic-targets  %t.profdata | FileCheck  %s
 // RUN: llvm-profdata show --all-functions -ic-targets  %t-merged.profdata | FileCheck  %s
-//
-// RUN: env LLVM_PROFILE_FILE=%t-3.profraw LLVM_VP_BUFFER_SIZE=1 %run %t 1
-// RUN: env LLVM_PROFILE_FILE=%t-4.profraw LLVM_VP_BUFFER_SIZE=8 %run %t 1
-// RUN: env LLVM_PROFILE_FILE=%t-5.profraw LLVM_VP_BUFFER_SIZE=128 %run %t 1
-// RUN: env LLVM_PROFILE_FILE=%t-6.profraw LLVM_VP_BUFFER_SIZE=1024 %run %t 1
-// RUN: env LLVM_PROFILE_FILE=%t-7.profraw LLVM_VP_BUFFER_SIZE=102400 %run %t 1
-// RUN: llvm-profdata merge -o %t-3.profdata %t-3.profraw
-// RUN: llvm-profdata merge -o %t-4.profdata %t-4.profraw
-// RUN: llvm-profdata merge -o %t-5.profdata %t-5.profraw
-// RUN: llvm-profdata merge -o %t-6.profdata %t-6.profraw
-// RUN: llvm-profdata merge -o %t-7.profdata %t-7.profraw
-// RUN: llvm-profdata show --all-functions -ic-targets  %t-3.profdata | FileCheck  %s
-// RUN: llvm-profdata show --all-functions -ic-targets  %t-4.profdata | FileCheck  %s
-// RUN: llvm-profdata show --all-functions -ic-targets  %t-5.profdata | FileCheck  %s
-// RUN: llvm-profdata show --all-functions -ic-targets  %t-6.profdata | FileCheck  %s
-// RUN: llvm-profdata show --all-functions -ic-targets  %t-7.profdata | FileCheck  %s
 
 #include <stdint.h>
 #include <stdio.h>
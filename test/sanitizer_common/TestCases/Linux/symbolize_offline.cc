@@ -0,0 +1,19 @@
+// Test that symbolize_offline=1 prints module+offset records with build IDs
+// instead of symbolizing.
+// RUN: %clangxx -O0 -Wl,--build-id %s -o %t
+// RUN: %env_tool_opts=symbolize_offline=1 %run %t 2>&1 | FileCheck %s
+
+#include <sanitizer/common_interface_defs.h>
+
+__attribute__((noinline)) static void FooBarBaz() {
+  __sanitizer_print_stack_trace();
+}
+
+int main() {
+  FooBarBaz();
+  return 0;
+}
+// CHECK-NOT: FooBarBaz
+// CHECK: {{    #1 0x[0-9a-f]+ \(.*symbolize_offline.cc.tmp\+0x[0-9a-f]+\) \(BuildId: [0-9a-f]+\)$}}
+// CHECK-NOT: FooBarBaz
+// CHECK: {{    #2 0x[0-9a-f]+ \(.*symbolize_offline.cc.tmp\+0x[0-9a-f]+\) \(BuildId: [0-9a-f]+\)$}}
@@ -0,0 +1,20 @@
+// Test that the ELF symbol tables give function names without an external
+// symbolizer, and instead of it with symbolize_with_symtab=1.
+// RUN: %clangxx -O0 %s -o %t
+// RUN: %env_tool_opts=symbolize_with_symtab=1 %run %t 2>&1 | FileCheck %s
+// RUN: %env_tool_opts=external_symbolizer_path= %run %t 2>&1 | FileCheck %s
+
+#include <sanitizer/common_interface_defs.h>
+
+__attribute__((noinline)) static void FooBarBaz() {
+  __sanitizer_print_stack_trace();
+}
+
+int main() {
+  FooBarBaz();
+  return 0;
+}
+// CHECK: {{    #0 0x.* in __sanitizer_print_stack_trace}}
+// CHECK-NOT: symbolize_with_symtab.cc:
+// CHECK: {{    #1 0x.* in .*FooBarBaz.*\+0x[0-9a-f]+ \(.*\+0x[0-9a-f]+\)}}
+// CHECK: {{    #2 0x.* in main\+0x[0-9a-f]+ \(.*\+0x[0-9a-f]+\)}}